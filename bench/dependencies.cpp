@@ -0,0 +1,111 @@
+// resolving imports and ordering modules of large compile units
+// usage: dependencies [module count in thousands]
+
+#include "../src/compile_unit.hpp"
+
+#include <boost/filesystem/path.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstddef>
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::size_t;
+using std::cout;
+using std::endl;
+using std::atoi;
+
+using boost::filesystem::path;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// modules in directories of 100, each one imports up to 4 earlier modules, some of them in other directories
+struct synthetic_unit
+{
+    vector<path> paths;
+    // parent directory and imported name, like in an import statement
+    vector<vector<string>> imports;
+};
+
+string module_directory(size_t module)
+{
+    return "dir" + to_string(module / 100);
+}
+string module_name(size_t module)
+{
+    return "module" + to_string(module);
+}
+
+synthetic_unit generate_unit(size_t module_count)
+{
+    synthetic_unit unit;
+    for(size_t module = 0; module != module_count; ++module)
+    {
+        unit.paths.push_back(path{"src"} / module_directory(module) / (module_name(module) + ".al"));
+        vector<string> imports;
+        for(size_t distance : {1, 2, 37, 1000})
+        {
+            if(distance > module)
+                continue;
+            size_t imported = module - distance;
+            if(imported / 100 == module / 100)
+                imports.push_back(module_name(imported));
+            else
+                imports.push_back("../" + module_directory(imported) + "/" + module_name(imported));
+        }
+        unit.imports.push_back(imports);
+    }
+    return unit;
+}
+
+template<class Functor>
+double best_seconds(Functor&& functor)
+{
+    double best = 1e100;
+    for(int i = 0; i != 5; ++i)
+    {
+        auto begin = steady_clock::now();
+        functor();
+        best = std::min(best, duration<double>(steady_clock::now() - begin).count());
+    }
+    return best;
+}
+
+int main(int argc, char** args)
+{
+    size_t thousands = argc > 1 ? atoi(args[1]) : 10;
+
+    // the time per module stays the same when the number of modules grows
+    for(size_t module_count : {thousands * 250, thousands * 500, thousands * 1000})
+    {
+        synthetic_unit unit = generate_unit(module_count);
+        vector<vector<size_t>> graph;
+        double resolve = best_seconds([&]
+        {
+            path_index index{unit.paths};
+            graph.assign(module_count, {});
+            for(size_t module = 0; module != module_count; ++module)
+            {
+                path parent = unit.paths[module].parent_path();
+                for(const string& imported : unit.imports[module])
+                    graph[module].push_back(*index.find(parent / (imported + ".al")));
+            }
+        });
+        size_t sorted = 0;
+        double sort = best_seconds([&]
+        {
+            sorted = toposort(graph).size();
+        });
+        cout << module_count << " modules: resolving imports " << (resolve * 1e3) << " ms ("
+            << (resolve / module_count * 1e9) << " ns/module), toposort " << (sort * 1e3) << " ms ("
+            << (sort / module_count * 1e9) << " ns/module)" << endl;
+        if(sorted != module_count)
+            return 1;
+    }
+}
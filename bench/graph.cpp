@@ -0,0 +1,186 @@
+// node creation and cloning in dynamic_graph
+// usage: graph [node count in thousands]
+
+#include "../src/dynamic_graph.hpp"
+#include "../src/node.hpp"
+#include "../src/compact_graph.hpp"
+#include "../src/macro_cache.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <unordered_map>
+#include <malloc.h>
+
+using std::string;
+using std::vector;
+using std::size_t;
+using std::cout;
+using std::endl;
+using std::atoi;
+using std::move;
+using std::unordered_map;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// counts all heap allocations of the program
+// (creating the std::string arguments of create_lit/create_ref counts, too)
+static size_t allocation_count = 0;
+
+void* operator new(size_t size)
+{
+    ++allocation_count;
+    if(void* result = std::malloc(size))
+        return result;
+    throw std::bad_alloc{};
+}
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+template<class Functor>
+void report(const char* name, size_t node_count, Functor&& functor)
+{
+    double best = 1e100;
+    size_t allocations = 0;
+    for(int i = 0; i != 5; ++i)
+    {
+        size_t allocations_before = allocation_count;
+        auto begin = steady_clock::now();
+        functor();
+        best = std::min(best, duration<double>(steady_clock::now() - begin).count());
+        allocations = allocation_count - allocations_before;
+    }
+    cout << name << ": " << (node_count / best / 1e6) << " M nodes/s, "
+        << (static_cast<double>(allocations) / node_count) << " allocations/node" << endl;
+}
+
+// a tree shaped like parsed code: lists of short lists of references and literals
+list_node& build_tree(dynamic_graph& graph, size_t node_count)
+{
+    vector<node*> statements;
+    statements.reserve(node_count / 5 + 1);
+    vector<node*> statement;
+    size_t created = 0;
+    while(created < node_count)
+    {
+        statement.clear();
+        statement.push_back(&graph.create_ref("add_int64"));
+        statement.push_back(&graph.create_ref("intermediate_result"));
+        statement.push_back(&graph.create_lit("1234"));
+        statement.push_back(&graph.create_lit("a longer literal, not stored inline"));
+        statements.push_back(&graph.create_list(statement));
+        created += 5;
+    }
+    return graph.create_list(statements);
+}
+
+// same as in module.cpp
+void dispatch_references(node& s, const unordered_map<identifier_id_t, const node&>& table)
+{
+    if(s.is<ref_node>())
+    {
+        ref_node& r = s.cast<ref_node>();
+        auto find_it = table.find(r.identifier_id());
+        if(find_it != table.end())
+            r.refered(&find_it->second);
+    }
+    else if(s.is<list_node>())
+    {
+        list_node& l = s.cast<list_node>();
+        for(node& child : l)
+            dispatch_references(child, table);
+    }
+}
+
+size_t allocated_bytes()
+{
+    return mallinfo2().uordblks;
+}
+
+int main(int argc, char** args)
+{
+    size_t node_count = (argc > 1 ? atoi(args[1]) : 1000) * size_t{1000};
+
+    report("create_*", node_count, [&]
+    {
+        dynamic_graph graph;
+        build_tree(graph, node_count);
+    });
+
+    dynamic_graph graph;
+    list_node& tree = build_tree(graph, node_count);
+    report("clone", node_count, [&]
+    {
+        dynamic_graph::clone(tree);
+    });
+
+    report("add", node_count, [&]
+    {
+        dynamic_graph target;
+        for(size_t i = 0; i != node_count / 100; ++i)
+        {
+            dynamic_graph part;
+            build_tree(part, 100);
+            target.add(move(part));
+        }
+    });
+
+    {
+        size_t bytes_before = allocated_bytes();
+        dynamic_graph measured;
+        build_tree(measured, node_count);
+        cout << "dynamic_graph: " << static_cast<double>(allocated_bytes() - bytes_before) / node_count << " bytes/node" << endl;
+    }
+    compact_graph compact{tree};
+    cout << "compact_graph: " << static_cast<double>(compact.memory_usage()) / compact.size() << " bytes/node" << endl;
+
+    report("compact_graph::clone", node_count, [&]
+    {
+        compact.clone(compact.root());
+    });
+    dynamic_graph other_graph;
+    list_node& other_tree = build_tree(other_graph, node_count);
+    bool volatile sink;
+    report("structurally_equal", node_count, [&]
+    {
+        sink = structurally_equal(tree, other_tree);
+    });
+    compact_graph other_compact{other_tree};
+    report("structurally_equal (compact_graph)", node_count, [&]
+    {
+        sink = structurally_equal(compact, compact.root(), other_compact, other_compact.root());
+    });
+    // comparisons of a cached macro call, the stored arguments are a compact_graph
+    report("structurally_identical", node_count, [&]
+    {
+        sink = structurally_identical(rangeify(tree), rangeify(other_tree));
+    });
+    report("structurally_identical (compact_graph)", node_count, [&]
+    {
+        sink = structurally_identical(compact, compact.root(), rangeify(other_tree));
+    });
+
+    lit_node& definition = graph.create_lit("definition");
+    unordered_map<identifier_id_t, const node&> table{{identifier_id("add_int64"), definition}};
+    report("dispatch_references", node_count, [&]
+    {
+        dispatch_references(tree, table);
+    });
+    unordered_map<identifier_id_t, node_handle> compact_table{{identifier_id("add_int64"), compact.child(compact.root(), 0)}};
+    report("dispatch_references (compact_graph)", node_count, [&]
+    {
+        dispatch_references(compact, compact.root(), compact_table);
+    });
+    (void) sink;
+}
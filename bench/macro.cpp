@@ -0,0 +1,126 @@
+// JIT latency and execution speed of a list-transforming macro at each optimization level, and of the interpreter
+// usage: macro [list length in thousands]
+
+#include "../src/compile_unit.hpp"
+#include "../src/compilation_context.hpp"
+#include "../src/dynamic_graph.hpp"
+#include "../src/node.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstddef>
+
+using std::string;
+using std::vector;
+using std::size_t;
+using std::cout;
+using std::endl;
+using std::atoi;
+using std::ofstream;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+using boost::filesystem::path;
+
+// copies the literals of the list passed as first argument into a new list
+const char* source = R"(
+import (macro node let return int alloc store load add cmp eq ne cond_branch is_lit list_get list_size list_create list_push) from "core";
+export copy_lits;
+
+def copy_lits macro ((s node)) node
+{
+	entry
+	{
+		let input list_get s 0;
+		let result list_create;
+		let size list_size input;
+		let i_loc (alloc (int 64));
+		(store (int 64)) 0 i_loc;
+		let is_empty (cmp eq (int 64)) size 0;
+		cond_branch is_empty done loop;
+	};
+	loop
+	{
+		let i (load (int 64)) i_loc;
+		let element list_get input i;
+		let is_literal is_lit element;
+		cond_branch is_literal copy skip;
+	};
+	copy
+	{
+		let copy_i (load (int 64)) i_loc;
+		let copied list_get input copy_i;
+		list_push result copied;
+		let copy_next (add (int 64)) copy_i 1;
+		(store (int 64)) copy_next i_loc;
+		let copy_more (cmp ne (int 64)) copy_next size;
+		cond_branch copy_more loop done;
+	};
+	skip
+	{
+		let skip_i (load (int 64)) i_loc;
+		let skip_next (add (int 64)) skip_i 1;
+		(store (int 64)) skip_next i_loc;
+		let skip_more (cmp ne (int 64)) skip_next size;
+		cond_branch skip_more loop done;
+	};
+	done
+	{
+		(return node) result;
+	};
+};
+)";
+
+double seconds_since(steady_clock::time_point begin)
+{
+    return duration<double>(steady_clock::now() - begin).count();
+}
+
+void run(const char* name, optimization_level level, size_t jit_threshold, const path& source_path, const list_node& args)
+{
+    compilation_context context;
+    context.macro_optimization_level(level);
+    context.macro_jit_threshold(jit_threshold);
+    vector<module> modules = compile_unit({source_path}, context);
+    const macro_node& macro = modules.front().exports.at(identifier_id("copy_lits")).cast<macro_node>();
+
+    // the first call optimizes and compiles the macro (unless it is interpreted)
+    auto begin = steady_clock::now();
+    macro(rangeify(args));
+    double first_call = seconds_since(begin);
+
+    double best = 1e100;
+    for(int i = 0; i != 5; ++i)
+    {
+        begin = steady_clock::now();
+        macro(rangeify(args));
+        best = std::min(best, seconds_since(begin));
+    }
+    size_t length = args[0].cast<list_node>().size();
+    cout << name << ": first call " << first_call * 1e3 << " ms, then "
+        << (length / best / 1e6) << " M elements/s" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t length = (argc > 1 ? atoi(argv[1]) : 1000) * size_t{1000};
+
+    path source_path = "bench-build/macro.al";
+    ofstream{source_path.native()} << source;
+
+    dynamic_graph graph;
+    vector<node*> elements;
+    for(size_t i = 0; i != length; ++i)
+        elements.push_back(i % 2 == 0 ? static_cast<node*>(&graph.create_lit("element")) : &graph.create_id(i));
+    list_node& args = graph.create_list({&graph.create_list(elements)});
+
+    run("none", optimization_level::NONE, 0, source_path, args);
+    run("O1", optimization_level::O1, 0, source_path, args);
+    run("O2", optimization_level::O2, 0, source_path, args);
+    run("interpreted", optimization_level::O2, 100, source_path, args);
+}
@@ -0,0 +1,134 @@
+// parser throughput on large generated sources
+// usage: parse [megabytes]
+
+#include "../src/parse_state.hpp"
+#include "../src/parse.hpp"
+#include "../src/scan.hpp"
+#include "../src/parallel_parse.hpp"
+#include "../src/parallel.hpp"
+#include "../src/ast_cache.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstddef>
+
+using std::string;
+using std::to_string;
+using std::size_t;
+using std::cout;
+using std::endl;
+using std::atoi;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// looks like generated code: long identifiers, deep indentation, comments and constants
+string generate_source(size_t min_size)
+{
+    string source;
+    for(size_t i = 0; source.size() < min_size; ++i)
+    {
+        string name = "generated_definition_" + to_string(i);
+        source += "# definition number " + to_string(i) + ", generated\n";
+        source += "def " + name + " proc ((first_argument (int 64)) (second_argument (int 64))) (int 64)\n";
+        source += "{\n";
+        source += "    entry_block\n";
+        source += "    {\n";
+        source += "        (let intermediate_result add_int64 first_argument second_argument);\n";
+        source += "        (let final_result add_int64 intermediate_result " + to_string(i * 7919) + ");\n";
+        source += "        (return_int64 final_result);\n";
+        source += "    };\n";
+        source += "};\n\n";
+    }
+    return source;
+}
+
+template<class Functor>
+double seconds(Functor&& functor)
+{
+    auto begin = steady_clock::now();
+    functor();
+    return duration<double>(steady_clock::now() - begin).count();
+}
+
+template<class Functor>
+void report(const char* name, size_t bytes, Functor&& functor)
+{
+    double best = 1e100;
+    for(int i = 0; i != 5; ++i)
+        best = std::min(best, seconds(functor));
+    cout << name << ": " << (bytes / best / (1 << 20)) << " MiB/s" << endl;
+}
+
+int main(int argc, char** args)
+{
+    size_t megabytes = argc > 1 ? atoi(args[1]) : 32;
+    string source = generate_source(megabytes << 20);
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    cout << "input: " << source.size() << " bytes" << endl;
+
+    string whitespace(source.size(), ' ');
+    string words(source.size(), 'w');
+    const char* volatile sink;
+    size_t volatile count_sink;
+
+    report("skip_whitespace (scalar)", whitespace.size(), [&]
+    {
+        sink = scan_detail::scalar::skip_whitespace(whitespace.data(), whitespace.data() + whitespace.size());
+    });
+    report("skip_whitespace (vector)", whitespace.size(), [&]
+    {
+        sink = scan::skip_whitespace(whitespace.data(), whitespace.data() + whitespace.size());
+    });
+    report("skip_word_chars (scalar)", words.size(), [&]
+    {
+        sink = scan_detail::scalar::skip_word_chars(words.data(), words.data() + words.size());
+    });
+    report("skip_word_chars (vector)", words.size(), [&]
+    {
+        sink = scan::skip_word_chars(words.data(), words.data() + words.size());
+    });
+    report("count_newlines (scalar)", source.size(), [&]
+    {
+        count_sink = scan_detail::scalar::count_newlines(begin, end);
+    });
+    report("count_newlines (vector)", source.size(), [&]
+    {
+        count_sink = scan::count_newlines(begin, end);
+    });
+
+    report("parse_file", source.size(), [&]
+    {
+        dynamic_graph graph;
+        parse_state<const char*> state{begin, end, 0, graph};
+        parse_file(state);
+    });
+    report("parse_file_parallel", source.size(), [&]
+    {
+        dynamic_graph graph;
+        parse_file_parallel(begin, end, 0, graph, 4 * worker_count());
+    });
+
+    const char* cache_path = "bench-build/parse.alc";
+    {
+        dynamic_graph graph;
+        parse_state<const char*> state{begin, end, 0, graph};
+        write_ast_cache(cache_path, content_hash(begin, end), begin, end, parse_file(state));
+    }
+    report("content_hash", source.size(), [&]
+    {
+        count_sink = content_hash(begin, end);
+    });
+    report("read_ast_cache (including hash)", source.size(), [&]
+    {
+        dynamic_graph graph;
+        if(!read_ast_cache(cache_path, content_hash(begin, end), begin, end, 0, graph))
+            cout << "cache miss" << endl;
+    });
+    (void) sink;
+    (void) count_sink;
+}
+
@@ -0,0 +1,176 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using std::size_t;
+using std::vector;
+using std::pair;
+using std::max;
+using std::min;
+using std::malloc;
+using std::free;
+using std::bad_alloc;
+
+namespace
+{
+
+constexpr size_t min_chunk_size = 4 << 10;
+constexpr size_t max_chunk_size = 1 << 20;
+
+}
+
+struct arena::chunk
+{
+    chunk* next;
+    size_t size;
+
+    char* begin()
+    {
+        return reinterpret_cast<char*>(this + 1);
+    }
+    char* end()
+    {
+        return begin() + size;
+    }
+};
+
+struct arena::finalizer
+{
+    finalizer* next;
+    void (*destroy)(void*);
+    void* object;
+};
+
+arena::arena(arena&& other) noexcept
+{
+    splice(other);
+}
+arena::~arena()
+{
+    release();
+}
+arena& arena::operator=(arena&& other) noexcept
+{
+    if(this != &other)
+    {
+        release();
+        splice(other);
+    }
+    return *this;
+}
+
+void arena::add_finalizer(void (*destroy)(void*), void* object)
+{
+    finalizer& f = create<finalizer>(finalizer{first_finalizer_, destroy, object});
+    first_finalizer_ = &f;
+    if(last_finalizer_ == nullptr)
+        last_finalizer_ = &f;
+}
+
+void arena::splice(arena& other)
+{
+    if(other.first_chunk_ == nullptr)
+        return;
+    if(first_chunk_ == nullptr)
+    {
+        first_chunk_ = other.first_chunk_;
+        last_chunk_ = other.last_chunk_;
+        pos_ = other.pos_;
+        end_ = other.end_;
+    }
+    else
+    {
+        // keep allocating from our own first chunk, the rest of other's is lost
+        last_chunk_->next = other.first_chunk_;
+        last_chunk_ = other.last_chunk_;
+    }
+    if(other.first_finalizer_ != nullptr)
+    {
+        if(first_finalizer_ == nullptr)
+            first_finalizer_ = other.first_finalizer_;
+        else
+            last_finalizer_->next = other.first_finalizer_;
+        last_finalizer_ = other.last_finalizer_;
+    }
+    next_chunk_size_ = max(next_chunk_size_, other.next_chunk_size_);
+
+    other.first_chunk_ = nullptr;
+    other.last_chunk_ = nullptr;
+    other.first_finalizer_ = nullptr;
+    other.last_finalizer_ = nullptr;
+    other.pos_ = nullptr;
+    other.end_ = nullptr;
+    other.next_chunk_size_ = 0;
+}
+
+size_t arena::chunk_count() const
+{
+    size_t count = 0;
+    for(chunk* c = first_chunk_; c != nullptr; c = c->next)
+        ++count;
+    return count;
+}
+
+vector<pair<const char*, const char*>> arena::chunk_ranges() const
+{
+    vector<pair<const char*, const char*>> ranges;
+    for(chunk* c = first_chunk_; c != nullptr; c = c->next)
+        ranges.push_back({c->begin(), c->end()});
+    return ranges;
+}
+
+void* arena::allocate_slow(size_t size, size_t alignment)
+{
+    static_assert(sizeof(chunk) % alignof(std::max_align_t) == 0, "");
+
+    next_chunk_size_ = next_chunk_size_ == 0 ? min_chunk_size : min(2 * next_chunk_size_, max_chunk_size);
+    size_t required = size + (alignment > alignof(std::max_align_t) ? alignment : 0);
+    // big allocations get a chunk of their own, so the current chunk is not wasted
+    bool dedicated = required > next_chunk_size_ / 4;
+    size_t chunk_size = dedicated ? required : next_chunk_size_;
+
+    chunk* c = static_cast<chunk*>(malloc(sizeof(chunk) + chunk_size));
+    if(c == nullptr)
+        throw bad_alloc{};
+    c->size = chunk_size;
+
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(c->begin());
+    char* result = reinterpret_cast<char*>((begin + alignment - 1) & ~(alignment - 1));
+    if(dedicated && first_chunk_ != nullptr)
+    {
+        c->next = first_chunk_->next;
+        first_chunk_->next = c;
+        if(last_chunk_ == first_chunk_)
+            last_chunk_ = c;
+    }
+    else
+    {
+        c->next = first_chunk_;
+        first_chunk_ = c;
+        if(last_chunk_ == nullptr)
+            last_chunk_ = c;
+        pos_ = result + size;
+        end_ = c->end();
+    }
+    return result;
+}
+
+void arena::release()
+{
+    for(finalizer* f = first_finalizer_; f != nullptr; f = f->next)
+        f->destroy(f->object);
+    for(chunk* c = first_chunk_; c != nullptr; )
+    {
+        chunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    first_chunk_ = nullptr;
+    last_chunk_ = nullptr;
+    first_finalizer_ = nullptr;
+    last_finalizer_ = nullptr;
+    pos_ = nullptr;
+    end_ = nullptr;
+}
+
@@ -0,0 +1,110 @@
+#ifndef ARENA_HPP_
+#define ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+// bump pointer allocator over a list of chunks
+// memory is only given back when the arena is destroyed, objects are not destroyed
+// unless a finalizer is registered for them
+class arena
+{
+public:
+    arena() = default;
+    arena(const arena&) = delete;
+    arena(arena&& other) noexcept;
+    ~arena();
+
+    arena& operator=(const arena&) = delete;
+    arena& operator=(arena&& other) noexcept;
+
+    // alignment has to be a power of two
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        std::uintptr_t pos = reinterpret_cast<std::uintptr_t>(pos_);
+        std::uintptr_t aligned = (pos + alignment - 1) & ~(alignment - 1);
+        std::uintptr_t end = reinterpret_cast<std::uintptr_t>(end_);
+        if(pos_ != nullptr && aligned <= end && size <= end - aligned)
+        {
+            pos_ = reinterpret_cast<char*>(aligned + size);
+            return pos_ - size;
+        }
+        return allocate_slow(size, alignment);
+    }
+    template<class T>
+    T* allocate_array(std::size_t count)
+    {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+    template<class T, class... Args>
+    T& create(Args&&... args)
+    {
+        return *new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // destroy(object) is called when the arena is destroyed
+    void add_finalizer(void (*destroy)(void*), void* object);
+
+    // takes over all memory and finalizers of other in constant time, other is empty afterwards
+    void splice(arena& other);
+
+    std::size_t chunk_count() const;
+    // [begin, end) of every chunk, in no particular order
+    std::vector<std::pair<const char*, const char*>> chunk_ranges() const;
+private:
+    struct chunk;
+    struct finalizer;
+
+    void* allocate_slow(std::size_t size, std::size_t alignment);
+    void release();
+
+    // allocations are served from the first chunk
+    chunk* first_chunk_ = nullptr;
+    chunk* last_chunk_ = nullptr;
+    finalizer* first_finalizer_ = nullptr;
+    finalizer* last_finalizer_ = nullptr;
+    char* pos_ = nullptr;
+    char* end_ = nullptr;
+    std::size_t next_chunk_size_ = 0;
+};
+
+// for standard containers that don't outlive the arena, deallocation does nothing
+template<class T>
+struct arena_allocator
+{
+    typedef T value_type;
+
+    arena_allocator(arena& new_memory)
+      : memory(&new_memory)
+    {}
+    template<class U>
+    arena_allocator(const arena_allocator<U>& other)
+      : memory(other.memory)
+    {}
+
+    T* allocate(std::size_t count)
+    {
+        return memory->allocate_array<T>(count);
+    }
+    void deallocate(T*, std::size_t)
+    {}
+
+    template<class U>
+    bool operator==(const arena_allocator<U>& other) const
+    {
+        return memory == other.memory;
+    }
+    template<class U>
+    bool operator!=(const arena_allocator<U>& other) const
+    {
+        return memory != other.memory;
+    }
+
+    arena* memory;
+};
+
+#endif
+
@@ -0,0 +1,302 @@
+#include "ast_cache.hpp"
+
+#include "mapped_file.hpp"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::string;
+using std::to_string;
+using std::vector;
+using std::unordered_map;
+using std::ofstream;
+using std::ios;
+using std::memcpy;
+using std::memcmp;
+using std::move;
+
+namespace
+{
+
+constexpr char cache_magic[4] = {'A', 'L', 'C', '\0'};
+constexpr uint32_t cache_version = 1;
+
+// layout of a cache file:
+// header, identifier_record[identifier_count], node_record[node_count], uint32_t[child_count]
+// nodes are in post order, so children come before their list and the root is the last node
+// every distinct identifier is listed once, so loading interns each of them only once
+struct cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t content_hash;
+    uint64_t source_size;
+    uint32_t identifier_count;
+    uint32_t node_count;
+    uint32_t child_count;
+    uint32_t unused;
+};
+
+// characters of an identifier in the source
+struct identifier_record
+{
+    uint32_t first;
+    uint32_t size;
+};
+
+enum record_kind
+  : uint8_t
+{
+    LITERAL,
+    REFERENCE,
+    LIST
+};
+
+struct node_record
+{
+    uint8_t kind;
+    uint8_t unused[3];
+    file_offset source_begin;
+    file_offset source_end;
+    // literals: characters in the source
+    // references: first character in the source and index of the identifier
+    // lists: child indices
+    uint32_t first;
+    uint32_t size;
+};
+
+class cache_writer
+{
+public:
+    cache_writer(const char* source_begin, const char* source_end)
+      : source_begin{source_begin},
+        source_end{source_end}
+    {}
+
+    bool write(const node& n)
+    {
+        node_record record = {};
+        const file_source* source = boost::get<file_source>(&n.source());
+        if(!source)
+            return false;
+        record.source_begin = source->begin;
+        record.source_end = source->end;
+
+        if(n.is<list_node>())
+        {
+            vector<uint32_t> child_indices;
+            for(const node& child : n.cast<list_node>())
+            {
+                if(!write(child))
+                    return false;
+                child_indices.push_back(records.size() - 1);
+            }
+            record.kind = LIST;
+            record.first = children.size();
+            record.size = child_indices.size();
+            children.insert(children.end(), child_indices.begin(), child_indices.end());
+        }
+        else if(n.is<lit_node>())
+        {
+            const lit_node& lit = n.cast<lit_node>();
+            record.kind = LITERAL;
+            if(!set_chars(record, lit.begin(), lit.end()))
+                return false;
+        }
+        else if(n.is<ref_node>())
+        {
+            const ref_node& ref = n.cast<ref_node>();
+            auto identifier = ref.identifier();
+            if(identifier.empty())
+                return false; // not created by the parser
+            record.kind = REFERENCE;
+            if(!set_chars(record, &identifier.front(), &identifier.front() + identifier.length()))
+                return false;
+            auto inserted = identifier_indices.insert({ref.identifier_id(), identifiers.size()});
+            if(inserted.second)
+                identifiers.push_back(identifier_record{record.first, record.size});
+            record.size = inserted.first->second;
+        }
+        else
+            return false; // not created by the parser
+        records.push_back(record);
+        return true;
+    }
+
+    vector<identifier_record> identifiers;
+    vector<node_record> records;
+    vector<uint32_t> children;
+private:
+    bool set_chars(node_record& record, const char* begin, const char* end)
+    {
+        if(begin < source_begin || end > source_end || begin > end)
+            return false;
+        record.first = begin - source_begin;
+        record.size = end - begin;
+        return true;
+    }
+
+    const char* source_begin;
+    const char* source_end;
+    unordered_map<identifier_id_t, uint32_t> identifier_indices;
+};
+
+}
+
+uint64_t content_hash(const char* begin, const char* end)
+{
+    // FNV-1a on 8 byte words, the cache only has to tell versions of a file apart
+    uint64_t hash = 14695981039346656037ull ^ static_cast<uint64_t>(end - begin);
+    for( ; end - begin >= 8; begin += 8)
+    {
+        uint64_t word;
+        memcpy(&word, begin, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    for( ; begin != end; ++begin)
+        hash = (hash ^ static_cast<uint8_t>(*begin)) * 1099511628211ull;
+    return hash;
+}
+
+bool write_ast_cache(const char* path, uint64_t hash, const char* source_begin, const char* source_end,
+        const list_node& syntax_tree)
+{
+    cache_writer writer{source_begin, source_end};
+    if(!writer.write(syntax_tree))
+        return false;
+
+    cache_header header = {};
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.content_hash = hash;
+    header.source_size = source_end - source_begin;
+    header.identifier_count = writer.identifiers.size();
+    header.node_count = writer.records.size();
+    header.child_count = writer.children.size();
+
+    // write to a temporary file and rename it, so readers never see half written caches
+    string temporary_path = string{path} + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream file{temporary_path, ios::binary | ios::trunc};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(writer.identifiers.data()),
+                writer.identifiers.size() * sizeof(identifier_record));
+        file.write(reinterpret_cast<const char*>(writer.records.data()), writer.records.size() * sizeof(node_record));
+        file.write(reinterpret_cast<const char*>(writer.children.data()), writer.children.size() * sizeof(uint32_t));
+        if(!file)
+        {
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+    }
+    if(std::rename(temporary_path.c_str(), path) != 0)
+    {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+list_node* read_ast_cache(const char* path, uint64_t hash, const char* source_begin, const char* source_end,
+        size_t file_id, dynamic_graph& graph)
+{
+    mapped_file file{path};
+    if(!file || file.size() < sizeof(cache_header))
+        return nullptr;
+
+    cache_header header;
+    memcpy(&header, file.begin(), sizeof(header));
+    size_t source_size = source_end - source_begin;
+    if(memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version
+            || header.content_hash != hash || header.source_size != source_size || header.node_count == 0)
+        return nullptr;
+    if(file.size() != sizeof(header) + header.identifier_count * sizeof(identifier_record)
+            + header.node_count * sizeof(node_record) + header.child_count * sizeof(uint32_t))
+        return nullptr;
+
+    // the mapping is page aligned and all sizes are multiples of 4
+    const identifier_record* identifiers = reinterpret_cast<const identifier_record*>(file.begin() + sizeof(header));
+    const node_record* records = reinterpret_cast<const node_record*>(identifiers + header.identifier_count);
+    const uint32_t* children = reinterpret_cast<const uint32_t*>(records + header.node_count);
+
+    auto is_in_source = [&](uint32_t first, uint32_t size)
+    {
+        return first <= source_size && size <= source_size - first;
+    };
+    vector<identifier_id_t> identifier_ids(header.identifier_count);
+    for(uint32_t i = 0; i != header.identifier_count; ++i)
+    {
+        if(!is_in_source(identifiers[i].first, identifiers[i].size))
+            return nullptr;
+        const char* begin = source_begin + identifiers[i].first;
+        identifier_ids[i] = identifier_id(begin, begin + identifiers[i].size);
+    }
+
+    // one pass front to back, children are created before the lists referring to them
+    dynamic_graph loaded;
+    vector<node*> nodes;
+    nodes.reserve(header.node_count);
+    for(uint32_t index = 0; index != header.node_count; ++index)
+    {
+        const node_record& record = records[index];
+        if(record.source_begin > record.source_end || record.source_end > source_size)
+            return nullptr;
+
+        node* created;
+        if(record.kind == LIST)
+        {
+            if(record.first > header.child_count || record.size > header.child_count - record.first)
+                return nullptr;
+            vector<node*> list_children(record.size);
+            for(uint32_t i = 0; i != record.size; ++i)
+            {
+                uint32_t child_index = children[record.first + i];
+                if(child_index >= index)
+                    return nullptr;
+                list_children[i] = nodes[child_index];
+            }
+            created = &loaded.create_list(move(list_children));
+        }
+        else if(record.kind == LITERAL)
+        {
+            if(!is_in_source(record.first, record.size))
+                return nullptr;
+            const char* begin = source_begin + record.first;
+            const char* end = begin + record.size;
+            created = &loaded.create_lit(begin, end, decode_integer(begin, end));
+        }
+        else if(record.kind == REFERENCE)
+        {
+            if(record.size >= header.identifier_count)
+                return nullptr;
+            uint32_t size = identifiers[record.size].size;
+            if(!is_in_source(record.first, size))
+                return nullptr;
+            const char* begin = source_begin + record.first;
+            created = &loaded.create_ref(begin, begin + size, identifier_ids[record.size]);
+        }
+        else
+            return nullptr;
+
+        created->source(file_source{record.source_begin, record.source_end, static_cast<uint32_t>(file_id)});
+        nodes.push_back(created);
+    }
+    if(!nodes.back()->is<list_node>())
+        return nullptr;
+
+    graph.add(move(loaded));
+    return &nodes.back()->cast<list_node>();
+}
+
@@ -0,0 +1,28 @@
+#ifndef AST_CACHE_HPP_
+#define AST_CACHE_HPP_
+
+#include "node.hpp"
+#include "dynamic_graph.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// binary cache of the syntax tree of a source file, stored next to it as <name>.alc
+// the cache is keyed by a hash of the source, and literals and references point into the source,
+// so loading needs the (mapped) source, too
+// the format uses the native byte order, caches are not meant to be copied between machines
+
+std::uint64_t content_hash(const char* begin, const char* end);
+
+// syntax_tree has to be the result of parsing [source_begin, source_end)
+// returns false if the cache couldn't be written
+bool write_ast_cache(const char* path, std::uint64_t hash, const char* source_begin, const char* source_end,
+        const list_node& syntax_tree);
+
+// returns nullptr if there is no cache for this source at path
+// (missing, written by another version, different hash, or corrupt)
+list_node* read_ast_cache(const char* path, std::uint64_t hash, const char* source_begin, const char* source_end,
+        std::size_t file_id, dynamic_graph& graph);
+
+#endif
+
@@ -0,0 +1,340 @@
+#include "compact_graph.hpp"
+
+#include <unordered_set>
+#include <algorithm>
+#include <cassert>
+
+using boost::get;
+using boost::blank;
+
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+using std::pair;
+using std::string;
+using std::move;
+using std::equal;
+using std::size_t;
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+
+compact_graph::compact_graph(const node& root)
+{
+    unordered_map<const node*, node_handle> handles;
+    // children and refered nodes are resolved once every node has a handle
+    vector<const node*> child_nodes;
+    vector<pair<node_handle, const node*>> references;
+    size_t next_reference = 0;
+
+    vector<const node*> stack{&root};
+    while(!stack.empty())
+    {
+        const node& current = *stack.back();
+        stack.pop_back();
+        if(handles.insert({&current, static_cast<node_handle>(size())}).second)
+        {
+            file_source source{0, 0, no_file};
+            if(const file_source* s = get<file_source>(&current.source()))
+                source = *s;
+
+            switch(current.type())
+            {
+            case node_type::ID:
+                push(node_type::ID, ids_.size(), 0, source);
+                ids_.push_back(current.cast<id_node>().id());
+                break;
+            case node_type::LITERAL:
+            {
+                const lit_node& lit = current.cast<lit_node>();
+                push(node_type::LITERAL, chars_.size(), lit.end() - lit.begin(), source);
+                chars_.insert(chars_.end(), lit.begin(), lit.end());
+                break;
+            }
+            case node_type::REFERENCE:
+            {
+                const ref_node& ref = current.cast<ref_node>();
+                node_handle handle = push(node_type::REFERENCE, ref.identifier_id(), null_handle, source);
+                if(ref.refered())
+                    references.push_back({handle, ref.refered()});
+                break;
+            }
+            case node_type::LIST:
+            {
+                const list_node& list = current.cast<list_node>();
+                push(node_type::LIST, child_nodes.size(), list.size(), source);
+                size_t first_child = child_nodes.size();
+                for(const node& child : list)
+                    child_nodes.push_back(&child);
+                // pushed in reverse, so the first child is numbered first
+                for(size_t i = child_nodes.size(); i != first_child; --i)
+                    stack.push_back(child_nodes[i - 1]);
+                break;
+            }
+            case node_type::MACRO:
+                push(node_type::MACRO, macros_.size(), 0, source);
+                macros_.push_back(current.cast<macro_node>());
+                break;
+            case node_type::PROC:
+                push(node_type::PROC, procs_.size(), 0, source);
+                procs_.push_back(current.cast<proc_node>());
+                break;
+            }
+        }
+
+        // nodes only reachable through references come after all nodes reachable through lists
+        if(stack.empty())
+        {
+            for( ; next_reference != references.size(); ++next_reference)
+                stack.push_back(references[next_reference].second);
+        }
+    }
+
+    children_.reserve(child_nodes.size());
+    for(const node* child : child_nodes)
+        children_.push_back(handles.at(child));
+    for(const auto& reference : references)
+        second_[reference.first] = handles.at(reference.second);
+}
+
+node_source compact_graph::source(node_handle n) const
+{
+    if(sources_[n].file_id == no_file)
+        return blank{};
+    return sources_[n];
+}
+
+node_handle compact_graph::push(node_type type, uint32_t first, uint32_t second, const file_source& source)
+{
+    assert(size() < null_handle);
+    types_.push_back(static_cast<uint8_t>(type));
+    first_.push_back(first);
+    second_.push_back(second);
+    sources_.push_back(source);
+    return size() - 1;
+}
+
+node_handle compact_graph::push_copy(const compact_graph& from, node_handle n)
+{
+    const file_source& source = from.sources_[n];
+    switch(from.type(n))
+    {
+    case node_type::ID:
+        ids_.push_back(from.id(n));
+        return push(node_type::ID, ids_.size() - 1, 0, source);
+    case node_type::LITERAL:
+    {
+        uint32_t first = chars_.size();
+        chars_.insert(chars_.end(), from.literal_begin(n), from.literal_end(n));
+        return push(node_type::LITERAL, first, from.second_[n], source);
+    }
+    case node_type::REFERENCE:
+        return push(node_type::REFERENCE, from.first_[n], from.second_[n], source);
+    case node_type::LIST:
+    {
+        const node_handle* children = from.children_.data() + from.first_[n];
+        uint32_t first = children_.size();
+        children_.insert(children_.end(), children, children + from.second_[n]);
+        return push(node_type::LIST, first, from.second_[n], source);
+    }
+    case node_type::MACRO:
+        macros_.push_back(from.macro(n));
+        return push(node_type::MACRO, macros_.size() - 1, 0, source);
+    case node_type::PROC:
+        procs_.push_back(from.proc(n));
+        return push(node_type::PROC, procs_.size() - 1, 0, source);
+    }
+    assert(false);
+    return null_handle;
+}
+
+compact_graph compact_graph::clone(node_handle n) const
+{
+    compact_graph result;
+    // dense map from handles of this graph to handles of the result
+    vector<node_handle> handles(size(), null_handle);
+    vector<node_handle> references;
+    size_t next_reference = 0;
+
+    vector<node_handle> stack{n};
+    while(!stack.empty())
+    {
+        node_handle current = stack.back();
+        stack.pop_back();
+        if(handles[current] == null_handle)
+        {
+            node_handle copy = result.push_copy(*this, current);
+            handles[current] = copy;
+            if(is<list_node>(current))
+            {
+                for(size_t i = child_count(current); i != 0; --i)
+                    stack.push_back(child(current, i - 1));
+            }
+            else if(is<ref_node>(current) && refered(current) != null_handle)
+                references.push_back(copy);
+        }
+
+        if(stack.empty())
+        {
+            // the copies still have the refered handles of this graph
+            for( ; next_reference != references.size(); ++next_reference)
+                stack.push_back(result.second_[references[next_reference]]);
+        }
+    }
+
+    for(node_handle& child : result.children_)
+        child = handles[child];
+    for(node_handle reference : references)
+        result.second_[reference] = handles[result.second_[reference]];
+    return result;
+}
+
+std::pair<node&, dynamic_graph> compact_graph::expand() const
+{
+    dynamic_graph graph;
+    vector<node*> nodes(size());
+    vector<node*> no_children;
+
+    // lists and references are connected once all nodes exist
+    for(node_handle n = 0; n != size(); ++n)
+    {
+        switch(type(n))
+        {
+        case node_type::ID:
+            nodes[n] = &graph.create_id(id(n));
+            break;
+        case node_type::LITERAL:
+            nodes[n] = &graph.create_lit(literal_begin(n), literal_end(n));
+            break;
+        case node_type::REFERENCE:
+        {
+            const string& str = identifier(n);
+            nodes[n] = &graph.create_ref(str.data(), str.data() + str.size(), identifier_id(n));
+            break;
+        }
+        case node_type::LIST:
+            no_children.assign(second_[n], nullptr);
+            nodes[n] = &graph.create_list(no_children);
+            break;
+        case node_type::MACRO:
+            nodes[n] = &(graph.create_macro() = macro(n));
+            break;
+        case node_type::PROC:
+            nodes[n] = &(graph.create_proc() = proc(n));
+            break;
+        }
+        nodes[n]->source(source(n));
+    }
+    for(node_handle n = 0; n != size(); ++n)
+    {
+        if(is<list_node>(n))
+        {
+            list_node& list = nodes[n]->cast<list_node>();
+            for(size_t i = 0; i != child_count(n); ++i)
+                graph.set_child(list, i, *nodes[child(n, i)]);
+        }
+        else if(is<ref_node>(n) && refered(n) != null_handle)
+            nodes[n]->cast<ref_node>().refered(nodes[refered(n)]);
+    }
+
+    node& root_node = *nodes[root()];
+    return {root_node, move(graph)};
+}
+
+size_t compact_graph::memory_usage() const
+{
+    return types_.capacity() * sizeof(uint8_t)
+        + first_.capacity() * sizeof(uint32_t)
+        + second_.capacity() * sizeof(uint32_t)
+        + sources_.capacity() * sizeof(file_source)
+        + chars_.capacity() * sizeof(char)
+        + children_.capacity() * sizeof(node_handle)
+        + ids_.capacity() * sizeof(size_t)
+        + macros_.capacity() * sizeof(macro_node)
+        + procs_.capacity() * sizeof(proc_node);
+}
+
+bool structurally_equal(const compact_graph& lhs, node_handle lhs_node, const compact_graph& rhs, node_handle rhs_node)
+{
+    // a pair of nodes that is already being compared is assumed to be equal, this terminates on cycles
+    // usually every lhs node is compared with one rhs node, other pairs go to the slower set
+    vector<node_handle> matched(lhs.size(), null_handle);
+    unordered_set<uint64_t> other_pairs;
+
+    vector<pair<node_handle, node_handle>> stack{{lhs_node, rhs_node}};
+    while(!stack.empty())
+    {
+        node_handle l = stack.back().first;
+        node_handle r = stack.back().second;
+        stack.pop_back();
+
+        if(matched[l] == r)
+            continue;
+        if(matched[l] == null_handle)
+            matched[l] = r;
+        else if(!other_pairs.insert(uint64_t{l} << 32 | r).second)
+            continue;
+
+        if(lhs.type(l) != rhs.type(r))
+            return false;
+        switch(lhs.type(l))
+        {
+        case node_type::ID:
+            if(lhs.id(l) != rhs.id(r))
+                return false;
+            break;
+        case node_type::LITERAL:
+            if(!equal(lhs.literal_begin(l), lhs.literal_end(l), rhs.literal_begin(r), rhs.literal_end(r)))
+                return false;
+            break;
+        case node_type::REFERENCE:
+            if(lhs.identifier_id(l) != rhs.identifier_id(r))
+                return false;
+            if(lhs.refered(l) == null_handle || rhs.refered(r) == null_handle)
+            {
+                if(lhs.refered(l) != rhs.refered(r))
+                    return false;
+            }
+            else
+                stack.push_back({lhs.refered(l), rhs.refered(r)});
+            break;
+        case node_type::LIST:
+            if(lhs.child_count(l) != rhs.child_count(r))
+                return false;
+            for(size_t i = lhs.child_count(l); i != 0; --i)
+                stack.push_back({lhs.child(l, i - 1), rhs.child(r, i - 1)});
+            break;
+        case node_type::MACRO:
+            if(lhs.macro(l).function() != rhs.macro(r).function())
+                return false;
+            break;
+        case node_type::PROC:
+            if(lhs.proc(l).ct_function() != rhs.proc(r).ct_function() || lhs.proc(l).rt_function() != rhs.proc(r).rt_function())
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
+void dispatch_references(compact_graph& graph, node_handle n, const unordered_map<identifier_id_t, node_handle>& table)
+{
+    vector<node_handle> stack{n};
+    while(!stack.empty())
+    {
+        node_handle current = stack.back();
+        stack.pop_back();
+        if(graph.is<ref_node>(current))
+        {
+            auto find_it = table.find(graph.identifier_id(current));
+            if(find_it != table.end())
+                graph.refered(current, find_it->second);
+        }
+        else if(graph.is<list_node>(current))
+        {
+            for(size_t i = graph.child_count(current); i != 0; --i)
+                stack.push_back(graph.child(current, i - 1));
+        }
+    }
+}
+
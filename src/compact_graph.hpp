@@ -0,0 +1,135 @@
+#ifndef COMPACT_GRAPH_HPP_
+#define COMPACT_GRAPH_HPP_
+
+#include "node.hpp"
+#include "dynamic_graph.hpp"
+#include "identifier.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+// nodes of a compact_graph are addressed by their index
+typedef std::uint32_t node_handle;
+constexpr node_handle null_handle = std::numeric_limits<node_handle>::max();
+
+// alternative representation of a node graph with one array per node property
+// nodes reachable through lists are numbered in pre-order, so traversals mostly walk the arrays front to back
+// per node: type, two 32 bit fields and the source, depending on the type the fields are
+//  - ID: index into ids_, unused
+//  - LITERAL: character range in chars_
+//  - REFERENCE: identifier id, refered node (the characters are the interned identifier)
+//  - LIST: child range in children_
+//  - MACRO, PROC: index into macros_/procs_, unused
+class compact_graph
+{
+public:
+    // copies all nodes reachable from root, root gets handle 0
+    explicit compact_graph(const node& root);
+
+    node_handle root() const
+    {
+        return 0;
+    }
+    std::size_t size() const
+    {
+        return types_.size();
+    }
+
+    node_type type(node_handle n) const
+    {
+        return static_cast<node_type>(types_[n]);
+    }
+    template<class NodeType>
+    bool is(node_handle n) const
+    {
+        return type(n) == NodeType::type_id;
+    }
+    node_source source(node_handle n) const;
+
+    std::size_t id(node_handle n) const
+    {
+        return ids_[first_[n]];
+    }
+    const char* literal_begin(node_handle n) const
+    {
+        return chars_.data() + first_[n];
+    }
+    const char* literal_end(node_handle n) const
+    {
+        return chars_.data() + first_[n] + second_[n];
+    }
+    identifier_id_t identifier_id(node_handle n) const
+    {
+        return first_[n];
+    }
+    const std::string& identifier(node_handle n) const
+    {
+        return identifier_string(first_[n]);
+    }
+    // null_handle for a reference without refered node
+    node_handle refered(node_handle n) const
+    {
+        return second_[n];
+    }
+    void refered(node_handle n, node_handle new_refered)
+    {
+        second_[n] = new_refered;
+    }
+    std::size_t child_count(node_handle n) const
+    {
+        return second_[n];
+    }
+    node_handle child(node_handle n, std::size_t index) const
+    {
+        return children_[first_[n] + index];
+    }
+    const macro_node& macro(node_handle n) const
+    {
+        return macros_[first_[n]];
+    }
+    const proc_node& proc(node_handle n) const
+    {
+        return procs_[first_[n]];
+    }
+
+    // the nodes reachable from n, n becomes the root
+    compact_graph clone(node_handle n) const;
+
+    // node objects for the node visit/cast API
+    // the literals refer to the characters of this compact_graph, so it has to outlive the result
+    std::pair<node&, dynamic_graph> expand() const;
+
+    // bytes allocated for the arrays
+    std::size_t memory_usage() const;
+private:
+    compact_graph() = default;
+
+    node_handle push(node_type type, std::uint32_t first, std::uint32_t second, const file_source& source);
+    node_handle push_copy(const compact_graph& from, node_handle n);
+
+    std::vector<std::uint8_t> types_;
+    std::vector<std::uint32_t> first_;
+    std::vector<std::uint32_t> second_;
+    std::vector<file_source> sources_; // file_id is no_file for nodes without source
+    
+    std::vector<char> chars_;
+    std::vector<node_handle> children_;
+    std::vector<std::size_t> ids_;
+    std::vector<macro_node> macros_;
+    std::vector<proc_node> procs_;
+
+    static constexpr std::uint32_t no_file = std::numeric_limits<std::uint32_t>::max();
+};
+
+// like the node version, but cycles are allowed and macros and procs are compared by the functions they call
+bool structurally_equal(const compact_graph& lhs, node_handle lhs_node, const compact_graph& rhs, node_handle rhs_node);
+
+// like dispatch_references in module.cpp: resolves references reachable from n through lists
+void dispatch_references(compact_graph& graph, node_handle n, const std::unordered_map<identifier_id_t, node_handle>& table);
+
+#endif
+
@@ -1,6 +1,7 @@
 #include "compilation_context.hpp"
 
 #include "core_module.hpp"
+#include "macro_code_cache.hpp"
 
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
@@ -8,19 +9,45 @@
 #include <llvm/ExecutionEngine/JIT.h>
 #include <llvm/Support/TargetSelect.h>
 
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <cassert>
+
 using std::size_t;
 using std::unordered_map;
 using std::string;
 using std::pair;
 using std::make_unique;
 using std::unique_ptr;
+using std::uintmax_t;
+using std::recursive_mutex;
+using std::lock_guard;
+using std::numeric_limits;
+using std::stable_sort;
+using std::tie;
+
+using boost::optional;
+using boost::none;
+
+using boost::filesystem::path;
 
 using llvm::LLVMContext;
 using llvm::getGlobalContext;
 using llvm::Module;
+using llvm::Function;
 using llvm::ExecutionEngine;
 using llvm::EngineBuilder;
 
+namespace
+{
+
+thread_local size_t runtime_functions_added = 0;
+thread_local optional<size_t> evaluated_file_id;
+thread_local size_t file_sequence = 0;
+
+}
+
 compilation_context::compilation_context()
   : rt_module{new Module{"runtime module", llvm()}}
 {
@@ -33,12 +60,17 @@ LLVMContext& compilation_context::llvm()
 {
     return getGlobalContext();
 }
+recursive_mutex& compilation_context::llvm_mutex()
+{
+    return llvm_lock;
+}
 macro_execution_environment& compilation_context::macro_environment()
 {
+    lock_guard<recursive_mutex> lock{llvm_lock};
     if(!macro_env)
     {
         llvm::InitializeNativeTarget();
-        macro_env = make_unique<macro_execution_environment>(create_macro_environment(llvm()));
+        macro_env = make_unique<macro_execution_environment>(create_macro_environment(llvm(), macro_opt_level));
     }
     return *macro_env;
 }
@@ -46,7 +78,118 @@ Module& compilation_context::runtime_module()
 {
     return *rt_module;
 }
+void compilation_context::add_runtime_function(Function* func)
+{
+    rt_module->getFunctionList().push_back(func);
+    ++runtime_functions_added;
+    if(evaluated_file_id)
+        rt_functions.push_back({*evaluated_file_id, next_in_file(), func});
+    else
+        rt_functions.push_back({numeric_limits<size_t>::max(), rt_functions.size(), func});
+}
+void compilation_context::order_runtime_functions()
+{
+    stable_sort(rt_functions.begin(), rt_functions.end(), [](const runtime_function& lhs, const runtime_function& rhs)
+    {
+        return tie(lhs.file_id, lhs.index) < tie(rhs.file_id, rhs.index);
+    });
+    // functions that weren't added by add_runtime_function stay in front
+    Module::FunctionListType& functions = rt_module->getFunctionList();
+    for(const runtime_function& f : rt_functions)
+    {
+        functions.remove(f.func);
+        functions.push_back(f.func);
+    }
+}
+size_t compilation_context::runtime_functions_added_by_this_thread()
+{
+    return runtime_functions_added;
+}
 module& compilation_context::core_module()
 {
     return *core;
 }
+
+compilation_context::file_scope::file_scope(size_t file_id)
+{
+    assert(!evaluated_file_id);
+    evaluated_file_id = file_id;
+    file_sequence = 0;
+}
+compilation_context::file_scope::~file_scope()
+{
+    evaluated_file_id = none;
+}
+optional<size_t> compilation_context::evaluated_file()
+{
+    return evaluated_file_id;
+}
+size_t compilation_context::next_in_file()
+{
+    return file_sequence++;
+}
+
+identifier_id_t compilation_context::identifier_id(const string& str)
+{
+    return ::identifier_id(str);
+}
+const string& compilation_context::to_string(identifier_id_t id)
+{
+    return identifier_string(id);
+}
+
+bool compilation_context::lazy_macro_compilation() const
+{
+    return lazy_macros;
+}
+void compilation_context::lazy_macro_compilation(bool lazy)
+{
+    lazy_macros = lazy;
+}
+
+size_t compilation_context::macro_jit_threshold() const
+{
+    return jit_threshold;
+}
+void compilation_context::macro_jit_threshold(size_t threshold)
+{
+    jit_threshold = threshold;
+}
+
+optimization_level compilation_context::macro_optimization_level() const
+{
+    return macro_opt_level;
+}
+void compilation_context::macro_optimization_level(optimization_level level)
+{
+    assert(!macro_env);
+    macro_opt_level = level;
+}
+
+const path& compilation_context::code_cache_directory() const
+{
+    return code_cache_dir;
+}
+void compilation_context::code_cache_directory(const path& directory)
+{
+    assert(!code_cache_ptr);
+    code_cache_dir = directory;
+}
+uintmax_t compilation_context::code_cache_size() const
+{
+    return code_cache_max_size;
+}
+void compilation_context::code_cache_size(uintmax_t max_size)
+{
+    assert(!code_cache_ptr);
+    code_cache_max_size = max_size;
+}
+macro_code_cache* compilation_context::code_cache()
+{
+    if(code_cache_dir.empty())
+        return nullptr;
+    lock_guard<recursive_mutex> lock{llvm_lock};
+    if(!code_cache_ptr)
+        code_cache_ptr = make_unique<macro_code_cache>(code_cache_dir, code_cache_max_size, macro_opt_level);
+    return code_cache_ptr.get();
+}
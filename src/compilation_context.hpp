@@ -2,38 +2,30 @@
 #define COMPILATION_CONTEXT_HPP_
 
 #include "macro_environment.hpp"
+#include "identifier.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/optional.hpp>
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace llvm
 {
 class LLVMContext;
 class Module;
+class Function;
 class ExecutionEngine;
 }
 
-typedef size_t identifier_id_t;
-
-
-enum class identifier_ids
-  : identifier_id_t
-{
-    // import/export identifiers
-    EXPORT = 1,
-    IMPORT,
-    FROM,
-    DEF,
-
-    CORE,
-
-    FIRST_UNUSED
-};
-
 struct module;
 struct macro_execution_environment;
+class macro_code_cache;
 
 class compilation_context
 {
@@ -47,13 +39,77 @@ public:
     llvm::LLVMContext& llvm();
     macro_execution_environment& macro_environment();
     llvm::Module& runtime_module();
+    // takes ownership, the caller has to hold llvm_mutex
+    void add_runtime_function(llvm::Function* func);
+    // orders the functions of the runtime module by the file whose module added them (see file_scope),
+    // then by the order they were added in, so the output doesn't depend on the order modules were evaluated in
+    // functions added outside of a file_scope come last, no module may be evaluated while this runs
+    void order_runtime_functions();
+    // functions the calling thread added to the runtime module, of all contexts
+    // a module is evaluated on one thread, so this tells whether evaluating it emitted code (see module_cache.hpp)
+    static std::size_t runtime_functions_added_by_this_thread();
     module& core_module();
 
+    // the calling thread evaluates the module of file_id while the scope exists
+    // runtime functions and unique ids are numbered per file, a module is evaluated on one thread in a fixed order
+    class file_scope
+    {
+    public:
+        explicit file_scope(std::size_t file_id);
+        file_scope(const file_scope&) = delete;
+        ~file_scope();
+
+        file_scope& operator=(const file_scope&) = delete;
+    };
+    // file of the calling thread's file_scope, none outside of one
+    static boost::optional<std::size_t> evaluated_file();
+    // 0, 1, ... in each file_scope
+    static std::size_t next_in_file();
+
+    // LLVM is not thread-safe: creating or changing IR (compiling macros and procs, adding to the runtime module)
+    // and using the JIT have to hold this lock when modules are evaluated in parallel
+    // it is recursive, because compiling can call macros that are compiled on their first call
+    std::recursive_mutex& llvm_mutex();
+
     identifier_id_t identifier_id(const std::string& str);
     const std::string& to_string(identifier_id_t);
+
+    // macros are JIT-compiled on their first call instead of when they are defined (default)
+    bool lazy_macro_compilation() const;
+    void lazy_macro_compilation(bool lazy);
+    // with lazy compilation, the first calls of a macro are interpreted, it is JIT-compiled when they exceed the threshold
+    // 0 compiles every macro on its first call, default is 8
+    std::size_t macro_jit_threshold() const;
+    void macro_jit_threshold(std::size_t threshold);
+    // has to be set before the macro environment is first used, default is O2
+    optimization_level macro_optimization_level() const;
+    void macro_optimization_level(optimization_level level);
+    // directory to keep optimized macros in between runs, empty (the default) disables the cache
+    // both have to be set before the cache is first used, the size is in bytes and defaults to 64 MiB
+    const boost::filesystem::path& code_cache_directory() const;
+    void code_cache_directory(const boost::filesystem::path& directory);
+    std::uintmax_t code_cache_size() const;
+    void code_cache_size(std::uintmax_t max_size);
+    // nullptr if disabled
+    macro_code_cache* code_cache();
 private:
+    // destroyed last, macros compiled lazily take it while they are destroyed
+    std::recursive_mutex llvm_lock;
+    bool lazy_macros = true;
+    std::size_t jit_threshold = 8;
+    optimization_level macro_opt_level = optimization_level::O2;
+    boost::filesystem::path code_cache_dir;
+    std::uintmax_t code_cache_max_size = 64 << 20;
+    std::unique_ptr<macro_code_cache> code_cache_ptr;
     std::unique_ptr<macro_execution_environment> macro_env;
     std::unique_ptr<llvm::Module> rt_module;
+    struct runtime_function
+    {
+        std::size_t file_id; // the maximum outside of a file_scope
+        std::size_t index;
+        llvm::Function* func;
+    };
+    std::vector<runtime_function> rt_functions;
     std::unique_ptr<module> core;
 };
 
@@ -4,11 +4,17 @@
 #include "compile_instruction.hpp"
 #include "instruction_types.hpp"
 #include "macro_execution.hpp"
+#include "macro_interpreter.hpp"
+#include "macro_code_cache.hpp"
 
 #include <llvm/IR/CFG.h>
 #include <llvm/IR/Module.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/PassManager.h>
+
+#include <atomic>
+#include <mutex>
 
 using namespace compile_function_error;
 
@@ -33,14 +39,39 @@ using boost::get;
 using std::pair;
 using std::tuple;
 using std::unique_ptr;
+using std::shared_ptr;
 using std::make_shared;
 using std::unordered_map;
 using std::string;
 using std::move;
 using std::vector;
 using std::ignore;
+using std::atomic;
+using std::recursive_mutex;
+using std::lock_guard;
+using std::size_t;
+
+namespace
+{
+
+// before code generation for the macro module
+// the result comes from code_cache instead if the function was optimized in an earlier run
+void optimize(Function& func, macro_execution_environment& env, macro_code_cache* code_cache)
+{
+    auto run_passes = [&](Function& f)
+    {
+        inline_node_accessors(f);
+        env.optimizer.run(f);
+    };
+    if(code_cache)
+        code_cache->optimize(func, run_passes);
+    else
+        run_passes(func);
+}
+
+}
 
-pair<unique_ptr<Function>, unordered_map<string, named_value_info>> compile_signature(const node& params_node, const node& return_type_node, compilation_context& context)
+pair<unique_ptr<Function>, unordered_map<identifier_id_t, named_value_info>> compile_signature(const node& params_node, const node& return_type_node, compilation_context& context)
 {
     const list_node& params_list = params_node.cast_else<list_node>([&]
     {
@@ -75,7 +106,7 @@ pair<unique_ptr<Function>, unordered_map<string, named_value_info>> compile_sign
     FunctionType* function_type = FunctionType::get(&return_type.llvm_type, arg_types, false);
     unique_ptr<Function> function{Function::Create(function_type, Function::InternalLinkage)};
 
-    unordered_map<string, named_value_info> parameter_table;
+    unordered_map<identifier_id_t, named_value_info> parameter_table;
     auto args_range = rangeify(function->arg_begin(), function->arg_end());
     for_each(zipped(param_declarations_range, args_range), unpacking(
     [&](const list_node& param_declaration, Argument& arg)
@@ -86,7 +117,7 @@ pair<unique_ptr<Function>, unordered_map<string, named_value_info>> compile_sign
         });
 
         bool was_inserted;
-        tie(ignore, was_inserted) = parameter_table.insert({save<string>(name_ref.identifier()), named_value_info{arg, name_ref}});
+        tie(ignore, was_inserted) = parameter_table.insert({name_ref.identifier_id(), named_value_info{arg, name_ref}});
         if(!was_inserted)
             fatal<id("duplicate_parameter_name")>(name_ref.source());
     }));
@@ -119,20 +150,20 @@ block_info compile_block(const node& block_node, BasicBlock& llvm_block, LookupV
     llvm_block.setName(save<string>(block_name.identifier()));
     IRBuilder<> builder{&llvm_block};
 
-    unordered_map<string, named_value_info> local_variable_table;
+    unordered_map<identifier_id_t, named_value_info> local_variable_table;
     vector<statement> statements;
     statements.reserve(block_body.size());
 
     auto define_variable = [&](const ref_node& name, const named_value_info& value_info)
     {
-        local_variable_table.insert({save<string>(name.identifier()), value_info});
+        local_variable_table.insert({name.identifier_id(), value_info});
     };
     auto lookup_variable = [&](const ref_node& name) -> named_value_info&
     {
         named_value_info* value = lookup_global_variable(name);
         if(value)
             return *value;
-        auto find_it = local_variable_table.find(save<string>(name.identifier()));
+        auto find_it = local_variable_table.find(name.identifier_id());
         if(find_it == local_variable_table.end())
             fatal<id("variable_undefined")>(name.source());
 
@@ -173,14 +204,14 @@ pair<unique_ptr<Function>, function_info> compile_function(node_range source_ran
     source_range.pop_front();
 
     unique_ptr<Function> function;
-    unordered_map<string, named_value_info> parameter_table;
+    unordered_map<identifier_id_t, named_value_info> parameter_table;
     tie(function, parameter_table) = compile_signature(parameters_node, return_type_node, context);
     
     vector<block_info> blocks;
 
     auto lookup_global_variable = [&](const ref_node& name_ref) -> named_value_info*
     {
-        string name = save<string>(name_ref.identifier());
+        identifier_id_t name = name_ref.identifier_id();
         if(!blocks.empty())
         {
             auto initial_block_it = blocks.front().variable_table.find(name);
@@ -193,11 +224,11 @@ pair<unique_ptr<Function>, function_info> compile_function(node_range source_ran
 
         return nullptr;
     };
-    auto check_for_duplicates = [&](const unordered_map<string, named_value_info>& variable_table)
+    auto check_for_duplicates = [&](const unordered_map<identifier_id_t, named_value_info>& variable_table)
     {
         for(const auto& p : variable_table)
         {
-            const string variable_name = p.first;
+            identifier_id_t variable_name = p.first;
             const named_value_info& info = p.second;
 
             // check in function global variables
@@ -232,7 +263,7 @@ pair<unique_ptr<Function>, function_info> compile_function(node_range source_ran
     {
         auto it = find_if(blocks.begin(), blocks.end(), [&](block_info& block)
         {
-            return block.block_name.identifier() == name_ref.identifier();
+            return block.block_name.identifier_id() == name_ref.identifier_id();
         });
         if(it == blocks.end())
             fatal<id("block_not_found")>(name_ref.source());
@@ -282,7 +313,7 @@ pair<unique_ptr<Function>, function_info> compile_function(node_range source_ran
                         fatal<id("phi_incoming_block_twice")>(inc.block_name.source());
                     has_incoming_for_predecessor[predecessor_index] = true;
 
-                    auto value_info_it  = block.variable_table.find(save<string>(inc.variable_name.identifier()));
+                    auto value_info_it  = block.variable_table.find(inc.variable_name.identifier_id());
                     if(value_info_it == block.variable_table.end())
                         fatal<id("phi_incoming_variable_not_defined")>(inc.variable_name.source());
                     named_value_info& value = value_info_it->second;
@@ -316,6 +347,8 @@ pair<unique_ptr<Function>, function_info> compile_function(node_range source_ran
 
 macro_node compile_macro(node_range source, compilation_context& context)
 {
+    recursive_mutex* llvm_mutex = &context.llvm_mutex();
+    lock_guard<recursive_mutex> lock{*llvm_mutex};
     auto p = compile_function(source, context);
     unique_ptr<Function>& func_owner = p.first;
     function_info& func_info = p.second;
@@ -331,19 +364,61 @@ macro_node compile_macro(node_range source, compilation_context& context)
     context.macro_environment().llvm_module.getFunctionList().push_back(func_owner.get());
     func_owner.release();
 
-    auto func_ptr = (macro_function*) context.macro_environment().llvm_engine.getPointerToFunction(&func_info.llvm_function);
-    assert(func_ptr);
+    // with lazy compilation, the function is interpreted for the first calls, then optimized and compiled
+    // (macros that are never called cost nothing, macros that are called a few times don't pay for the JIT)
+    macro_execution_environment& env = context.macro_environment();
+    Function* llvm_function = &func_info.llvm_function;
+    auto compiled = make_shared<atomic<macro_function*>>(nullptr);
+    macro_code_cache* code_cache = context.code_cache();
+    // calls on other threads may want the code at the same time, it is generated once
+    auto generate_code = [llvm_function, &env, code_cache, compiled, llvm_mutex]
+    {
+        lock_guard<recursive_mutex> lock{*llvm_mutex};
+        if(macro_function* func_ptr = *compiled)
+            return func_ptr;
+        optimize(*llvm_function, env, code_cache);
+        auto func_ptr = (macro_function*) env.llvm_engine.getPointerToFunction(llvm_function);
+        assert(func_ptr);
+        *compiled = func_ptr;
+        return func_ptr;
+    };
+    shared_ptr<const macro_interpreter> interpreter;
+    if(!context.lazy_macro_compilation())
+        generate_code();
+    else if(context.macro_jit_threshold() != 0)
+    {
+        // the interpreter owns a copy of the IR, which may be destroyed on any thread
+        interpreter.reset(macro_interpreter::create(*llvm_function, env).release(), [llvm_mutex](const macro_interpreter* interpreter)
+        {
+            lock_guard<recursive_mutex> lock{*llvm_mutex};
+            delete interpreter;
+        });
+    }
+    auto call_count = make_shared<atomic<size_t>>(0);
+    size_t jit_threshold = context.macro_jit_threshold();
 
-    auto macro_func = [func_ptr](node_range nodes) -> pair<node&, dynamic_graph>
+    auto macro_func = [compiled, generate_code, interpreter, call_count, jit_threshold](node_range nodes) -> pair<node&, dynamic_graph>
     {
+        macro_function* func_ptr = *compiled;
+        if(func_ptr == nullptr && interpreter && (*call_count)++ < jit_threshold)
+        {
+            return execute_macro([&](node_ptr macro_arg)
+            {
+                return (*interpreter)(macro_arg);
+            }, nodes);
+        }
+        if(func_ptr == nullptr)
+            func_ptr = generate_code();
         return execute_macro(func_ptr, nodes);
     };
 
-    return {make_shared<std::function<macro_node::macro>>(macro_func)};
+    // once compiled, macro_node calls the code directly, macro_func only runs before that
+    return {make_shared<std::function<macro_node::macro>>(macro_func), compiled.get()};
 }
 
 proc_node compile_proc(node_range source, compilation_context& context)
 {
+    lock_guard<recursive_mutex> lock{context.llvm_mutex()};
     auto p = compile_function(source, context);
     unique_ptr<Function>& func_owner = p.first;
     function_info& func_info = p.second;
@@ -365,6 +440,7 @@ proc_node compile_proc(node_range source, compilation_context& context)
         }
         context.macro_environment().llvm_module.getFunctionList().push_back(cloned_func.get());
         ct_function = cloned_func.release();
+        optimize(*ct_function, context.macro_environment(), context.code_cache());
     }
     if(!func_info.is_ct_only)
     {
@@ -378,7 +454,7 @@ proc_node compile_proc(node_range source, compilation_context& context)
                     cast<CallInst>(vtvm[&call->llvm_value])->setCalledFunction(call->callee.rt_function());
             }
         }
-        context.runtime_module().getFunctionList().push_back(cloned_func.get());
+        context.add_runtime_function(cloned_func.get());
         rt_function = cloned_func.release();
     }
 
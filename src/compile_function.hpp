@@ -26,7 +26,7 @@ struct block_info
 {
     const node& block_node;
     const ref_node& block_name;
-    std::unordered_map<std::string, named_value_info> variable_table;
+    std::unordered_map<identifier_id_t, named_value_info> variable_table;
     std::vector<statement> statements;
     llvm::BasicBlock& llvm_block;
 };
@@ -40,7 +40,7 @@ struct function_info
 };
 
 
-std::pair<std::unique_ptr<llvm::Function>, std::unordered_map<std::string, named_value_info>> compile_signature(const node& params_node, const node& return_type_node, compilation_context& context);
+std::pair<std::unique_ptr<llvm::Function>, std::unordered_map<identifier_id_t, named_value_info>> compile_signature(const node& params_node, const node& return_type_node, compilation_context& context);
 
 block_info compile_block(const node& block_node, llvm::BasicBlock& llvm_block, std::function<named_value_info* (const ref_node&)> lookup_global_variable, compilation_context& context);
 
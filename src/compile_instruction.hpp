@@ -77,11 +77,8 @@ void compile_statement_impl
     using std::move;
     using std::vector;
     using std::string;
-    using std::stoul;
-    using std::invalid_argument;
     using std::pair;
     using std::tuple;
-    using std::out_of_range;
 
     if(instruction_type_range.empty())
         fatal<id("empty_instruction_type")>(instruction_type_node.source());
@@ -169,24 +166,13 @@ void compile_statement_impl
             if(!isa<IntegerType>(expected_type))
                 fatal<id("invalid_literal_for_type")>(arg_node.source());
             
-            long number;
-            try
-            {
-                size_t index_after;
-                string as_string{lit.begin(), lit.end()};
-                number = stol(as_string, &index_after);
-                if(index_after != as_string.size())
-                    throw invalid_argument{""};
-            }
-            catch(const invalid_argument& exc)
-            {
+            lit_integer integer = lit.integer();
+            if(integer.status == lit_integer::INVALID)
                 fatal<id("invalid_integer_constant")>(lit.source());
-            }
-            catch(const out_of_range& exc)
-            {
+            if(integer.status == lit_integer::OUT_OF_RANGE)
                 fatal<id("out_of_range_integer_constant")>(lit.source());
-            }
             
+            std::int64_t number = integer.value;
             if(!ConstantInt::isValueValidForType(&expected_type, number))
                 fatal<id("out_of_range_integer_constant")>(lit.source());
             return *ConstantInt::getSigned(&expected_type, number);
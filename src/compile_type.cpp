@@ -17,9 +17,6 @@
 
 using std::size_t;
 using std::string;
-using std::stoul;
-using std::out_of_range;
-using std::invalid_argument;
 using std::distance;
 using std::string;
 using std::vector;
@@ -43,27 +40,13 @@ unsigned long read_bit_width(const node& n)
         fatal<id("int_invalid_argument_node")>(n.source());
     });
 
-    unsigned long width;
-    try
-    {
-        size_t index_after;
-        string as_str{bit_width_lit.begin(), bit_width_lit.end()};
-        width = stoul(as_str, &index_after);
-        if(index_after != as_str.size())
-            throw invalid_argument{""};
-        if(width == 0 || width > 1024) // TODO: be less conservative
-            throw out_of_range{""};
-    }
-    catch(const invalid_argument&)
-    {
+    lit_integer width = bit_width_lit.integer();
+    if(width.status == lit_integer::INVALID)
         fatal<id("int_invalid_argument_literal")>(bit_width_lit.source());
-    }
-    catch(const out_of_range&)
-    {
+    if(width.status == lit_integer::OUT_OF_RANGE || width.value <= 0 || width.value > 1024) // TODO: be less conservative
         fatal<id("int_out_of_range_bit_width")>(bit_width_lit.source());
-    }
 
-    return width;
+    return width.value;
 }
 
 type_info compile_type(const node& type_node, LLVMContext& llvm_context)
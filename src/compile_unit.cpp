@@ -4,26 +4,33 @@
 #include "compilation_context.hpp"
 #include "parse_state.hpp"
 #include "parse.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include "parallel_parse.hpp"
+#include "ast_cache.hpp"
+#include "header_scan.hpp"
+#include "module_cache.hpp"
 #include "error/compile_exception.hpp"
 #include "error/import_export_error.hpp"
 
 #include <boost/optional.hpp>
 
 #include <utility>
-#include <fstream>
-#include <iterator>
+#include <memory>
 #include <algorithm>
+#include <limits>
 
 using std::vector;
 using std::pair;
 using std::tuple;
-using std::ifstream;
-using std::ios;
-using std::istreambuf_iterator;
 using std::move;
-using std::find;
+using std::make_shared;
+using std::shared_ptr;
+using std::find_if;
+using std::numeric_limits;
 using std::string;
 using std::size_t;
+using std::uint64_t;
 
 using boost::filesystem::path;
 using boost::filesystem::exists;
@@ -32,126 +39,372 @@ using boost::none;
 
 using namespace import_export_error;
 
-vector<size_t> toposort(const vector<vector<size_t>>& graph)
+namespace
+{
+
+// every node that is not sorted depends on another one that is not sorted, following those leads into a cycle
+vector<size_t> find_cycle(const vector<vector<size_t>>& graph, const vector<size_t>& remaining)
 {
-    // crude implementation of topological sort
-    vector<optional<vector<size_t>>> remaining_graph{graph.begin(), graph.end()};
-    auto remove_node = [&](size_t node_to_remove)
+    size_t node = find_if(remaining.begin(), remaining.end(), [](size_t count)
     {
-        remaining_graph[node_to_remove] = none;
-        for(optional<vector<size_t>>& neighbors : remaining_graph)
+        return count != 0;
+    }) - remaining.begin();
+
+    const size_t not_visited = numeric_limits<size_t>::max();
+    vector<size_t> position(graph.size(), not_visited);
+    vector<size_t> visited;
+    while(position[node] == not_visited)
+    {
+        position[node] = visited.size();
+        visited.push_back(node);
+        node = *find_if(graph[node].begin(), graph[node].end(), [&](size_t dependency)
         {
-            if(neighbors)
-                neighbors->erase(remove(neighbors->begin(), neighbors->end(), node_to_remove), neighbors->end());
-        }
-    };
+            return remaining[dependency] != 0;
+        });
+    }
+    return {visited.begin() + position[node], visited.end()};
+}
+
+const string core_str = "core";
+
+path module_path(const path& importing_file, const string& imported_module)
+{
+    return importing_file.parent_path() / (imported_module + ".al");
+}
 
+// opens unit.paths[first, last), the error of the file with the lowest id is reported if files can't be read
+void open_range(unit_files& unit, size_t first, size_t last)
+{
+    parallel_for(last - first, [&](size_t index)
+    {
+        size_t file_id = first + index;
+        unit.files[file_id] = open_file(unit.paths[file_id]);
+        unit.imports[file_id] = scan_imports(unit.files[file_id]->begin(), unit.files[file_id]->end());
+    });
+}
+
+}
+
+vector<size_t> toposort(const vector<vector<size_t>>& graph)
+{
+    // Kahn's algorithm: a node is ready when all nodes it depends on are sorted
+    vector<size_t> remaining(graph.size());
+    vector<vector<size_t>> dependents(graph.size());
+    for(size_t node = 0; node != graph.size(); ++node)
+    {
+        remaining[node] = graph[node].size();
+        for(size_t dependency : graph[node])
+            dependents[dependency].push_back(node);
+    }
+
+    // the sorted nodes are the queue of ready nodes, too
     vector<size_t> result;
     result.reserve(graph.size());
-
-    while(result.size() != graph.size())
+    for(size_t node = 0; node != graph.size(); ++node)
+    {
+        if(remaining[node] == 0)
+            result.push_back(node);
+    }
+    for(size_t i = 0; i != result.size(); ++i)
     {
-        for(size_t node = 0; node != remaining_graph.size(); ++node)
+        for(size_t dependent : dependents[result[i]])
         {
-            optional<vector<size_t>>& neighbors = remaining_graph[node];
-            if(!neighbors)
-                continue;
-            if(neighbors->empty())
-            {
-                result.push_back(node);
-                remove_node(node);
-                goto node_removed;
-            }
+            if(--remaining[dependent] == 0)
+                result.push_back(dependent);
         }
-        throw circular_dependency{};
+    }
+
+    if(result.size() != graph.size())
+        throw circular_dependency{find_cycle(graph, remaining)};
+    return result;
+}
+
+path_index::path_index(const vector<path>& paths)
+{
+    ids_.reserve(paths.size());
+    for(size_t id = 0; id != paths.size(); ++id)
+        insert(paths[id], id);
+}
+
+bool path_index::insert(const path& p, size_t id)
+{
+    return ids_.insert({key(p), id}).second;
+}
+
+optional<size_t> path_index::find(const path& p) const
+{
+    auto it = ids_.find(key(p));
+    if(it == ids_.end())
+        return none;
+    return it->second;
+}
 
-        node_removed:;
+string path_index::key(const path& p)
+{
+    vector<string> elements;
+    for(const path& element : p)
+    {
+        const string& str = element.native();
+        if(str == "." || (str == ".." && !elements.empty() && elements.back() == "/"))
+            continue;
+        if(str == ".." && !elements.empty() && elements.back() != "..")
+            elements.pop_back();
+        else
+            elements.push_back(str);
+    }
+    string result;
+    for(const string& element : elements)
+    {
+        result += element;
+        result += '\0';
     }
-    
     return result;
 }
 
 
-parsed_file read_file(size_t file_id, const path& p)
+list_node& parse_source(const mapped_file& file, size_t file_id, dynamic_graph& graph)
+{
+    if(file.size() < parallel_parse_min_size)
+    {
+        parse_state<const char*> state{file.begin(), file.end(), file_id, graph};
+        return parse_file(state);
+    }
+    return parse_file_parallel(file.begin(), file.end(), file_id, graph, 4 * worker_count());
+}
+
+shared_ptr<const mapped_file> open_file(const path& p)
 {
     if(p.extension() != ".al")
         throw wrong_file_extension{};
     if(!exists(p))
         throw file_not_found{};
 
-    ifstream file{p.native(), ios::binary};
-    if(!file)
+    auto file = make_shared<mapped_file>(p.native().c_str());
+    if(!*file)
         throw io_error{};
-    istreambuf_iterator<char> begin{file};
-    istreambuf_iterator<char> end{};
+    if(file->size() > std::numeric_limits<file_offset>::max())
+        throw file_too_large{}; // nodes store 32 bit offsets
+    return file;
+}
 
+parsed_file parse_mapped_file(size_t file_id, const path& p, shared_ptr<const mapped_file> file)
+{
     dynamic_graph graph_owner;
-    parse_state<istreambuf_iterator<char>> state{begin, end, file_id, graph_owner};
-    list_node& syntax_tree = parse_file(state);
-    module_header header = read_module_header(syntax_tree);
+    // literals and references point into the mapping
+    graph_owner.keep_alive(file);
+    path cache_path = path{p}.replace_extension(".alc");
+    uint64_t hash = content_hash(file->begin(), file->end());
+    list_node* syntax_tree = read_ast_cache(cache_path.native().c_str(), hash, file->begin(), file->end(),
+            file_id, graph_owner);
+    if(!syntax_tree)
+    {
+        syntax_tree = &parse_source(*file, file_id, graph_owner);
+        // failing to write the cache (e.g. in a read-only directory) only costs time on the next run
+        write_ast_cache(cache_path.native().c_str(), hash, file->begin(), file->end(), *syntax_tree);
+    }
+    module_header header = read_module_header(*syntax_tree);
+
+    return {*syntax_tree, move(graph_owner), move(header)};
+}
+
+parsed_file read_file(size_t file_id, const path& p)
+{
+    return parse_mapped_file(file_id, p, open_file(p));
+}
+
+unit_files open_unit(const vector<path>& paths)
+{
+    unit_files unit{paths, vector<shared_ptr<const mapped_file>>(paths.size()), vector<optional<vector<string>>>(paths.size())};
+    open_range(unit, 0, paths.size());
+    return unit;
+}
+
+unit_files discover_unit(const path& entry)
+{
+    unit_files unit;
+    path_index file_ids;
+    file_ids.insert(entry, 0);
+    unit.paths.push_back(entry);
+
+    // breadth first, files [level_begin, level_end) are one level of imports
+    size_t level_begin = 0;
+    while(level_begin != unit.paths.size())
+    {
+        size_t level_end = unit.paths.size();
+        unit.files.resize(level_end);
+        unit.imports.resize(level_end);
+        open_range(unit, level_begin, level_end);
 
-    return {syntax_tree, move(graph_owner), move(header)};
+        for(size_t file_id = level_begin; file_id != level_end; ++file_id)
+        {
+            if(!unit.imports[file_id])
+                continue;
+            for(const string& imported_module : *unit.imports[file_id])
+            {
+                if(imported_module == core_str)
+                    continue;
+                path imported_path = module_path(unit.paths[file_id], imported_module);
+                if(exists(imported_path) && file_ids.insert(imported_path, unit.paths.size()))
+                    unit.paths.push_back(imported_path);
+            }
+        }
+        level_begin = level_end;
+    }
+    return unit;
 }
 
 vector<module> compile_unit(const vector<path>& paths, compilation_context& context)
 {
-    auto parsed_files = save<vector<parsed_file>>(mapped(enumerate(paths), unpacking(
-    [&](size_t index, const path& p) -> parsed_file
+    return compile_unit(open_unit(paths), context);
+}
+
+vector<module> compile_unit(unit_files unit, compilation_context& context)
+{
+    // the dependency graph is built from the headers, before anything is parsed,
+    // so modules can be parsed and evaluated without waiting for unrelated files
+    assert(unit.files.size() == unit.paths.size() && unit.imports.size() == unit.paths.size());
+    const vector<path>& paths = unit.paths;
+    vector<shared_ptr<const mapped_file>>& files = unit.files;
+    const vector<optional<vector<string>>>& scanned_imports = unit.imports;
+
+    path_index file_ids{paths};
+    // modules that are not found, and files with malformed headers, have no edges
+    // the errors are reported when the file is parsed or the module is evaluated
+    vector<vector<size_t>> dependency_graph(paths.size());
+    for(size_t file_id = 0; file_id != paths.size(); ++file_id)
     {
-        return read_file(index, p);
-    })));
+        if(!scanned_imports[file_id])
+            continue;
+        for(const string& imported_module : *scanned_imports[file_id])
+        {
+            if(imported_module == core_str)
+                continue;
+            if(optional<size_t> imported_id = file_ids.find(module_path(paths[file_id], imported_module)))
+                dependency_graph[file_id].push_back(*imported_id);
+        }
+    }
+
+    // throws circular_dependency, the scheduler needs an acyclic graph
+    toposort(dependency_graph);
 
-    auto lookup_file_id = [&](const path& parent_path, const import_statement& import) -> size_t
+    // nodes [0, n) parse the files, nodes [n, 2n) evaluate the modules after their files are parsed
+    // and the modules they import are evaluated, parses come first if several fail
+    size_t file_count = paths.size();
+    vector<vector<size_t>> tasks(2 * file_count);
+    for(size_t file_id = 0; file_id != file_count; ++file_id)
     {
-        path module_path{parent_path / (save<string>(rangeify(import.imported_module)) + ".al")};
-        auto it = find(paths.begin(), paths.end(), module_path);
-        if(it == paths.end())
-            fatal<id("module_not_found")>(import.imported_module.source());
-        return it - paths.begin();
+        tasks[file_count + file_id].push_back(file_id);
+        for(size_t imported_id : dependency_graph[file_id])
+            tasks[file_count + file_id].push_back(file_count + imported_id);
+    }
+
+    vector<optional<parsed_file>> parsed_files(file_count);
+    vector<optional<module>> evaluated_modules(file_count);
+    // see module_cache.hpp, imports_hash is known when the imported modules are evaluated
+    vector<module_cache_key> cache_keys(file_count);
+    vector<uint64_t> interface_hashes(file_count);
+    auto cache_path = [&](size_t file_id)
+    {
+        return path{paths[file_id]}.replace_extension(".alm");
     };
-    
-    auto dependency_graph = save<vector<vector<size_t>>>(mapped(zipped(paths, parsed_files), unpacking(
-    [&](const path& p, parsed_file& f)
-    {
-        path parent = p.parent_path();
-        auto& imports = f.header.imports;
-        auto non_core_imports = filtered(imports,
-        [&](const import_statement& import)
+    auto parse = [&](size_t file_id)
+    {
+        parsed_files[file_id].emplace(parse_mapped_file(file_id, paths[file_id], move(files[file_id])));
+        // the dependency graph was built from the scanned imports, evaluating with other imports would use
+        // modules that aren't evaluated yet
+        vector<string> parsed_imports = save<vector<string>>(mapped(parsed_files[file_id]->header.imports,
+        [](const import_statement& import)
         {
-            static const string core_str = "core";
-            return rangeify(import.imported_module) != rangeify(core_str);
-        });
+            return save<string>(rangeify(import.imported_module));
+        }));
+        if(!scanned_imports[file_id] || *scanned_imports[file_id] != parsed_imports)
+            fatal<id("header_scan_mismatch")>(parsed_files[file_id]->syntax_tree.source());
+    };
+    parallel_for_dag(tasks, [&](size_t task)
+    {
+        if(task < file_count)
+        {
+            // files with a cache entry are only parsed if their imports turn out to have changed
+            size_t file_id = task;
+            const mapped_file& file = *files[file_id];
+            cache_keys[file_id].content_hash = content_hash(file.begin(), file.end());
+            cache_keys[file_id].source_size = file.size();
+            if(!has_module_cache(cache_path(file_id).native().c_str(), cache_keys[file_id].content_hash, file.size()))
+                parse(file_id);
+            return;
+        }
 
-        return save<vector<size_t>>(mapped(non_core_imports,
-        [&](const import_statement& import)
+        size_t file_id = task - file_count;
+        // the imported modules by import statement, none if one is not found
+        optional<vector<const module*>> imported_modules;
+        if(scanned_imports[file_id])
         {
-            return lookup_file_id(parent, import);
-        }));
-    })));
+            imported_modules.emplace();
+            vector<uint64_t> imported_hashes;
+            for(const string& imported_module : *scanned_imports[file_id])
+            {
+                optional<size_t> imported_id;
+                if(imported_module == core_str)
+                {
+                    imported_modules->push_back(&context.core_module());
+                    imported_hashes.push_back(core_interface_hash);
+                }
+                else if((imported_id = file_ids.find(module_path(paths[file_id], imported_module))))
+                {
+                    imported_modules->push_back(&*evaluated_modules[*imported_id]);
+                    imported_hashes.push_back(interface_hashes[*imported_id]);
+                }
+                else
+                {
+                    imported_modules = none;
+                    break;
+                }
+            }
+            cache_keys[file_id].imports_hash = imports_hash(imported_hashes);
+        }
 
-    vector<size_t> compilation_order_indices = toposort(dependency_graph);
-    auto ordered_paths = permuted(paths, compilation_order_indices);
-    auto ordered_parsed_files = permuted(parsed_files, compilation_order_indices);
+        const module_cache_key& key = cache_keys[file_id];
+        if(imported_modules)
+        {
+            if(optional<cached_module> cached = read_module_cache(cache_path(file_id).native().c_str(), key, file_id, *imported_modules))
+            {
+                evaluated_modules[file_id].emplace(move(cached->loaded));
+                interface_hashes[file_id] = cached->interface_hash;
+                files[file_id] = nullptr;
+                return;
+            }
+        }
 
-    vector<module> modules;
-    modules.reserve(paths.size());
-    for_each(zipped(ordered_paths, ordered_parsed_files), unpacking(
-    [&](const path& p, parsed_file& file)
-    {
-        path parent = p.parent_path();
+        if(!parsed_files[file_id])
+            parse(file_id);
+        parsed_file& file = *parsed_files[file_id];
         auto lookup_module = [&](const import_statement& import) -> module&
         {
-            const static string core_str = "core";
             if(rangeify(import.imported_module) == rangeify(core_str))
                 return context.core_module();
-            size_t file_id = lookup_file_id(parent, import);
-            assert(file_id < modules.size());
-            return modules[file_id];
+            optional<size_t> imported_id = file_ids.find(module_path(paths[file_id], save<string>(rangeify(import.imported_module))));
+            if(!imported_id)
+                fatal<id("module_not_found")>(import.imported_module.source());
+            assert(evaluated_modules[*imported_id]);
+            return *evaluated_modules[*imported_id];
         };
 
-        modules.emplace_back(evaluate_module(file.syntax_tree, move(file.graph_owner), move(file.header), lookup_module));
-    }));
+        // modules that emitted code have to be evaluated on every run
+        size_t runtime_functions = compilation_context::runtime_functions_added_by_this_thread();
+        {
+            compilation_context::file_scope scope{file_id};
+            evaluated_modules[file_id].emplace(evaluate_module(file.syntax_tree, move(file.graph_owner), file.header, lookup_module));
+        }
+        optional<uint64_t> interface_hash;
+        if(imported_modules && runtime_functions == compilation_context::runtime_functions_added_by_this_thread())
+            interface_hash = write_module_cache(cache_path(file_id).native().c_str(), key, file_id, *evaluated_modules[file_id], *imported_modules);
+        interface_hashes[file_id] = interface_hash ? *interface_hash : uncached_interface_hash(key);
+    });
+    context.order_runtime_functions();
 
-    return modules;
+    return save<vector<module>>(mapped(evaluated_modules,
+    [&](optional<module>& evaluated) -> module
+    {
+        return move(*evaluated);
+    }));
 }
-
@@ -5,21 +5,30 @@
 #include "compilation_context.hpp"
 
 #include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
 
 #include <vector>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <memory>
 
+class mapped_file;
 
 
 struct wrong_file_extension
 {};
 struct circular_dependency
-{};
+{
+    // file ids, every file imports the next one and the last one imports the first one
+    std::vector<std::size_t> cycle;
+};
 struct file_not_found
 {};
 struct io_error
 {};
+struct file_too_large
+{};
 
 struct parsed_file
 {
@@ -28,8 +37,53 @@ struct parsed_file
     module_header header;
 };
 
+// file ids by path, in constant time
+// paths are compared lexically after removing "." and resolving ".." (symbolic links are not followed)
+class path_index
+{
+public:
+    // the first id is used for paths that occur more than once
+    path_index() = default;
+    explicit path_index(const std::vector<boost::filesystem::path>& paths);
+
+    // returns false, and keeps the old id, if p is already in the index
+    bool insert(const boost::filesystem::path& p, std::size_t id);
+    boost::optional<std::size_t> find(const boost::filesystem::path& p) const;
+private:
+    static std::string key(const boost::filesystem::path& p);
+
+    std::unordered_map<std::string, std::size_t> ids_;
+};
+
+// graph[node] are the nodes node depends on, they come before it in the result
+// linear in the number of nodes and edges, throws circular_dependency
 std::vector<std::size_t> toposort(const std::vector<std::vector<std::size_t>>& graph);
+// throws the errors above
+std::shared_ptr<const mapped_file> open_file(const boost::filesystem::path& p);
+parsed_file parse_mapped_file(std::size_t file_id, const boost::filesystem::path& p, std::shared_ptr<const mapped_file> file);
+// both of the above
 parsed_file read_file(std::size_t file_id, const boost::filesystem::path& p);
+
+// the files of a compile unit, mapped, with the imports scanned from their headers (see header_scan.hpp)
+struct unit_files
+{
+    std::vector<boost::filesystem::path> paths;
+    std::vector<std::shared_ptr<const mapped_file>> files;
+    // none for malformed headers
+    std::vector<boost::optional<std::vector<std::string>>> imports;
+};
+
+// opens the files in parallel
+unit_files open_unit(const std::vector<boost::filesystem::path>& paths);
+// entry and the modules it imports, directly or indirectly, with entry first
+// each level of imports is opened in parallel, imported modules that don't exist are left out
+// (evaluating the importing module reports them)
+unit_files discover_unit(const boost::filesystem::path& entry);
+
+// the modules are in the order of paths
+// modules are evaluated in parallel where their imports allow, context has to be safe for that (see compilation_context::llvm_mutex)
+std::vector<module> compile_unit(unit_files unit, compilation_context& context);
+// compile_unit(open_unit(paths), context)
 std::vector<module> compile_unit(const std::vector<boost::filesystem::path>& paths, compilation_context& context);
 
 #endif
@@ -3,6 +3,8 @@
 #include "error/core_misc_error.hpp"
 #include "core_unique_ids.hpp"
 #include "compile_function.hpp"
+#include "core_utils.hpp"
+#include "macro_cache.hpp"
 
 #include <boost/variant.hpp>
 
@@ -11,6 +13,8 @@
 
 #include <memory>
 #include <utility>
+#include <atomic>
+#include <mutex>
 
 using std::pair;
 using std::vector;
@@ -22,6 +26,9 @@ using std::size_t;
 using std::move;
 using std::tie;
 using std::ignore;
+using std::atomic;
+using std::recursive_mutex;
+using std::lock_guard;
 
 using llvm::Function;
 using llvm::FunctionType;
@@ -30,6 +37,7 @@ using llvm::IntegerType;
 using llvm::dyn_cast;
 
 using boost::blank;
+using boost::optional;
 
 using namespace core_misc_error;
 
@@ -41,7 +49,7 @@ module create_core_module(compilation_context& context)
     auto add_symbol = [&](string name, node& n)
     {
         bool was_inserted;
-        tie(ignore, was_inserted) = exports.insert({move(name), n});
+        tie(ignore, was_inserted) = exports.insert({identifier_id(name), n});
         assert(was_inserted);
     };
     auto add_id_symbol = [&](string name, size_t id)
@@ -49,24 +57,32 @@ module create_core_module(compilation_context& context)
         id_node& node = node_owner.create_id(id);
         add_symbol(move(name), node);
     };
-    auto add_macro_symbol = [&](const char* name, auto func)
+    auto add_macro_symbol = [&](const char* name, auto func, bool has_side_effects = false)
     {
         auto f = make_shared<std::function<macro_node::macro>>(move(func));
         macro_node& m = node_owner.create_macro();
         m.function(move(f));
+        m.has_side_effects(has_side_effects);
         add_symbol(move(name), m);
     };
     
-    size_t next_unique_id = static_cast<size_t>(unique_ids::FIRST_UNUSED);
-    auto unique_func = [next_unique_id](node_range nodes) mutable -> pair<node&, dynamic_graph>
+    // modules are evaluated in parallel, so ids are numbered per evaluated file (file id + 1 in the upper 32 bits)
+    // and don't depend on the evaluation order, ids outside of a file come from a counter shared by all threads
+    auto next_unique_id = make_shared<atomic<size_t>>(static_cast<size_t>(unique_ids::FIRST_UNUSED));
+    auto unique_func = [next_unique_id](node_range nodes) -> pair<node&, dynamic_graph>
     {
         if(!nodes.empty())
             fatal<id("unique_invalid_argument_number")>(blank());
+        size_t new_id;
+        if(optional<size_t> file_id = compilation_context::evaluated_file())
+            new_id = static_cast<size_t>(unique_ids::FIRST_UNUSED) + ((*file_id + 1) << 32) + compilation_context::next_in_file();
+        else
+            new_id = (*next_unique_id)++;
         dynamic_graph graph;
-        id_node& id = graph.create_id(next_unique_id++);
+        id_node& id = graph.create_id(new_id);
         return {id, move(graph)};
     };
-    add_macro_symbol("unique", unique_func);
+    add_macro_symbol("unique", unique_func, true);
     
     auto macro_func = [&context](node_range nodes) -> pair<node&, dynamic_graph>
     {
@@ -102,6 +118,7 @@ module create_core_module(compilation_context& context)
         });
         args.pop_front();
 
+        lock_guard<recursive_mutex> lock{context.llvm_mutex()};
         auto llvm_arg_types = save<vector<Type*>>(mapped(arg_types_list,
         [&](const node& type_node) -> Type*
         {
@@ -115,7 +132,7 @@ module create_core_module(compilation_context& context)
 
         unique_ptr<Function> func_owner{Function::Create(func_type, Function::ExternalLinkage, save<string>(external_name))};
         // TODO: check for duplicate names
-        context.runtime_module().getFunctionList().push_back(func_owner.get());
+        context.add_runtime_function(func_owner.get());
         Function* func = func_owner.release();
         
         dynamic_graph graph;
@@ -124,10 +141,11 @@ module create_core_module(compilation_context& context)
         proc.rt_function(func);
         return {proc, move(graph)};
     };
-    add_macro_symbol("external", external_func);
+    add_macro_symbol("external", external_func, true);
 
     auto main_func = [&context](node_range args) -> pair<node&, dynamic_graph>
     {
+        lock_guard<recursive_mutex> lock{context.llvm_mutex()};
         dynamic_graph graph;
         proc_node& p = graph.create_proc();
         p = compile_proc(args, context);
@@ -144,7 +162,27 @@ module create_core_module(compilation_context& context)
 
         return {p, move(graph)};
     };
-    add_macro_symbol("main", main_func);
+    add_macro_symbol("main", main_func, true);
+
+    // copy of a macro whose results are cached
+    auto memoized_func = [](node_range args) -> pair<node&, dynamic_graph>
+    {
+        if(length(args) != 1)
+            fatal<id("memoized_invalid_argument_number")>(blank());
+        const macro_node& macro = resolve_refs(args.front()).cast_else<macro_node>([&]
+        {
+            fatal<id("memoized_not_a_macro")>(args.front().source());
+        });
+        if(macro.has_side_effects())
+            fatal<id("memoized_side_effects")>(args.front().source());
+
+        dynamic_graph graph;
+        macro_node& result = graph.create_macro();
+        result = macro;
+        result.cache(make_shared<macro_cache>());
+        return {result, move(graph)};
+    };
+    add_macro_symbol("memoized", memoized_func);
 
 
     add_id_symbol("add", unique_ids::ADD);
@@ -2,95 +2,240 @@
 
 #include "node.hpp"
 
-#include <mblib/boost_variant.hpp>
-
 #include <unordered_map>
-#include <limits>
-
-using boost::get;
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cassert>
 
-using std::make_unique;
+using std::shared_ptr;
 using std::move;
 using std::string;
 using std::pair;
-using std::make_pair;
 using std::vector;
-using std::back_inserter;
 using std::unordered_map;
-using std::numeric_limits;
+using std::hash;
+using std::equal_to;
+using std::max;
+using std::copy;
 using std::size_t;
+using std::sort;
+using std::upper_bound;
 
-id_node& dynamic_graph::create_id(size_t id)
+namespace
+{
+
+// literals and lists are always allocated as these, so a node reference can be cast down to them
+// capacity is the number of elements allocated at begin, it is 0 if the elements are not owned by a graph
+// (a buffer outside of the graph, or the characters of another literal, see copy) and must not be written to
+struct lit_data
+  : lit_node
 {
-    auto storage = make_unique<node_data>(id_node{id});
-    id_node& result = get<id_node>(*storage);
-    data.push_back(std::move(storage));
+    lit_data(const lit_node& lit, size_t capacity)
+      : lit_node(lit),
+        capacity(capacity)
+    {}
 
+    size_t capacity;
+};
+struct list_data
+  : list_node
+{
+    list_data(const list_node& list, size_t capacity)
+      : list_node(list),
+        capacity(capacity)
+    {}
+
+    size_t capacity;
+};
+
+// moves the characters of data to a new array owned by memory, drops the decoded integer
+void reallocate(arena& memory, lit_data& data, size_t capacity)
+{
+    size_t size = data.end() - data.begin();
+    assert(size <= capacity);
+    char* begin = memory.allocate_array<char>(capacity);
+    copy(data.begin(), data.end(), begin);
+    node_source source = data.source();
+    data = lit_data{lit_node{begin, begin + size}, capacity};
+    data.source(source);
+}
+
+lit_data& data_of(lit_node& lit)
+{
+    return static_cast<lit_data&>(lit);
+}
+list_data& data_of(list_node& list)
+{
+    return static_cast<list_data&>(list);
+}
+
+void destroy_macro(void* macro)
+{
+    static_cast<macro_node*>(macro)->~macro_node();
+}
+
+template<class T>
+T* copy_into(arena& memory, const T* begin, const T* end)
+{
+    T* result = memory.allocate_array<T>(end - begin);
+    copy(begin, end, result);
     return result;
 }
 
-lit_node& dynamic_graph::create_lit(string str)
+}
+
+id_node& dynamic_graph::create_id(size_t id)
+{
+    return memory.create<id_node>(id);
+}
+
+lit_node& dynamic_graph::create_lit(const string& str)
 {
-    auto storage = make_unique<node_data>(make_pair(lit_node{nullptr, nullptr}, move(str)));
-    lit_data& result_data = get<lit_data>(*storage);
-    data.push_back(std::move(storage));
+    char* begin = copy_into(memory, str.data(), str.data() + str.size());
+    return memory.create<lit_data>(lit_node{begin, begin + str.size()}, str.size());
+}
 
-    lit_node& lit = result_data.first;
-    std::string& s = result_data.second;
-    char* begin = &s[0];
-    char* end = begin + s.size();
-    lit = lit_node{begin, end};
-    return lit;
+ref_node& dynamic_graph::create_ref(const string& str)
+{
+    char* begin = copy_into(memory, str.data(), str.data() + str.size());
+    return memory.create<ref_node>(begin, begin + str.size(), nullptr);
 }
 
-ref_node& dynamic_graph::create_ref(string str)
+lit_node& dynamic_graph::create_lit(const char* begin, const char* end, lit_integer integer)
 {
-    auto storage = make_unique<node_data>(make_pair(ref_node{nullptr, nullptr, nullptr}, move(str)));
-    ref_data& result_data = get<ref_data>(*storage);
-    data.push_back(std::move(storage));
+    lit_node lit{const_cast<char*>(begin), const_cast<char*>(end), integer};
+    return memory.create<lit_data>(lit, 0);
+}
 
-    ref_node& ref = result_data.first;
-    std::string& s = result_data.second;
-    char* begin = &s[0];
-    char* end = begin + s.size();
-    ref = ref_node{begin, end, nullptr};
-    return ref;
+ref_node& dynamic_graph::create_ref(const char* begin, const char* end)
+{
+    return memory.create<ref_node>(const_cast<char*>(begin), const_cast<char*>(end), nullptr);
 }
 
-list_node& dynamic_graph::create_list(vector<node*> nodes)
+ref_node& dynamic_graph::create_ref(const char* begin, const char* end, identifier_id_t id)
 {
-    auto storage = make_unique<node_data>(make_pair(list_node{nullptr, nullptr}, move(nodes)));
-    list_data& result_data = get<list_data>(*storage);
-    data.push_back(std::move(storage));
+    return memory.create<ref_node>(const_cast<char*>(begin), const_cast<char*>(end), id, nullptr);
+}
 
-    list_node& list = result_data.first;
-    vector<node*>& v = result_data.second;
-    node** begin = &v[0];
-    node** end = begin + v.size();
-    list = list_node{begin, end};
-    return list;
+list_node& dynamic_graph::create_list(const vector<node*>& nodes)
+{
+    node** begin = copy_into(memory, nodes.data(), nodes.data() + nodes.size());
+    return memory.create<list_data>(list_node{begin, begin + nodes.size()}, nodes.size());
 }
 
 macro_node& dynamic_graph::create_macro()
 {
-    auto storage = make_unique<node_data>(macro_node{{}});
-    macro_node& result = get<macro_node>(*storage);
-    data.push_back(std::move(storage));
-
+    macro_node& result = memory.create<macro_node>(nullptr);
+    memory.add_finalizer(destroy_macro, &result);
     return result;
 }
 proc_node& dynamic_graph::create_proc()
 {
-    auto storage = make_unique<node_data>(proc_node{nullptr, nullptr});
-    proc_node& result = get<proc_node>(*storage);
-    data.push_back(std::move(storage));
+    return memory.create<proc_node>(nullptr, nullptr);
+}
 
-    return result;
+node& dynamic_graph::copy(const node& n)
+{
+    switch(n.type())
+    {
+    case node_type::ID:
+        return memory.create<id_node>(n.cast<id_node>());
+    case node_type::LITERAL:
+    {
+        // the characters are copied, too: sharing them would let modifications of either literal show in the other
+        const lit_node& lit = n.cast<lit_node>();
+        size_t size = lit.end() - lit.begin();
+        char* begin = copy_into(memory, lit.begin(), lit.end());
+        lit_node& result = memory.create<lit_data>(lit_node{begin, begin + size, lit.integer()}, size);
+        result.source(lit.source());
+        return result;
+    }
+    case node_type::REFERENCE:
+        return memory.create<ref_node>(n.cast<ref_node>());
+    case node_type::LIST:
+    {
+        const list_node& list = n.cast<list_node>();
+        node** begin = copy_into(memory, list.begin_, list.end_);
+        list_node& result = memory.create<list_data>(list_node{begin, begin + list.size()}, list.size());
+        result.source(list.source());
+        return result;
+    }
+    case node_type::MACRO:
+    {
+        macro_node& result = memory.create<macro_node>(n.cast<macro_node>());
+        memory.add_finalizer(destroy_macro, &result);
+        return result;
+    }
+    case node_type::PROC:
+        return memory.create<proc_node>(n.cast<proc_node>());
+    }
+    assert(false);
+    return create_id(0);
+}
+
+void dynamic_graph::set_char(lit_node& lit, size_t index, char c)
+{
+    lit_data& data = data_of(lit);
+    if(data.capacity == 0)
+        reallocate(memory, data, lit.end() - lit.begin());
+    lit.reset_integer();
+    lit.begin()[index] = c;
+}
+void dynamic_graph::push_back(lit_node& lit, char c)
+{
+    lit_data& data = data_of(lit);
+    size_t size = lit.end() - lit.begin();
+    if(size == data.capacity || data.capacity == 0)
+        reallocate(memory, data, max<size_t>(2 * size, 16));
+    node_source source = lit.source();
+    *lit.end() = c;
+    lit = lit_node{lit.begin(), lit.end() + 1};
+    lit.source(source);
+}
+void dynamic_graph::pop_back(lit_node& lit)
+{
+    // only shrinks the range, characters that are not owned are not written to
+    node_source source = lit.source();
+    lit = lit_node{lit.begin(), lit.end() - 1};
+    lit.source(source);
+}
+void dynamic_graph::set_identifier(ref_node& ref, const char* begin, const char* end)
+{
+    char* chars = copy_into(memory, begin, end);
+    node_source source = ref.source();
+    ref = ref_node{chars, chars + (end - begin), const_cast<node*>(ref.refered())};
+    ref.source(source);
+}
+void dynamic_graph::set_child(list_node& list, size_t index, node& child)
+{
+    list.begin_[index] = &child;
+}
+void dynamic_graph::push_back(list_node& list, node& child)
+{
+    list_data& data = data_of(list);
+    size_t size = list.size();
+    if(size == data.capacity)
+    {
+        size_t capacity = max<size_t>(2 * size, 4);
+        node** begin = memory.allocate_array<node*>(capacity);
+        std::copy(list.begin_, list.end_, begin);
+        list.begin_ = begin;
+        list.end_ = begin + size;
+        data.capacity = capacity;
+    }
+    *list.end_++ = &child;
+}
+void dynamic_graph::pop_back(list_node& list)
+{
+    --list.end_;
 }
 
 void dynamic_graph::add(dynamic_graph graph)
 {
-    std::move(graph.data.begin(), graph.data.end(), back_inserter(data));
+    memory.splice(graph.memory);
+    std::move(graph.buffers.begin(), graph.buffers.end(), back_inserter(buffers));
 }
 node& dynamic_graph::add(const node& n)
 {
@@ -98,93 +243,208 @@ node& dynamic_graph::add(const node& n)
     add(move(p.second));
     return p.first;
 }
+void dynamic_graph::keep_alive(shared_ptr<const void> buffer)
+{
+    buffers.push_back(move(buffer));
+}
 pair<node&, dynamic_graph> dynamic_graph::clone(const node& n)
 {
-    unordered_map<const node*, node_data*> copied_nodes;
-    vector<pair<const node*, node_data*>> node_stack;
+    dynamic_graph graph;
+
+    // the bookkeeping is allocated from a scratch arena, too
+    arena scratch;
+    typedef pair<const node* const, node*> copied_entry;
+    unordered_map<const node*, node*, hash<const node*>, equal_to<const node*>, arena_allocator<copied_entry>>
+        copied_nodes{64, hash<const node*>{}, equal_to<const node*>{}, arena_allocator<copied_entry>{scratch}};
+    // nodes whose children still have to be copied
+    vector<pair<const node*, node*>> node_stack;
+
+    // characters are always copied: the original buffers are not kept alive by the copy
+    auto ptr_for = [&](const node& child_node) -> node*
+    {
+        auto it = copied_nodes.find(&child_node);
+        if(it != copied_nodes.end())
+            return it->second;
+
+        node* copied = child_node.visit<node*>(
+        [&](const id_node& id) -> node*
+        {
+            return &graph.memory.create<id_node>(id);
+        },
+        [&](const lit_node& lit) -> node*
+        {
+            size_t size = lit.end() - lit.begin();
+            char* begin = copy_into(graph.memory, lit.begin(), lit.end());
+            return &graph.memory.create<lit_data>(lit_node{begin, begin + size, lit.integer()}, size);
+        },
+        [&](const ref_node& ref) -> node*
+        {
+            const char* identifier_begin = &ref.identifier().front();
+            size_t size = ref.identifier().length();
+            char* begin = copy_into(graph.memory, identifier_begin, identifier_begin + size);
+            return &graph.memory.create<ref_node>(begin, begin + size, ref.identifier_id(), nullptr);
+        },
+        [&](const list_node& list) -> node*
+        {
+            size_t size = list.size();
+            node** begin = graph.memory.allocate_array<node*>(size);
+            return &graph.memory.create<list_data>(list_node{begin, begin + size}, size);
+        },
+        [&](const macro_node& macro) -> node*
+        {
+            macro_node& result = graph.memory.create<macro_node>(macro);
+            graph.memory.add_finalizer(destroy_macro, &result);
+            return &result;
+        },
+        [&](const proc_node& proc) -> node*
+        {
+            return &graph.memory.create<proc_node>(proc);
+        });
+
+        copied->source(child_node.source());
+        copied_nodes.insert({&child_node, copied});
+        if(child_node.is<list_node>() || child_node.is<ref_node>())
+            node_stack.push_back({&child_node, copied});
+        return copied;
+    };
+
+    node& result_node = *ptr_for(n);
+    while(!node_stack.empty())
+    {
+        const node& current_node = *node_stack.back().first;
+        node& current_copy = *node_stack.back().second;
+        node_stack.pop_back();
+
+        current_node.visit(
+        [&](const ref_node& ref)
+        {
+            if(ref.refered())
+                current_copy.cast<ref_node>().refered(ptr_for(*ref.refered()));
+        },
+        [&](const list_node& list)
+        {
+            list_node& list_copy = current_copy.cast<list_node>();
+            size_t index = 0;
+            for(const node& child : list)
+            {
+                list_copy.begin_[index] = ptr_for(child);
+                ++index;
+            }
+        },
+        [&](const node&)
+        {
+        });
+    }
+
+    return {result_node, move(graph)};
+}
+
 
+pair<node&, dynamic_graph> dynamic_graph::extract(const node& root)
+{
     dynamic_graph graph;
+    graph.buffers = move(buffers);
 
-    auto node_ptr_of_data = [&](node_data& d)
+    typedef pair<const char*, const char*> chunk_range;
+    vector<chunk_range> chunks = memory.chunk_ranges();
+    sort(chunks.begin(), chunks.end());
+    auto owns = [&](const void* ptr)
     {
-        return visit<node*>(d, [&](auto& obj) -> node*
+        const char* address = static_cast<const char*>(ptr);
+        auto it = upper_bound(chunks.begin(), chunks.end(), address, [](const char* address, const chunk_range& chunk)
         {
-            return reinterpret_cast<node*>(&obj);
+            return address < chunk.first;
         });
+        return it != chunks.begin() && address < (it - 1)->second;
     };
 
+    arena scratch;
+    typedef pair<const node* const, node*> copied_entry;
+    unordered_map<const node*, node*, hash<const node*>, equal_to<const node*>, arena_allocator<copied_entry>>
+        copied_nodes{64, hash<const node*>{}, equal_to<const node*>{}, arena_allocator<copied_entry>{scratch}};
+    vector<pair<const node*, node*>> node_stack;
+
+    // characters are only copied if they belong to this graph, too
     auto ptr_for = [&](const node& child_node) -> node*
     {
+        if(!owns(&child_node))
+            return const_cast<node*>(&child_node);
         auto it = copied_nodes.find(&child_node);
         if(it != copied_nodes.end())
-            return node_ptr_of_data(*it->second);
-        
-        graph.data.push_back(make_unique<node_data>(id_node{0}));
-        node_data* copied_data_ptr = graph.data.back().get();
-        copied_nodes.insert({&child_node, copied_data_ptr});
-        node_stack.push_back(make_pair(&child_node, copied_data_ptr));
-
-        return node_ptr_of_data(*copied_data_ptr);
+            return it->second;
+
+        node* copied = child_node.visit<node*>(
+        [&](const id_node& id) -> node*
+        {
+            return &graph.memory.create<id_node>(id);
+        },
+        [&](const lit_node& lit) -> node*
+        {
+            if(!owns(lit.begin()))
+                return &graph.memory.create<lit_data>(lit, 0);
+            size_t size = lit.end() - lit.begin();
+            char* begin = copy_into(graph.memory, lit.begin(), lit.end());
+            return &graph.memory.create<lit_data>(lit_node{begin, begin + size, lit.integer()}, size);
+        },
+        [&](const ref_node& ref) -> node*
+        {
+            if(ref.identifier().empty() || !owns(&ref.identifier().front()))
+                return &graph.memory.create<ref_node>(ref);
+            const char* identifier_begin = &ref.identifier().front();
+            size_t size = ref.identifier().length();
+            char* begin = copy_into(graph.memory, identifier_begin, identifier_begin + size);
+            return &graph.memory.create<ref_node>(begin, begin + size, ref.identifier_id(), nullptr);
+        },
+        [&](const list_node& list) -> node*
+        {
+            size_t size = list.size();
+            node** begin = graph.memory.allocate_array<node*>(size);
+            return &graph.memory.create<list_data>(list_node{begin, begin + size}, size);
+        },
+        [&](const macro_node& macro) -> node*
+        {
+            macro_node& result = graph.memory.create<macro_node>(macro);
+            graph.memory.add_finalizer(destroy_macro, &result);
+            return &result;
+        },
+        [&](const proc_node& proc) -> node*
+        {
+            return &graph.memory.create<proc_node>(proc);
+        });
+
+        copied->source(child_node.source());
+        copied_nodes.insert({&child_node, copied});
+        if(child_node.is<list_node>() || child_node.is<ref_node>())
+            node_stack.push_back({&child_node, copied});
+        return copied;
     };
 
-    node& result_node = *ptr_for(n);
+    node& result_node = *ptr_for(root);
     while(!node_stack.empty())
     {
         const node& current_node = *node_stack.back().first;
-        node_data* current_data = node_stack.back().second;
+        node& current_copy = *node_stack.back().second;
         node_stack.pop_back();
 
         current_node.visit(
-        [&](const id_node& id)
-        {
-            *current_data = id_node{id};
-        },
-        [&](const lit_node& lit)
-        {
-            *current_data = make_pair(lit_node{nullptr, nullptr}, "");
-            lit_data& data = get<lit_data>(*current_data);
-            data.second = save<string>(lit);
-            char* str_begin = &data.second[0];
-            char* str_end = str_begin + data.second.size();
-            lit_node cloned_lit{str_begin, str_end};
-            data.first = lit_node{str_begin, str_end};
-        },
         [&](const ref_node& ref)
         {
-            *current_data = make_pair(ref_node{nullptr, nullptr, nullptr}, "");
-            ref_data& data = get<ref_data>(*current_data);
-            data.second = save<string>(ref.identifier());
-            char* str_begin = &data.second[0];
-            char* str_end = str_begin + data.second.size();
-            node* child = nullptr;
-            if(ref.refered())
-                child = ptr_for(*ref.refered());
-            data.first = ref_node{str_begin, str_end, child};
+            current_copy.cast<ref_node>().refered(ref.refered() ? ptr_for(*ref.refered()) : nullptr);
         },
         [&](const list_node& list)
         {
-            *current_data = make_pair(list_node{nullptr, nullptr}, vector<node*>{});
-            list_data& data = get<list_data>(*current_data);
-            data.second = save<vector<node*>>(mapped(list,
-            [&](const node& n) -> node*
+            list_node& list_copy = current_copy.cast<list_node>();
+            size_t index = 0;
+            for(const node& child : list)
             {
-                return ptr_for(n);
-                //return nullptr;
-            }));
-            node** children_begin = &data.second[0];
-            node** children_end = children_begin + data.second.size();
-            data.first = list_node{children_begin, children_end};
-        },
-        [&](const macro_node& macro)
-        {
-            *current_data = macro_node{macro};
+                list_copy.begin_[index] = ptr_for(child);
+                ++index;
+            }
         },
-        [&](const proc_node& proc)
+        [&](const node&)
         {
-            *current_data = proc_node{proc};
         });
     }
 
     return {result_node, move(graph)};
 }
-
@@ -2,11 +2,15 @@
 #define DYNAMIC_GRAPH_HPP_
 
 //#include "node.hpp"
-
-#include <boost/variant.hpp>
+#include "integer_literal.hpp"
+#include "identifier.hpp"
+#include "arena.hpp"
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <utility>
+#include <cstddef>
 
 class node;
 class id_node;
@@ -23,27 +27,48 @@ public:
     dynamic_graph() = default;
 
     id_node& create_id(std::size_t id);
-    lit_node& create_lit(std::string str);
-    ref_node& create_ref(std::string str);
-    list_node& create_list(std::vector<node*> nodes);
+    lit_node& create_lit(const std::string& str);
+    ref_node& create_ref(const std::string& str);
+    // don't copy the characters, the node refers to [begin, end) directly
+    // the buffer has to be kept alive, see keep_alive
+    // integer has to be NOT_DECODED or decode_integer(begin, end)
+    lit_node& create_lit(const char* begin, const char* end, lit_integer integer = {lit_integer::NOT_DECODED, 0});
+    ref_node& create_ref(const char* begin, const char* end);
+    // id has to be the identifier_id of [begin, end)
+    ref_node& create_ref(const char* begin, const char* end, identifier_id_t id);
+    list_node& create_list(const std::vector<node*>& nodes);
     macro_node& create_macro();
     proc_node& create_proc();
+    // copy of a single node, children and refered node are shared with n, the characters of literals are copied
+    node& copy(const node& n);
+
+    // modify nodes created by any graph, new storage is taken from (and lives as long as) this graph
+    // characters the graph doesn't own (like the source of create_lit(begin, end)) are never written to,
+    // they are copied before the literal is first modified, its decoded integer is dropped
+    void set_char(lit_node& lit, std::size_t index, char c);
+    void push_back(lit_node& lit, char c);
+    void pop_back(lit_node& lit);
+    void set_identifier(ref_node& ref, const char* begin, const char* end);
+    void set_child(list_node& list, std::size_t index, node& child);
+    void push_back(list_node& list, node& child);
+    void pop_back(list_node& list);
 
+    // takes over all nodes of the graph in constant time
     void add(dynamic_graph);
     node& add(const node&);
 
-    static std::pair<node&, dynamic_graph> clone(const node&);
+    void keep_alive(std::shared_ptr<const void> buffer);
 
-    typedef id_node id_data;
-    typedef std::pair<lit_node, std::string> lit_data;
-    typedef std::pair<ref_node, std::string> ref_data;
-    typedef std::pair<list_node, std::vector<node*>> list_data;
-    typedef macro_node macro_data;
-    typedef proc_node proc_data;
-
-    typedef boost::variant<id_node, lit_data, ref_data, list_data, macro_node, proc_node> node_data;
+    static std::pair<node&, dynamic_graph> clone(const node&);
+    // copies the nodes reachable from root that were created by this graph into a new graph,
+    // nodes of other graphs are not copied, the copies refer to them like the originals
+    // the new graph takes over the kept alive buffers, this graph (with all unreachable nodes) can be destroyed afterwards
+    std::pair<node&, dynamic_graph> extract(const node& root);
 
-    std::vector<std::unique_ptr<node_data>> data;
+    std::vector<std::shared_ptr<const void>> buffers;
+private:
+    // nodes and their character and child arrays
+    arena memory;
 };
 
 
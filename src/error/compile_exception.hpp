@@ -19,7 +19,7 @@ class Type;
 
 struct code_location
 {
-    file_position pos;
+    file_offset pos;
     std::size_t file_id;
 };
 typedef boost::variant<boost::blank, code_location> error_location;
@@ -15,7 +15,10 @@ constexpr std::pair<conststr, conststr> dictionary[] =
     {"external_invalid_name", ""},
     {"external_invalid_argument_type_list", ""},
     {"main_ct_only_proc", ""},
-    {"main_invalid_signature", ""}
+    {"main_invalid_signature", ""},
+    {"memoized_invalid_argument_number", "invalid number of arguments to 'memoized': expected 1"},
+    {"memoized_not_a_macro", "argument to 'memoized' is not a macro"},
+    {"memoized_side_effects", "macro passed to 'memoized' has side effects"}
 };
 
 constexpr std::size_t id(conststr str)
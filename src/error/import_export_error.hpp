@@ -17,7 +17,8 @@ constexpr std::pair<conststr, conststr> dictionary[] =
     {"import_after_header", "import statement after file header not allowed"},
     {"export_after_header", "export statement after file header not allowed"},
     {"symbol_not_found", "symbol not found"},
-    {"module_not_found", "module not found"}
+    {"module_not_found", "module not found"},
+    {"header_scan_mismatch", "the imports of this file differ from the ones found before parsing it"}
 };
 
 constexpr std::size_t id(conststr str)
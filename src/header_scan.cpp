@@ -0,0 +1,207 @@
+#include "header_scan.hpp"
+
+#include "scan.hpp"
+#include "parse_literal.hpp"
+#include "parse_reference.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+using std::vector;
+using std::string;
+using std::find_if;
+using std::find_if_not;
+using std::size_t;
+
+using boost::optional;
+using boost::none;
+
+using parse_literal_detail::is_digit;
+using parse_reference_detail::is_head_word_char;
+using parse_reference_detail::is_operator;
+
+namespace
+{
+
+// tokens are read like by the parser, comments and whitespace are skipped in between
+class header_scanner
+{
+public:
+    header_scanner(const char* begin, const char* end)
+      : pos_(begin),
+        end_(end)
+    {
+        skip_whitespace();
+    }
+
+    bool empty() const
+    {
+        return pos_ == end_;
+    }
+    char front() const
+    {
+        return *pos_;
+    }
+    void pop_front()
+    {
+        ++pos_;
+        skip_whitespace();
+    }
+
+    // empty if there is no reference
+    string reference()
+    {
+        if(empty())
+            return {};
+        const char* begin = pos_;
+        const char* end;
+        if(is_head_word_char(front()))
+            end = scan::skip_word_chars(pos_, end_);
+        else if(is_operator(front()))
+            end = find_if_not(pos_, end_, is_operator);
+        else
+            return {};
+        advance(end);
+        return {begin, end};
+    }
+    optional<string> literal()
+    {
+        if(empty())
+            return none;
+        if(front() == '"')
+        {
+            const char* begin = pos_ + 1;
+            const char* end = find_if(begin, end_, [](char c)
+            {
+                return c == '"' || c == '\n' || c == '#';
+            });
+            if(end == end_ || *end != '"')
+                return none;
+            advance(end + 1);
+            return string{begin, end};
+        }
+        if(is_digit(front()))
+        {
+            const char* begin = pos_;
+            const char* end = find_if_not(pos_, end_, is_digit);
+            advance(end);
+            return string{begin, end};
+        }
+        return none;
+    }
+    // any node, false if there is none or it is malformed (see malformed())
+    bool skip_node()
+    {
+        if(empty())
+            return false;
+        if(front() == '(' || front() == '{')
+        {
+            char closing = front() == '(' ? ')' : '}';
+            pop_front();
+            while(true)
+            {
+                if(skip_node())
+                    continue;
+                // curly lists contain semicolon lists
+                if(closing == '}' && !empty() && front() == ';')
+                {
+                    pop_front();
+                    continue;
+                }
+                break;
+            }
+            if(empty() || front() != closing)
+            {
+                malformed_ = true;
+                return false;
+            }
+            pop_front();
+            return true;
+        }
+        if(literal())
+            return true;
+        if(front() == '"')
+            malformed_ = true;
+        return !reference().empty();
+    }
+    bool malformed() const
+    {
+        return malformed_;
+    }
+private:
+    void advance(const char* new_pos)
+    {
+        pos_ = new_pos;
+        skip_whitespace();
+    }
+    void skip_whitespace()
+    {
+        while(!empty())
+        {
+            if(front() == '#')
+                pos_ = scan::find_newline(pos_, end_);
+            else if(scan_detail::is_whitespace(front()))
+                pos_ = scan::skip_whitespace(pos_, end_);
+            else
+                break;
+        }
+    }
+
+    const char* pos_;
+    const char* end_;
+    bool malformed_ = false;
+};
+
+}
+
+optional<vector<string>> scan_imports(const char* begin, const char* end)
+{
+    header_scanner scanner{begin, end};
+    vector<string> imports;
+    while(true)
+    {
+        string command = scanner.reference();
+        if(command == "import")
+        {
+            // import (identifiers) from "module";
+            // or a curly list, which the parser accepts there, too (read_module_header only if it is empty)
+            if(scanner.empty())
+                return none;
+            if(scanner.front() == '{')
+            {
+                if(!scanner.skip_node())
+                    return none;
+            }
+            else if(scanner.front() == '(')
+            {
+                scanner.pop_front();
+                while(!scanner.reference().empty())
+                    ;
+                if(scanner.empty() || scanner.front() != ')')
+                    return none;
+                scanner.pop_front();
+            }
+            else
+                return none;
+            if(scanner.reference() != "from")
+                return none;
+            optional<string> imported_module = scanner.literal();
+            if(!imported_module)
+                return none;
+            imports.push_back(*imported_module);
+        }
+        else if(command == "export")
+        {
+            while(scanner.skip_node())
+                ;
+            if(scanner.malformed())
+                return none;
+        }
+        else
+            return imports;
+
+        if(scanner.empty() || scanner.front() != ';')
+            return none;
+        scanner.pop_front();
+    }
+}
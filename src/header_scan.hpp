@@ -0,0 +1,15 @@
+#ifndef HEADER_SCAN_HPP_
+#define HEADER_SCAN_HPP_
+
+#include <boost/optional.hpp>
+
+#include <vector>
+#include <string>
+
+// the modules a file imports, read from its leading import and export statements without parsing it
+// (no nodes are created), in the order of the import statements
+// none if the statements are malformed, parsing the file reports the error then
+// agrees with read_module_header for every file whose header it accepts
+boost::optional<std::vector<std::string>> scan_imports(const char* begin, const char* end);
+
+#endif
@@ -0,0 +1,125 @@
+#include "identifier.hpp"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <unordered_map>
+#include <deque>
+#include <shared_mutex>
+#include <mutex>
+#include <cassert>
+
+using std::string;
+using std::deque;
+using std::unordered_map;
+using std::shared_timed_mutex;
+using std::shared_lock;
+using std::unique_lock;
+using std::size_t;
+
+using boost::string_ref;
+
+namespace
+{
+
+// FNV-1a
+size_t hash(string_ref str)
+{
+    size_t result = 14695981039346656037ull;
+    for(char c : str)
+        result = (result ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return result;
+}
+struct string_ref_hash
+{
+    size_t operator()(string_ref str) const
+    {
+        return hash(str);
+    }
+};
+
+class identifier_table
+{
+public:
+    identifier_table()
+    {
+        // in the order of identifier_ids
+        const char* const initial_identifiers[] = {"", "export", "import", "from", "def", "core"};
+        static_assert(sizeof(initial_identifiers) / sizeof(initial_identifiers[0])
+                == identifier_id(identifier_ids::FIRST_UNUSED), "an identifier_ids entry is missing");
+        for(const char* str : initial_identifiers)
+            insert(str);
+    }
+
+    identifier_id_t id(string_ref str)
+    {
+        {
+            shared_lock<shared_timed_mutex> lock{mutex};
+            auto it = ids.find(str);
+            if(it != ids.end())
+                return it->second;
+        }
+        unique_lock<shared_timed_mutex> lock{mutex};
+        auto it = ids.find(str); // another thread may have inserted it meanwhile
+        if(it != ids.end())
+            return it->second;
+        return insert(str);
+    }
+    const string& str(identifier_id_t id)
+    {
+        shared_lock<shared_timed_mutex> lock{mutex};
+        assert(id < strings.size());
+        return strings[id];
+    }
+private:
+    identifier_id_t insert(string_ref str)
+    {
+        identifier_id_t new_id = strings.size();
+        // the keys refer to the strings, deque::push_back doesn't move them
+        strings.emplace_back(str.begin(), str.end());
+        ids.insert({string_ref{strings.back()}, new_id});
+        return new_id;
+    }
+
+    shared_timed_mutex mutex;
+    deque<string> strings;
+    unordered_map<string_ref, identifier_id_t, string_ref_hash> ids;
+};
+
+identifier_table& table()
+{
+    static identifier_table instance;
+    return instance;
+}
+
+}
+
+identifier_id_t identifier_id(const char* begin, const char* end)
+{
+    if(begin == end)
+        return 0;
+    string_ref str{begin, static_cast<size_t>(end - begin)};
+
+    // the parser looks up the same few identifiers over and over,
+    // a small per thread cache saves taking the lock for those
+    struct cache_entry
+    {
+        const string* str;
+        identifier_id_t id;
+    };
+    constexpr size_t cache_size = 1024;
+    thread_local cache_entry cache[cache_size] = {};
+
+    cache_entry& entry = cache[hash(str) % cache_size];
+    if(entry.str && string_ref{*entry.str} == str)
+        return entry.id;
+
+    identifier_id_t id = table().id(str);
+    entry = cache_entry{&identifier_string(id), id};
+    return id;
+}
+
+const string& identifier_string(identifier_id_t id)
+{
+    return table().str(id);
+}
+
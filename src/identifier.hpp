@@ -0,0 +1,42 @@
+#ifndef IDENTIFIER_HPP_
+#define IDENTIFIER_HPP_
+
+#include <string>
+#include <cstdint>
+
+// identifiers are interned in one table shared by all threads,
+// so equal identifiers have equal ids for the whole program run
+
+typedef std::uint32_t identifier_id_t;
+
+// ids of the identifiers the table starts with
+// id 0 is the empty identifier
+enum class identifier_ids
+  : identifier_id_t
+{
+    // import/export identifiers
+    EXPORT = 1,
+    IMPORT,
+    FROM,
+    DEF,
+
+    CORE,
+
+    FIRST_UNUSED
+};
+
+identifier_id_t identifier_id(const char* begin, const char* end);
+inline identifier_id_t identifier_id(const std::string& str)
+{
+    return identifier_id(str.data(), str.data() + str.size());
+}
+constexpr identifier_id_t identifier_id(identifier_ids id)
+{
+    return static_cast<identifier_id_t>(id);
+}
+
+// the returned reference stays valid
+const std::string& identifier_string(identifier_id_t id);
+
+#endif
+
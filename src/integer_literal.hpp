@@ -0,0 +1,66 @@
+#ifndef INTEGER_LITERAL_HPP_
+#define INTEGER_LITERAL_HPP_
+
+#include <cstdint>
+#include <limits>
+
+// value of a literal read as signed 64 bit decimal integer
+struct lit_integer
+{
+    enum status_t
+      : std::uint8_t
+    {
+        NOT_DECODED,
+        INVALID,
+        VALID,
+        OUT_OF_RANGE
+    };
+
+    status_t status;
+    std::int64_t value;
+};
+
+// accepts what std::stol accepts (leading whitespace, a sign, decimal digits),
+// but not trailing characters, without allocating
+// overflowing numbers are OUT_OF_RANGE even with trailing characters, like with stol
+inline lit_integer decode_integer(const char* begin, const char* end)
+{
+    auto is_space = [](char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    };
+    while(begin != end && is_space(*begin))
+        ++begin;
+
+    bool is_negative = false;
+    if(begin != end && (*begin == '+' || *begin == '-'))
+    {
+        is_negative = *begin == '-';
+        ++begin;
+    }
+    if(begin == end || *begin < '0' || *begin > '9')
+        return {lit_integer::INVALID, 0};
+
+    // accumulate the magnitude, which may be one larger than the maximum for negative numbers
+    const std::uint64_t limit = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) + is_negative;
+    std::uint64_t magnitude = 0;
+    bool overflow = false;
+    for( ; begin != end && '0' <= *begin && *begin <= '9'; ++begin)
+    {
+        unsigned digit = *begin - '0';
+        if(magnitude > (limit - digit) / 10)
+            overflow = true;
+        else
+            magnitude = magnitude * 10 + digit;
+    }
+    if(overflow)
+        return {lit_integer::OUT_OF_RANGE, 0};
+    if(begin != end)
+        return {lit_integer::INVALID, 0};
+
+    std::int64_t value = is_negative ? static_cast<std::int64_t>(0 - magnitude) : static_cast<std::int64_t>(magnitude);
+    return {lit_integer::VALID, value};
+}
+
+#endif
+
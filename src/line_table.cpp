@@ -0,0 +1,24 @@
+#include "line_table.hpp"
+
+#include "scan.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using std::upper_bound;
+
+line_table::line_table(const char* begin, const char* end)
+  : line_begins{0}
+{
+    for(const char* pos = scan::find_newline(begin, end); pos != end; pos = scan::find_newline(pos + 1, end))
+        line_begins.push_back(static_cast<file_offset>(pos + 1 - begin));
+}
+
+file_position line_table::position(file_offset offset) const
+{
+    auto next_line = upper_bound(line_begins.begin(), line_begins.end(), offset);
+    assert(next_line != line_begins.begin());
+    auto line = next_line - 1;
+    return file_position{static_cast<std::size_t>(line - line_begins.begin()), offset - *line};
+}
+
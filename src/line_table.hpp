@@ -0,0 +1,27 @@
+#ifndef LINE_TABLE_HPP_
+#define LINE_TABLE_HPP_
+
+#include "node_source.hpp"
+
+#include <vector>
+#include <cstddef>
+
+struct file_position
+{
+    std::size_t line;
+    std::size_t line_pos;
+};
+
+// offsets at which the lines of a file begin, for turning offsets into lines and columns
+class line_table
+{
+public:
+    line_table(const char* begin, const char* end);
+
+    file_position position(file_offset offset) const;
+private:
+    std::vector<file_offset> line_begins;
+};
+
+#endif
+
@@ -0,0 +1,390 @@
+#include "macro_cache.hpp"
+#include "macro_profile.hpp"
+#include "macro_execution.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+using std::size_t;
+using std::pair;
+using std::vector;
+using std::unordered_map;
+using std::shared_ptr;
+using std::make_shared;
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::move;
+using std::reverse;
+using std::equal;
+using std::numeric_limits;
+
+namespace
+{
+
+// incremented by every call of a macro with side effects on this thread
+thread_local size_t side_effect_count = 0;
+
+size_t mix(size_t hash, size_t value)
+{
+    return hash ^ (value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2));
+}
+
+size_t hash_chars(const char* begin, const char* end)
+{
+    size_t hash = 0xcbf29ce484222325;
+    for( ; begin != end; ++begin)
+    {
+        hash ^= static_cast<unsigned char>(*begin);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+template<class T>
+size_t address(const T* ptr)
+{
+    return reinterpret_cast<size_t>(ptr);
+}
+
+// arguments are visited in pre-order, starting with the first one
+vector<const node*> initial_stack(node_range nodes)
+{
+    vector<const node*> stack;
+    for_each(nodes, [&](const node& n)
+    {
+        stack.push_back(&n);
+    });
+    reverse(stack.begin(), stack.end());
+    return stack;
+}
+
+}
+
+size_t structural_hash(node_range nodes)
+{
+    // a node that is reached again contributes its pre-order index, this terminates on cycles
+    unordered_map<const node*, size_t> visited;
+    vector<const node*> stack = initial_stack(nodes);
+    size_t hash = stack.size();
+    while(!stack.empty())
+    {
+        const node& n = *stack.back();
+        stack.pop_back();
+
+        auto p = visited.insert({&n, visited.size()});
+        if(!p.second)
+        {
+            hash = mix(mix(hash, 0), p.first->second);
+            continue;
+        }
+        hash = mix(hash, static_cast<size_t>(n.type()) + 1);
+        switch(n.type())
+        {
+        case node_type::ID:
+            hash = mix(hash, n.cast<id_node>().id());
+            break;
+        case node_type::LITERAL:
+        {
+            const lit_node& lit = n.cast<lit_node>();
+            hash = mix(hash, hash_chars(lit.begin(), lit.end()));
+            break;
+        }
+        case node_type::REFERENCE:
+        {
+            const ref_node& ref = n.cast<ref_node>();
+            hash = mix(hash, ref.identifier_id());
+            if(ref.refered() == nullptr)
+                hash = mix(hash, 0);
+            else
+                stack.push_back(ref.refered());
+            break;
+        }
+        case node_type::LIST:
+        {
+            const list_node& list = n.cast<list_node>();
+            hash = mix(hash, list.size());
+            for(size_t i = list.size(); i != 0; --i)
+                stack.push_back(&list[i - 1]);
+            break;
+        }
+        case node_type::MACRO:
+            hash = mix(hash, address(n.cast<macro_node>().function().get()));
+            break;
+        case node_type::PROC:
+        {
+            const proc_node& proc = n.cast<proc_node>();
+            hash = mix(mix(hash, address(proc.ct_function())), address(proc.rt_function()));
+            break;
+        }
+        }
+    }
+    return hash;
+}
+
+bool structurally_identical(node_range lhs, node_range rhs)
+{
+    // both sides are walked in the same order as in structural_hash,
+    // a node reached again has to be paired with a node reached again at the same index
+    unordered_map<const node*, size_t> lhs_visited;
+    unordered_map<const node*, size_t> rhs_visited;
+    vector<const node*> lhs_stack = initial_stack(lhs);
+    vector<const node*> rhs_stack = initial_stack(rhs);
+    if(lhs_stack.size() != rhs_stack.size())
+        return false;
+    while(!lhs_stack.empty())
+    {
+        const node& l = *lhs_stack.back();
+        const node& r = *rhs_stack.back();
+        lhs_stack.pop_back();
+        rhs_stack.pop_back();
+
+        auto lhs_p = lhs_visited.insert({&l, lhs_visited.size()});
+        auto rhs_p = rhs_visited.insert({&r, rhs_visited.size()});
+        if(lhs_p.second != rhs_p.second)
+            return false;
+        if(!lhs_p.second)
+        {
+            if(lhs_p.first->second != rhs_p.first->second)
+                return false;
+            continue;
+        }
+
+        if(l.type() != r.type())
+            return false;
+        switch(l.type())
+        {
+        case node_type::ID:
+            if(l.cast<id_node>().id() != r.cast<id_node>().id())
+                return false;
+            break;
+        case node_type::LITERAL:
+        {
+            const lit_node& lhs_lit = l.cast<lit_node>();
+            const lit_node& rhs_lit = r.cast<lit_node>();
+            if(!equal(lhs_lit.begin(), lhs_lit.end(), rhs_lit.begin(), rhs_lit.end()))
+                return false;
+            break;
+        }
+        case node_type::REFERENCE:
+        {
+            const ref_node& lhs_ref = l.cast<ref_node>();
+            const ref_node& rhs_ref = r.cast<ref_node>();
+            if(lhs_ref.identifier_id() != rhs_ref.identifier_id())
+                return false;
+            if(lhs_ref.refered() == nullptr || rhs_ref.refered() == nullptr)
+            {
+                if(lhs_ref.refered() != rhs_ref.refered())
+                    return false;
+            }
+            else
+            {
+                lhs_stack.push_back(lhs_ref.refered());
+                rhs_stack.push_back(rhs_ref.refered());
+            }
+            break;
+        }
+        case node_type::LIST:
+        {
+            const list_node& lhs_list = l.cast<list_node>();
+            const list_node& rhs_list = r.cast<list_node>();
+            if(lhs_list.size() != rhs_list.size())
+                return false;
+            for(size_t i = lhs_list.size(); i != 0; --i)
+            {
+                lhs_stack.push_back(&lhs_list[i - 1]);
+                rhs_stack.push_back(&rhs_list[i - 1]);
+            }
+            break;
+        }
+        case node_type::MACRO:
+            if(l.cast<macro_node>().function() != r.cast<macro_node>().function())
+                return false;
+            break;
+        case node_type::PROC:
+        {
+            const proc_node& lhs_proc = l.cast<proc_node>();
+            const proc_node& rhs_proc = r.cast<proc_node>();
+            if(lhs_proc.ct_function() != rhs_proc.ct_function() || lhs_proc.rt_function() != rhs_proc.rt_function())
+                return false;
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+bool structurally_identical(const compact_graph& lhs, node_handle lhs_list, node_range rhs)
+{
+    // the same walk as above, the visit indices of lhs are stored by handle
+    const size_t not_visited = numeric_limits<size_t>::max();
+    vector<size_t> lhs_visited(lhs.size(), not_visited);
+    size_t lhs_visited_count = 0;
+    unordered_map<const node*, size_t> rhs_visited;
+    vector<node_handle> lhs_stack;
+    for(size_t i = lhs.child_count(lhs_list); i != 0; --i)
+        lhs_stack.push_back(lhs.child(lhs_list, i - 1));
+    vector<const node*> rhs_stack = initial_stack(rhs);
+    if(lhs_stack.size() != rhs_stack.size())
+        return false;
+    while(!lhs_stack.empty())
+    {
+        node_handle l = lhs_stack.back();
+        const node& r = *rhs_stack.back();
+        lhs_stack.pop_back();
+        rhs_stack.pop_back();
+
+        bool lhs_first_visit = lhs_visited[l] == not_visited;
+        if(lhs_first_visit)
+            lhs_visited[l] = lhs_visited_count++;
+        auto rhs_p = rhs_visited.insert({&r, rhs_visited.size()});
+        if(lhs_first_visit != rhs_p.second)
+            return false;
+        if(!lhs_first_visit)
+        {
+            if(lhs_visited[l] != rhs_p.first->second)
+                return false;
+            continue;
+        }
+
+        if(lhs.type(l) != r.type())
+            return false;
+        switch(r.type())
+        {
+        case node_type::ID:
+            if(lhs.id(l) != r.cast<id_node>().id())
+                return false;
+            break;
+        case node_type::LITERAL:
+        {
+            const lit_node& rhs_lit = r.cast<lit_node>();
+            if(!equal(lhs.literal_begin(l), lhs.literal_end(l), rhs_lit.begin(), rhs_lit.end()))
+                return false;
+            break;
+        }
+        case node_type::REFERENCE:
+        {
+            const ref_node& rhs_ref = r.cast<ref_node>();
+            if(lhs.identifier_id(l) != rhs_ref.identifier_id())
+                return false;
+            if(lhs.refered(l) == null_handle || rhs_ref.refered() == nullptr)
+            {
+                if(lhs.refered(l) != null_handle || rhs_ref.refered() != nullptr)
+                    return false;
+            }
+            else
+            {
+                lhs_stack.push_back(lhs.refered(l));
+                rhs_stack.push_back(rhs_ref.refered());
+            }
+            break;
+        }
+        case node_type::LIST:
+        {
+            const list_node& rhs_list = r.cast<list_node>();
+            if(lhs.child_count(l) != rhs_list.size())
+                return false;
+            for(size_t i = rhs_list.size(); i != 0; --i)
+            {
+                lhs_stack.push_back(lhs.child(l, i - 1));
+                rhs_stack.push_back(&rhs_list[i - 1]);
+            }
+            break;
+        }
+        case node_type::MACRO:
+            if(lhs.macro(l).function() != r.cast<macro_node>().function())
+                return false;
+            break;
+        case node_type::PROC:
+        {
+            const proc_node& rhs_proc = r.cast<proc_node>();
+            if(lhs.proc(l).ct_function() != rhs_proc.ct_function() || lhs.proc(l).rt_function() != rhs_proc.rt_function())
+                return false;
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+pair<node&, dynamic_graph> macro_cache::call(const function<macro_node::macro>& func, node_range args)
+{
+    size_t hash = structural_hash(args);
+    {
+        lock_guard<mutex> lock{mutex_};
+        auto equal_hashes = entries_.equal_range(hash);
+        for(auto it = equal_hashes.first; it != equal_hashes.second; ++it)
+        {
+            if(structurally_identical(*it->second.args, it->second.args->root(), args))
+            {
+                ++hits_;
+                return shared_result(it->second);
+            }
+        }
+        ++misses_;
+    }
+
+    // the arguments are kept as a compact_graph, the macro is executed with nodes expanded from it
+    shared_ptr<const compact_graph> arg_graph;
+    {
+        macro_copy_scope copy_scope;
+        vector<node*> arg_pointers;
+        for_each(args, [&](node& n)
+        {
+            arg_pointers.push_back(&n);
+        });
+        dynamic_graph arg_list_owner;
+        arg_graph = make_shared<compact_graph>(arg_list_owner.create_list(arg_pointers));
+    }
+    auto expanded = arg_graph->expand();
+
+    size_t side_effects_before = side_effect_count;
+    auto p = func(rangeify(expanded.first.cast<list_node>()));
+    // only the nodes reachable from the result stay alive as long as the cache, the expanded arguments are dropped
+    expanded.second.add(move(p.second));
+    expanded.second.keep_alive(arg_graph);
+    auto kept = expanded.second.extract(p.first);
+    entry e{move(arg_graph), &kept.first, make_shared<dynamic_graph>(move(kept.second))};
+    if(side_effect_count == side_effects_before)
+    {
+        lock_guard<mutex> lock{mutex_};
+        entries_.insert({hash, e});
+    }
+    return shared_result(e);
+}
+
+pair<node&, dynamic_graph> macro_cache::shared_result(const entry& e)
+{
+    dynamic_graph graph;
+    graph.keep_alive(e.graph);
+    return {*e.result, move(graph)};
+}
+
+size_t macro_cache::hits() const
+{
+    lock_guard<mutex> lock{mutex_};
+    return hits_;
+}
+size_t macro_cache::misses() const
+{
+    lock_guard<mutex> lock{mutex_};
+    return misses_;
+}
+size_t macro_cache::size() const
+{
+    lock_guard<mutex> lock{mutex_};
+    return entries_.size();
+}
+
+pair<node&, dynamic_graph> macro_node::operator()(node_range r) const
+{
+    macro_profile_scope profile_scope{func_.get()};
+    if(has_side_effects_)
+        ++side_effect_count;
+    if(cache_)
+        return cache_->call(*func_, move(r));
+    if(macro_function* code = compiled_code())
+        return execute_macro(code, r);
+    return (*func_)(move(r));
+}
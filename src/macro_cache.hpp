@@ -0,0 +1,53 @@
+#ifndef MACRO_CACHE_HPP_
+#define MACRO_CACHE_HPP_
+
+#include "node.hpp"
+#include "dynamic_graph.hpp"
+#include "compact_graph.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <functional>
+
+// results of a macro, keyed by the structure of its arguments
+// a hit returns the result of the first call with equal arguments, the nodes are shared by all callers
+// (they must not be modified, macro execution copies them before writing)
+// results of calls that invoke a macro with side effects are not cached
+class macro_cache
+{
+public:
+    std::pair<node&, dynamic_graph> call(const std::function<macro_node::macro>& func, node_range args);
+
+    std::size_t hits() const;
+    std::size_t misses() const;
+    std::size_t size() const;
+private:
+    struct entry
+    {
+        // list of the arguments the macro was executed with, compared with the arguments of later calls
+        std::shared_ptr<const compact_graph> args;
+        // only the nodes reachable from the result, the literals may refer to the characters of args
+        node* result;
+        std::shared_ptr<dynamic_graph> graph;
+    };
+    std::pair<node&, dynamic_graph> shared_result(const entry& e);
+
+    mutable std::mutex mutex_;
+    std::unordered_multimap<std::size_t, entry> entries_;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+};
+
+// hash and equality of everything reachable from the nodes, terminate on cycles
+// sharing is part of the structure: (a a) with a single node a differs from (a b) with an equal copy b
+// macros and procs are compared by identity (the function they call), not structurally
+std::size_t structural_hash(node_range nodes);
+bool structurally_identical(node_range lhs, node_range rhs);
+// the same with the children of lhs_list as lhs
+bool structurally_identical(const compact_graph& lhs, node_handle lhs_list, node_range rhs);
+
+#endif
+
@@ -0,0 +1,406 @@
+#include "macro_code_cache.hpp"
+
+#include "macro_execution.hpp"
+#include "ast_cache.hpp"
+#include "mapped_file.hpp"
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <boost/filesystem.hpp>
+
+#include <unistd.h>
+
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+
+using std::uint32_t;
+using std::uint64_t;
+using std::uintmax_t;
+using std::size_t;
+using std::time_t;
+using std::string;
+using std::to_string;
+using std::vector;
+using std::unique_ptr;
+using std::unordered_set;
+using std::function;
+using std::ofstream;
+using std::ios;
+using std::memcpy;
+using std::memcmp;
+using std::lock_guard;
+using std::mutex;
+using std::call_once;
+using std::sort;
+using std::move;
+
+using boost::filesystem::path;
+using boost::filesystem::directory_iterator;
+using boost::system::error_code;
+
+using llvm::Module;
+using llvm::Function;
+using llvm::BasicBlock;
+using llvm::Instruction;
+using llvm::Value;
+using llvm::Constant;
+using llvm::GlobalValue;
+using llvm::GlobalVariable;
+using llvm::ReturnInst;
+using llvm::MemoryBuffer;
+using llvm::ErrorOr;
+using llvm::StringRef;
+using llvm::SmallVector;
+using llvm::ValueToValueMapTy;
+using llvm::CloneFunctionInto;
+using llvm::raw_string_ostream;
+using llvm::WriteBitcodeToFile;
+using llvm::parseBitcodeFile;
+using llvm::dyn_cast;
+
+namespace
+{
+
+constexpr char entry_magic[4] = {'A', 'M', 'C', '\0'};
+constexpr uint32_t entry_version = 2;
+const char* const entry_extension = ".amc";
+
+// layout of an entry: header, key (key_size chars), bitcode of the optimized module (code_size bytes)
+// the whole key is stored, so a different function with the same key hash is a miss, not a wrong result
+struct entry_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key_hash;
+    uint64_t key_size;
+    uint64_t code_hash;
+    uint64_t code_size;
+};
+
+void collect_globals(const Value* value, unordered_set<const GlobalValue*>& globals)
+{
+    if(const GlobalValue* global = dyn_cast<GlobalValue>(value))
+        globals.insert(global);
+    else if(const Constant* constant = dyn_cast<Constant>(value))
+    {
+        for(unsigned i = 0; i != constant->getNumOperands(); ++i)
+            collect_globals(constant->getOperand(i), globals);
+    }
+}
+
+void copy_body(const Function& from, Function& to, ValueToValueMapTy& vtvm)
+{
+    auto to_arg = to.arg_begin();
+    for(auto arg = from.arg_begin(); arg != from.arg_end(); ++arg, ++to_arg)
+        vtvm[&*arg] = &*to_arg;
+    SmallVector<ReturnInst*, 4> returns;
+    CloneFunctionInto(&to, &from, vtvm, true, returns);
+}
+
+// a module with a copy of func named "macro" and declarations of the globals it uses, which are matched by name
+// nullptr if it uses unnamed globals, or addresses of nodes: to_node and call_macro pass them as integer constants,
+// which change with every run (address space layout randomization), so entries for them would never be used
+unique_ptr<Module> standalone_copy(const Function& func)
+{
+    unordered_set<const GlobalValue*> globals;
+    for(const BasicBlock& block : func)
+    {
+        for(const Instruction& instruction : block)
+        {
+            for(unsigned i = 0; i != instruction.getNumOperands(); ++i)
+                collect_globals(instruction.getOperand(i), globals);
+        }
+    }
+    for(const GlobalValue* global : globals)
+    {
+        if(global->getName() == "macro_to_node" || global->getName() == "macro_call_macro")
+            return nullptr;
+    }
+
+    unique_ptr<Module> module{new Module{"macro", func.getContext()}};
+    module->setDataLayout(func.getParent()->getDataLayout());
+    ValueToValueMapTy vtvm;
+    for(const GlobalValue* global : globals)
+    {
+        if(!global->hasName())
+            return nullptr;
+        if(const Function* callee = dyn_cast<Function>(global))
+            vtvm[callee] = Function::Create(callee->getFunctionType(), GlobalValue::ExternalLinkage, callee->getName(), module.get());
+        else if(const GlobalVariable* variable = dyn_cast<GlobalVariable>(global))
+        {
+            vtvm[variable] = new GlobalVariable(*module, variable->getType()->getElementType(), variable->isConstant(),
+                    GlobalValue::ExternalLinkage, nullptr, variable->getName());
+        }
+        else
+            return nullptr;
+    }
+    Function* copy = Function::Create(func.getFunctionType(), GlobalValue::ExternalLinkage, "macro", module.get());
+    copy_body(func, *copy, vtvm);
+    return module;
+}
+
+string print(const Module& module)
+{
+    string str;
+    raw_string_ostream os{str};
+    module.print(os, nullptr);
+    os.flush();
+    return str;
+}
+
+// the accessors inline_node_accessors inlines into macros (their names end in _inline), sorted by name
+string print_inline_accessors(const Module& module)
+{
+    vector<const Function*> accessors;
+    for(const Function& func : module)
+    {
+        if(!func.isDeclaration() && func.getName().endswith("_inline"))
+            accessors.push_back(&func);
+    }
+    sort(accessors.begin(), accessors.end(), [](const Function* lhs, const Function* rhs)
+    {
+        return lhs->getName() < rhs->getName();
+    });
+    string str;
+    raw_string_ostream os{str};
+    for(const Function* accessor : accessors)
+        accessor->print(os);
+    os.flush();
+    return str;
+}
+
+bool valid_entry(const mapped_file& file, const string& key)
+{
+    if(file.size() < sizeof(entry_header))
+        return false;
+    entry_header header;
+    memcpy(&header, file.begin(), sizeof(header));
+    if(memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0 || header.version != entry_version
+            || header.key_size != key.size() || file.size() != sizeof(header) + header.key_size + header.code_size)
+        return false;
+    const char* stored_key = file.begin() + sizeof(header);
+    if(memcmp(stored_key, key.data(), key.size()) != 0)
+        return false;
+    const char* code = stored_key + key.size();
+    return content_hash(code, code + header.code_size) == header.code_hash;
+}
+
+}
+
+macro_code_cache::macro_code_cache(path directory, uintmax_t max_size, optimization_level level)
+  : directory_(move(directory)),
+    max_size_(max_size)
+{
+    configuration_ = "llvm " + to_string(LLVM_VERSION_MAJOR) + "." + to_string(LLVM_VERSION_MINOR) + "\n";
+    configuration_ += "target " + llvm::sys::getProcessTriple() + " " + llvm::sys::getHostCPUName().str() + "\n";
+    configuration_ += "level " + to_string(static_cast<int>(level)) + "\n";
+    configuration_ += "passes";
+    for(const string& pass : optimization_passes(level))
+        configuration_ += " " + pass;
+    configuration_ += "\n";
+    // the accessors inlined into macros read nodes at these offsets
+    configuration_ += "layout " + to_string(node_layout::type()) + " " + to_string(node_layout::lit_begin())
+        + " " + to_string(node_layout::lit_end()) + " " + to_string(node_layout::ref_refered())
+        + " " + to_string(node_layout::list_begin()) + " " + to_string(node_layout::list_end()) + "\n";
+}
+
+bool macro_code_cache::optimize(Function& func, const function<void (Function&)>& run_passes)
+{
+    unique_ptr<Module> source = standalone_copy(func);
+    if(!source)
+    {
+        run_passes(func);
+        return false;
+    }
+    // the accessors are in the module of func, they are the same for all macros
+    call_once(accessors_once_, [&]
+    {
+        accessors_ = print_inline_accessors(*func.getParent());
+    });
+    string key = configuration_ + accessors_ + print(*source);
+    uint64_t key_hash = content_hash(key.data(), key.data() + key.size());
+    if(load(func, key, key_hash))
+    {
+        ++hits_;
+        return true;
+    }
+    ++misses_;
+    run_passes(func);
+    store(func, key, key_hash);
+    return false;
+}
+
+size_t macro_code_cache::hits() const
+{
+    return hits_;
+}
+size_t macro_code_cache::misses() const
+{
+    return misses_;
+}
+
+path macro_code_cache::entry_path(uint64_t key_hash) const
+{
+    return directory_ / (to_string(key_hash) + entry_extension);
+}
+
+bool macro_code_cache::load(Function& func, const string& key, uint64_t key_hash)
+{
+    path entry = entry_path(key_hash);
+    mapped_file file{entry.c_str()};
+    if(!file)
+        return false;
+    // written by another version, for another function or corrupt: it is replaced after optimization
+    if(!valid_entry(file, key))
+        return false;
+
+    const char* code = file.begin() + sizeof(entry_header) + key.size();
+    unique_ptr<MemoryBuffer> buffer{MemoryBuffer::getMemBuffer(StringRef{code, static_cast<size_t>(file.end() - code)}, "", false)};
+    ErrorOr<Module*> parsed = parseBitcodeFile(buffer.get(), func.getContext());
+    if(!parsed)
+        return false;
+    unique_ptr<Module> cached{parsed.get()};
+
+    Function* cached_func = cached->getFunction("macro");
+    if(!cached_func || cached_func->isDeclaration() || cached_func->getFunctionType() != func.getFunctionType())
+        return false;
+    // the declarations are resolved to the globals of the same name and type in the module of func
+    ValueToValueMapTy vtvm;
+    Module& module = *func.getParent();
+    auto map_global = [&](GlobalValue& global)
+    {
+        GlobalValue* target = module.getNamedValue(global.getName());
+        if(!target || target->getType() != global.getType())
+            return false;
+        vtvm[&global] = target;
+        return true;
+    };
+    for(Function& cached_global : *cached)
+    {
+        if(&cached_global != cached_func && !map_global(cached_global))
+            return false;
+    }
+    for(auto it = cached->global_begin(); it != cached->global_end(); ++it)
+    {
+        if(!map_global(*it))
+            return false;
+    }
+
+    GlobalValue::LinkageTypes linkage = func.getLinkage();
+    func.deleteBody();
+    copy_body(*cached_func, func, vtvm);
+    func.setLinkage(linkage);
+
+    // for the eviction of the least recently used entries
+    error_code error;
+    boost::filesystem::last_write_time(entry, std::time(nullptr), error);
+    return true;
+}
+
+void macro_code_cache::store(const Function& func, const string& key, uint64_t key_hash)
+{
+    unique_ptr<Module> optimized = standalone_copy(func);
+    if(!optimized)
+        return;
+    string code;
+    raw_string_ostream os{code};
+    WriteBitcodeToFile(optimized.get(), os);
+    os.flush();
+
+    entry_header header = {};
+    memcpy(header.magic, entry_magic, sizeof(entry_magic));
+    header.version = entry_version;
+    header.key_hash = key_hash;
+    header.key_size = key.size();
+    header.code_hash = content_hash(code.data(), code.data() + code.size());
+    header.code_size = code.size();
+
+    error_code error;
+    boost::filesystem::create_directories(directory_, error);
+    if(error)
+        return;
+
+    // write to a temporary file and rename it, so readers never see half written entries
+    string entry = entry_path(key_hash).native();
+    string temporary_path = entry + "." + to_string(getpid()) + "." + to_string(temporary_count_++) + ".tmp";
+    {
+        ofstream file{temporary_path, ios::binary | ios::trunc};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(key.data(), key.size());
+        file.write(code.data(), code.size());
+        if(!file)
+        {
+            std::remove(temporary_path.c_str());
+            return;
+        }
+    }
+    if(std::rename(temporary_path.c_str(), entry.c_str()) != 0)
+    {
+        std::remove(temporary_path.c_str());
+        return;
+    }
+    remove_least_recently_used();
+}
+
+void macro_code_cache::remove_least_recently_used()
+{
+    struct entry
+    {
+        time_t last_use;
+        uintmax_t size;
+        path p;
+    };
+
+    lock_guard<mutex> lock{eviction_mutex_};
+    vector<entry> entries;
+    uintmax_t total_size = 0;
+    error_code iteration_error;
+    for(directory_iterator it{directory_, iteration_error}, end; !iteration_error && it != end; it.increment(iteration_error))
+    {
+        const path& p = it->path();
+        if(p.extension() != entry_extension)
+            continue;
+        // entries can be removed by other compilers at any time
+        error_code size_error;
+        error_code time_error;
+        uintmax_t size = boost::filesystem::file_size(p, size_error);
+        time_t last_use = boost::filesystem::last_write_time(p, time_error);
+        if(size_error || time_error)
+            continue;
+        entries.push_back({last_use, size, p});
+        total_size += size;
+    }
+    if(total_size <= max_size_)
+        return;
+
+    sort(entries.begin(), entries.end(), [](const entry& lhs, const entry& rhs)
+    {
+        return lhs.last_use < rhs.last_use;
+    });
+    for(const entry& e : entries)
+    {
+        if(total_size <= max_size_)
+            break;
+        error_code error;
+        boost::filesystem::remove(e.p, error);
+        total_size -= e.size;
+    }
+}
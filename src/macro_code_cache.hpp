@@ -0,0 +1,64 @@
+#ifndef MACRO_CODE_CACHE_HPP_
+#define MACRO_CODE_CACHE_HPP_
+
+#include "macro_environment.hpp"
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+namespace llvm
+{
+class Function;
+}
+
+// optimized IR of macros (and compile time procs), kept on disk between runs of the compiler
+// an entry is keyed by the unoptimized IR, the target triple and CPU, the optimization level and passes,
+// the node layout and the IR of the inlined node accessors
+// entries are files in a directory, written to a temporary file and renamed, so concurrent compilers can share it
+// the format uses the native byte order, caches are not meant to be copied between machines
+class macro_code_cache
+{
+public:
+    // the least recently used entries are removed when the entries take more than max_size bytes
+    macro_code_cache(boost::filesystem::path directory, std::uintmax_t max_size, optimization_level level);
+    macro_code_cache(const macro_code_cache&) = delete;
+
+    macro_code_cache& operator=(const macro_code_cache&) = delete;
+
+    // replaces the body of func by the cached optimized body if there is one,
+    // otherwise calls run_passes(func) and stores the result
+    // functions that use unnamed globals (like other procs) or addresses of nodes (to_node, call_macro)
+    // are not cached, they are always optimized
+    // returns whether the cached body was used
+    bool optimize(llvm::Function& func, const std::function<void (llvm::Function&)>& run_passes);
+
+    std::size_t hits() const;
+    std::size_t misses() const;
+private:
+    boost::filesystem::path entry_path(std::uint64_t key_hash) const;
+    bool load(llvm::Function& func, const std::string& key, std::uint64_t key_hash);
+    void store(const llvm::Function& func, const std::string& key, std::uint64_t key_hash);
+    void remove_least_recently_used();
+
+    boost::filesystem::path directory_;
+    std::uintmax_t max_size_;
+    // everything in the key but the IR
+    std::string configuration_;
+    // printed once, on the first call of optimize
+    std::once_flag accessors_once_;
+    std::string accessors_;
+
+    std::mutex eviction_mutex_;
+    std::atomic<std::size_t> hits_{0};
+    std::atomic<std::size_t> misses_{0};
+    std::atomic<std::size_t> temporary_count_{0};
+};
+
+#endif
+
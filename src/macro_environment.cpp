@@ -1,6 +1,7 @@
 #include "macro_environment.hpp"
 #include "macro_execution.hpp"
 #include "compilation_context.hpp"
+#include "node.hpp"
 
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
@@ -9,6 +10,15 @@
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/PassManager.h>
+#include <llvm/Support/CodeGen.h>
 
 #include <boost/variant.hpp>
 
@@ -16,6 +26,8 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include <unordered_map>
+#include <cstdint>
 #include <setjmp.h>
 
 using std::unique_ptr;
@@ -26,6 +38,8 @@ using std::move;
 using std::string;
 using std::vector;
 using std::size_t;
+using std::uint64_t;
+using std::unordered_map;
 
 using llvm::LLVMContext;
 using llvm::Function;
@@ -35,13 +49,137 @@ using llvm::EngineBuilder;
 using llvm::FunctionType;
 using llvm::IntegerType;
 using llvm::Type;
+using llvm::PointerType;
+using llvm::Value;
+using llvm::Argument;
+using llvm::BasicBlock;
+using llvm::Instruction;
+using llvm::CallInst;
+using llvm::LoadInst;
+using llvm::IRBuilder;
+using llvm::GlobalValue;
+using llvm::GlobalVariable;
+using llvm::ConstantInt;
+using llvm::Attribute;
+using llvm::InlineFunctionInfo;
+using llvm::InlineFunction;
+using llvm::dyn_cast;
+using llvm::FunctionPassManager;
+using llvm::DataLayoutPass;
+using llvm::Pass;
 
-macro_execution_environment create_macro_environment(llvm::LLVMContext& llvm_context)
+namespace
+{
+
+// continues in a new block if condition holds, branches to otherwise if not
+void require(IRBuilder<>& builder, Value* condition, BasicBlock* otherwise)
+{
+    BasicBlock* next = BasicBlock::Create(builder.getContext(), "", builder.GetInsertBlock()->getParent());
+    builder.CreateCondBr(condition, next, otherwise);
+    builder.SetInsertPoint(next);
+}
+
+Value* load_member(IRBuilder<>& builder, Value* n, size_t offset, Type* type)
+{
+    Value* address = builder.CreateConstGEP1_64(n, offset);
+    return builder.CreateLoad(builder.CreateBitCast(address, PointerType::getUnqual(type)));
+}
+
+// the passes of optimization_passes by name
+Pass* create_pass(const string& name)
+{
+    static const unordered_map<string, Pass* (*)()> passes =
+    {
+        {"mem2reg", []() -> Pass* { return llvm::createPromoteMemoryToRegisterPass(); }},
+        {"instcombine", []() -> Pass* { return llvm::createInstructionCombiningPass(); }},
+        {"early-cse", []() -> Pass* { return llvm::createEarlyCSEPass(); }},
+        {"simplifycfg", []() -> Pass* { return llvm::createCFGSimplificationPass(); }},
+        {"reassociate", []() -> Pass* { return llvm::createReassociatePass(); }},
+        {"gvn", []() -> Pass* { return llvm::createGVNPass(); }},
+        {"licm", []() -> Pass* { return llvm::createLICMPass(); }},
+        {"indvars", []() -> Pass* { return llvm::createIndVarSimplifyPass(); }},
+        {"loop-deletion", []() -> Pass* { return llvm::createLoopDeletionPass(); }},
+        {"dse", []() -> Pass* { return llvm::createDeadStoreEliminationPass(); }}
+    };
+    auto it = passes.find(name);
+    assert(it != passes.end());
+    return it->second();
+}
+
+// IR body for a runtime function, to be inlined into macros (see inline_node_accessors)
+// build_fast_path handles the common case and branches to the slow path (calling runtime_func) for everything else
+template<class Functor>
+Function* define_inline(Function* runtime_func, Module* module, Functor&& build_fast_path)
+{
+    LLVMContext& context = module->getContext();
+    Function* func = Function::Create(runtime_func->getFunctionType(), Function::InternalLinkage, runtime_func->getName() + "_inline", module);
+    func->addFnAttr(Attribute::AlwaysInline);
+    vector<Value*> args;
+    for(Argument& arg : func->getArgumentList())
+        args.push_back(&arg);
+
+    BasicBlock* entry = BasicBlock::Create(context, "entry", func);
+    BasicBlock* slow_path = BasicBlock::Create(context, "slow_path", func);
+    IRBuilder<> builder{slow_path};
+    builder.CreateRet(builder.CreateCall(runtime_func, args));
+
+    builder.SetInsertPoint(entry);
+    builder.CreateRet(build_fast_path(builder, args, slow_path));
+    if(slow_path->use_empty())
+        slow_path->eraseFromParent();
+    return func;
+}
+
+}
+
+void inline_node_accessors(Function& func)
+{
+    vector<CallInst*> calls;
+    for(BasicBlock& block : func)
+    {
+        for(Instruction& instruction : block)
+        {
+            CallInst* call = dyn_cast<CallInst>(&instruction);
+            if(!call)
+                continue;
+            Function* callee = call->getCalledFunction();
+            if(callee && !callee->isDeclaration() && callee->hasFnAttribute(Attribute::AlwaysInline))
+                calls.push_back(call);
+        }
+    }
+    for(CallInst* call : calls)
+    {
+        InlineFunctionInfo info;
+        InlineFunction(call, info);
+    }
+}
+
+vector<string> optimization_passes(optimization_level level)
+{
+    vector<string> passes;
+    if(level != optimization_level::NONE)
+        passes = {"mem2reg", "instcombine", "early-cse", "simplifycfg"};
+    if(level == optimization_level::O2)
+        passes.insert(passes.end(), {"reassociate", "gvn", "licm", "indvars", "loop-deletion", "dse", "instcombine", "simplifycfg"});
+    return passes;
+}
+
+macro_execution_environment create_macro_environment(llvm::LLVMContext& llvm_context, optimization_level level)
 {
     auto module_owner = make_unique<Module>("macro module", llvm_context);
-    ExecutionEngine* engine = EngineBuilder(module_owner.get()).create();
+    ExecutionEngine* engine = EngineBuilder(module_owner.get())
+        .setOptLevel(level == optimization_level::NONE ? llvm::CodeGenOpt::None
+            : level == optimization_level::O1 ? llvm::CodeGenOpt::Less : llvm::CodeGenOpt::Default)
+        .create();
     assert(engine);
     Module* module = module_owner.release();
+    module->setDataLayout(engine->getDataLayout());
+
+    FunctionPassManager* optimizer = new FunctionPassManager(module);
+    optimizer->add(new DataLayoutPass(module));
+    for(const string& pass : optimization_passes(level))
+        optimizer->add(create_pass(pass));
+    optimizer->doInitialization();
     
     Type* node = &llvm_node_type(llvm_context);
     Type* int64 = IntegerType::get(llvm_context, 64);
@@ -114,10 +252,96 @@ macro_execution_environment create_macro_environment(llvm::LLVMContext& llvm_con
     Function* to_node = Function::Create(sig_node_int64, Function::InternalLinkage, "macro_to_node", module);
     Function* call_macro = Function::Create(sig_node_int64_node, Function::InternalLinkage, "macro_call_macro", module);
 
+    // the hot accessors get IR bodies, so the common case doesn't call into the runtime:
+    // nodes are read directly unless an execution forwards nodes to copies (see forwarding_executions)
+    // the counter is shared by all threads and read with an atomic load, which the optimizer neither merges nor hoists,
+    // so every accessor call checks it again (the slow paths may write nodes, too, which keeps the node loads in place)
+    static_assert(sizeof(forwarding_executions) == sizeof(uint64_t), "forwarding_executions is read as int64");
+    GlobalVariable* forwarding = new GlobalVariable(*module, int64, false, GlobalValue::ExternalLinkage, nullptr, "macro_forwarding_executions");
+    engine->addGlobalMapping(forwarding, &forwarding_executions);
+
+    Type* type_int = IntegerType::get(llvm_context, 8 * sizeof(node_type));
+    Type* int8_ptr = PointerType::getUnqual(int8);
+    Type* children_ptr = PointerType::getUnqual(node);
+    auto type_is = [&](IRBuilder<>& builder, Value* n, node_type type)
+    {
+        Value* actual = load_member(builder, n, node_layout::type(), type_int);
+        return builder.CreateICmpEQ(actual, ConstantInt::get(type_int, static_cast<uint64_t>(type)));
+    };
+    auto not_forwarding = [&](IRBuilder<>& builder)
+    {
+        LoadInst* count = builder.CreateLoad(forwarding);
+        count->setAtomic(llvm::Monotonic);
+        count->setAlignment(alignof(uint64_t));
+        return builder.CreateICmpEQ(count, ConstantInt::get(int64, 0));
+    };
+    auto lit_length = [&](IRBuilder<>& builder, Value* lit)
+    {
+        Value* begin = load_member(builder, lit, node_layout::lit_begin(), int8_ptr);
+        Value* end = load_member(builder, lit, node_layout::lit_end(), int8_ptr);
+        return builder.CreatePtrDiff(end, begin);
+    };
+    auto list_length = [&](IRBuilder<>& builder, Value* list)
+    {
+        Value* begin = load_member(builder, list, node_layout::list_begin(), children_ptr);
+        Value* end = load_member(builder, list, node_layout::list_end(), children_ptr);
+        return builder.CreatePtrDiff(end, begin);
+    };
+    auto define_type_test = [&](Function* runtime_func, node_type type)
+    {
+        return define_inline(runtime_func, module, [&](IRBuilder<>& builder, const vector<Value*>& args, BasicBlock*)
+        {
+            return type_is(builder, args[0], type);
+        });
+    };
+
+    is_id = define_type_test(is_id, node_type::ID);
+    is_lit = define_type_test(is_lit, node_type::LITERAL);
+    is_ref = define_type_test(is_ref, node_type::REFERENCE);
+    is_list = define_type_test(is_list, node_type::LIST);
+    is_macro = define_type_test(is_macro, node_type::MACRO);
+    is_proc = define_type_test(is_proc, node_type::PROC);
+
+    lit_size = define_inline(lit_size, module, [&](IRBuilder<>& builder, const vector<Value*>& args, BasicBlock* slow_path)
+    {
+        require(builder, not_forwarding(builder), slow_path);
+        require(builder, type_is(builder, args[0], node_type::LITERAL), slow_path);
+        return lit_length(builder, args[0]);
+    });
+    lit_get = define_inline(lit_get, module, [&](IRBuilder<>& builder, const vector<Value*>& args, BasicBlock* slow_path)
+    {
+        require(builder, not_forwarding(builder), slow_path);
+        require(builder, type_is(builder, args[0], node_type::LITERAL), slow_path);
+        require(builder, builder.CreateICmpULT(args[1], lit_length(builder, args[0])), slow_path);
+        Value* begin = load_member(builder, args[0], node_layout::lit_begin(), int8_ptr);
+        return builder.CreateLoad(builder.CreateGEP(begin, args[1]));
+    });
+    list_size = define_inline(list_size, module, [&](IRBuilder<>& builder, const vector<Value*>& args, BasicBlock* slow_path)
+    {
+        require(builder, not_forwarding(builder), slow_path);
+        require(builder, type_is(builder, args[0], node_type::LIST), slow_path);
+        return list_length(builder, args[0]);
+    });
+    list_get = define_inline(list_get, module, [&](IRBuilder<>& builder, const vector<Value*>& args, BasicBlock* slow_path)
+    {
+        require(builder, not_forwarding(builder), slow_path);
+        require(builder, type_is(builder, args[0], node_type::LIST), slow_path);
+        require(builder, builder.CreateICmpULT(args[1], list_length(builder, args[0])), slow_path);
+        Value* begin = load_member(builder, args[0], node_layout::list_begin(), children_ptr);
+        return builder.CreateLoad(builder.CreateGEP(begin, args[1]));
+    });
+    ref_has_refered = define_inline(ref_has_refered, module, [&](IRBuilder<>& builder, const vector<Value*>& args, BasicBlock* slow_path)
+    {
+        require(builder, not_forwarding(builder), slow_path);
+        require(builder, type_is(builder, args[0], node_type::REFERENCE), slow_path);
+        return builder.CreateIsNotNull(load_member(builder, args[0], node_layout::ref_refered(), node));
+    });
+
     return macro_execution_environment
     {
         *module,
         *engine,
+        *optimizer,
 
         *is_id,
         *is_lit,
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <utility>
+#include <vector>
+#include <string>
 
 namespace llvm
 {
@@ -10,12 +12,22 @@ class Module;
 class Function;
 class LLVMContext;
 class ExecutionEngine;
+class FunctionPassManager;
 }
 
+// IR passes run on macros (and compile time procs) before code generation
+enum class optimization_level
+{
+    NONE,
+    O1, // register promotion and local cleanups
+    O2  // additionally redundancy elimination and loop optimizations
+};
+
 struct macro_execution_environment
 {
     llvm::Module& llvm_module;
     llvm::ExecutionEngine& llvm_engine;
+    llvm::FunctionPassManager& optimizer;
 
     llvm::Function& is_id;
     llvm::Function& is_lit;
@@ -49,7 +61,14 @@ struct macro_execution_environment
     llvm::Function& call_macro;
 };
 
-macro_execution_environment create_macro_environment(llvm::LLVMContext& llvm_context);
+// names of the passes the optimizer runs at level, in order (they are part of the keys of macro_code_cache)
+std::vector<std::string> optimization_passes(optimization_level level);
+
+macro_execution_environment create_macro_environment(llvm::LLVMContext& llvm_context, optimization_level level);
+
+// replaces the calls of accessors (like list_get) in func by their IR bodies
+// func has to be in the module of the environment
+void inline_node_accessors(llvm::Function& func);
 
 #endif
 
@@ -1,11 +1,15 @@
 #include "macro_execution.hpp"
+#include "macro_profile.hpp"
 #include "error/macro_execution_error.hpp"
 
 #include <llvm/IR/DerivedTypes.h>
 
 #include <setjmp.h>
+#include <unordered_set>
+#include <unordered_map>
 #include <limits>
 #include <cstdint>
+#include <cstring>
 #include <stddef.h>
 
 using llvm::LLVMContext;
@@ -15,19 +19,25 @@ using llvm::PointerType;
 
 using std::pair;
 using std::vector;
+using std::unordered_set;
+using std::unordered_map;
 using std::size_t;
 using std::unique_ptr;
 using std::move;
 using std::int8_t;
 using std::string;
 using std::numeric_limits;
+using std::atomic;
+using std::uint64_t;
+using std::uint8_t;
+using std::memcpy;
+using std::function;
 
 using boost::get;
 using boost::blank;
 
 using namespace macro_execution_error;
 
-pair<node&, dynamic_graph> exeucte_macro(macro_function* func, const node& arg);
 
 
 Type& llvm_node_type(LLVMContext& context)
@@ -35,18 +45,62 @@ Type& llvm_node_type(LLVMContext& context)
     return *PointerType::getUnqual(IntegerType::get(context, 8));
 }
 
+// the arguments of a macro are not copied, instead nodes the execution did not create are copied
+// when they are first modified (copy-on-write), accesses to the original are forwarded to the copy from then on
 struct execution_data_t
 {
     jmp_buf jmp_env;
+    // everything the execution creates, including the results of nested executions
+    // only the part the result leads to is kept when it returns
     dynamic_graph graph;
+    unordered_set<const node*> owned;
+    unordered_map<const node*, node*> copies;
 };
 
 thread_local vector<execution_data_t> execution_data;
 
-template<class T>
-bool is_type(void* node_ptr)
+atomic<size_t> forwarding_executions{0};
+
+namespace
+{
+
+template<class NodeType, class MemberType>
+size_t offset_of(const NodeType& n, const MemberType& member)
+{
+    return reinterpret_cast<const char*>(&member) - reinterpret_cast<const char*>(static_cast<const node*>(&n));
+}
+
+}
+
+size_t node_layout::type()
+{
+    id_node n{0};
+    return offset_of(n, n.nt_);
+}
+size_t node_layout::lit_begin()
+{
+    lit_node n{nullptr, nullptr};
+    return offset_of(n, n.begin_);
+}
+size_t node_layout::lit_end()
+{
+    lit_node n{nullptr, nullptr};
+    return offset_of(n, n.end_);
+}
+size_t node_layout::ref_refered()
+{
+    ref_node n{nullptr, nullptr, 0, nullptr};
+    return offset_of(n, n.refered_);
+}
+size_t node_layout::list_begin()
 {
-    return get<T>(reinterpret_cast<dynamic_graph::node_data*>(node_ptr)) != nullptr;
+    list_node n{nullptr, nullptr};
+    return offset_of(n, n.begin_);
+}
+size_t node_layout::list_end()
+{
+    list_node n{nullptr, nullptr};
+    return offset_of(n, n.end_);
 }
 
 node* as_node(node_ptr ptr)
@@ -59,59 +113,124 @@ node_ptr as_node_ptr(node* ptr)
 }
 
 
-template<class NodeType>
-struct get_data_impl;
-
-template<>
-struct get_data_impl<id_node>
+// the current version of n, nested executions see the modifications of the enclosing ones
+node* resolve(const node* n)
 {
-    static dynamic_graph::id_data& get_data(node_ptr ptr)
+    for(execution_data_t& data : execution_data)
     {
-        return *reinterpret_cast<id_node*>(ptr);
+        if(data.copies.empty())
+            continue;
+        auto it = data.copies.find(n);
+        if(it != data.copies.end())
+            n = it->second;
     }
-};
-template<>
-struct get_data_impl<lit_node>
+    return const_cast<node*>(n);
+}
+node* resolve(node_ptr ptr)
+{
+    return resolve(as_node(ptr));
+}
+
+void pop_execution_data()
 {
-    static dynamic_graph::lit_data& get_data(node_ptr ptr)
+    if(!execution_data.back().copies.empty())
+        --forwarding_executions;
+    execution_data.pop_back();
+}
+
+node_ptr owned(node& n)
+{
+    execution_data.back().owned.insert(&n);
+    return as_node_ptr(&n);
+}
+
+// n has to be resolved
+node& writable(node& n)
+{
+    execution_data_t& data = execution_data.back();
+    if(data.owned.count(&n))
+        return n;
+    if(data.copies.empty())
+        ++forwarding_executions;
+    macro_copy_scope copy_scope;
+    node& copy = data.graph.copy(n);
+    data.owned.insert(&copy);
+    data.copies.insert({&n, &copy});
+    return copy;
+}
+
+template<class NodeType>
+NodeType& get_data(node_ptr ptr)
+{
+    return resolve(ptr)->cast_else<NodeType>([&]
     {
-        static_assert(offsetof(dynamic_graph::lit_data, first) == 0, "");
-        return *reinterpret_cast<dynamic_graph::lit_data*>(ptr);
-    }
-};
-template<>
-struct get_data_impl<ref_node>
+        longjmp(execution_data.back().jmp_env, id("invalid_node_type"));
+    });
+}
+template<class NodeType>
+NodeType& get_writable_data(node_ptr ptr)
+{
+    return writable(get_data<NodeType>(ptr)).template cast<NodeType>();
+}
+
+// after copy-on-write, the result may still lead to originals of copied nodes
+// every node on such a path is replaced by an updated copy, too, so the result sees all modifications
+node& redirect_to_copies(node& result)
 {
-    static dynamic_graph::ref_data& get_data(node_ptr ptr)
+    vector<node*> node_stack{&result};
+    unordered_set<const node*> visited;
+    unordered_map<const node*, vector<node*>> parents;
+    vector<node*> changed;
+
+    auto visit_edge = [&](node* parent, const node* child)
+    {
+        node* current = resolve(child);
+        if(current != child)
+            changed.push_back(parent);
+        parents[current].push_back(parent);
+        node_stack.push_back(current);
+    };
+    while(!node_stack.empty())
     {
-        static_assert(offsetof(dynamic_graph::ref_data, first) == 0, "");
-        return *reinterpret_cast<dynamic_graph::ref_data*>(ptr);
+        node* n = node_stack.back();
+        node_stack.pop_back();
+        if(!visited.insert(n).second)
+            continue;
+        if(n->is<list_node>())
+        {
+            for(node& child : n->cast<list_node>())
+                visit_edge(n, &child);
+        }
+        else if(n->is<ref_node>() && n->cast<ref_node>().refered())
+            visit_edge(n, n->cast<ref_node>().refered());
     }
-};
-template<>
-struct get_data_impl<list_node>
-{
-    static dynamic_graph::list_data& get_data(node_ptr ptr)
+
+    unordered_set<node*> dirty;
+    while(!changed.empty())
     {
-        static_assert(offsetof(dynamic_graph::list_data, first) == 0, "");
-        return *reinterpret_cast<dynamic_graph::list_data*>(ptr);
+        node* n = changed.back();
+        changed.pop_back();
+        if(dirty.insert(n).second)
+            changed.insert(changed.end(), parents[n].begin(), parents[n].end());
     }
-};
-template<>
-struct get_data_impl<macro_node>
-{
-    static macro_node& get_data(node_ptr ptr)
+    for(node* n : dirty)
+        writable(*n);
+    for(node* n : dirty)
     {
-        return *reinterpret_cast<macro_node*>(ptr);
+        node& current = *resolve(n);
+        if(current.is<list_node>())
+        {
+            list_node& list = current.cast<list_node>();
+            for(size_t i = 0; i != list.size(); ++i)
+                execution_data.back().graph.set_child(list, i, *resolve(&list[i]));
+        }
+        else
+        {
+            ref_node& ref = current.cast<ref_node>();
+            ref.refered(resolve(ref.refered()));
+        }
     }
-};
-
-template<class NodeType>
-decltype(auto) get_data(node_ptr ptr)
-{
-    if(!as_node(ptr)->is<NodeType>())
-        longjmp(execution_data.back().jmp_env, id("invalid_node_type"));
-    return get_data_impl<NodeType>::get_data(ptr);
+    return *resolve(&result);
 }
 
 extern "C"
@@ -140,129 +259,113 @@ bool macro_is_macro(node_ptr n)
 
 node_ptr macro_lit_create()
 {
-    return as_node_ptr(&execution_data.back().graph.create_lit(""));
+    return owned(execution_data.back().graph.create_lit(""));
 }
 uint64_t macro_lit_size(node_ptr n)
 {
-    return get_data<lit_node>(n).second.size();
+    const lit_node& lit = get_data<lit_node>(n);
+    return lit.end() - lit.begin();
 }
 int8_t macro_lit_get(node_ptr n, uint64_t index) noexcept
 {
-    string& str = get_data<lit_node>(n).second;
-    if(index >= str.size())
+    const lit_node& lit = get_data<lit_node>(n);
+    if(index >= static_cast<uint64_t>(lit.end() - lit.begin()))
         longjmp(execution_data.back().jmp_env, id("index_out_of_bounds"));
-    return str[index];
+    return lit.begin()[index];
 }
 void macro_lit_set(node_ptr n, uint64_t index, int8_t c)
 {
-    string& str = get_data<lit_node>(n).second;
-    if(index >= str.size())
+    lit_node& lit = get_writable_data<lit_node>(n);
+    if(index >= static_cast<uint64_t>(lit.end() - lit.begin()))
         longjmp(execution_data.back().jmp_env, id("index_out_of_bounds"));
-    str[index] = c;
+    execution_data.back().graph.set_char(lit, index, c);
 }
 void macro_lit_push(node_ptr n, int8_t c)
 {
-    auto& lit_data = get_data<lit_node>(n);
-    lit_data.second.push_back(c);
-    char* str_begin = &lit_data.second[0];
-    char* str_end = str_begin + lit_data.second.size();
-    lit_data.first = lit_node{str_begin, str_end};
+    execution_data.back().graph.push_back(get_writable_data<lit_node>(n), c);
 }
 void macro_lit_pop(node_ptr n)
 {
-    auto& lit_data = get_data<lit_node>(n);
-    lit_data.second.pop_back();
-    char* str_begin = &lit_data.second[0];
-    char* str_end = str_begin + lit_data.second.size();
-    lit_data.first = lit_node{str_begin, str_end};
+    lit_node& lit = get_writable_data<lit_node>(n);
+    if(lit.begin() == lit.end())
+        longjmp(execution_data.back().jmp_env, id("index_out_of_bounds"));
+    execution_data.back().graph.pop_back(lit);
 }
 
 node_ptr macro_list_create()
 {
-    return as_node_ptr(&execution_data.back().graph.create_list({}));
+    return owned(execution_data.back().graph.create_list({}));
 }
 uint64_t macro_list_size(node_ptr n)
 {
-    return get_data<list_node>(n).second.size();
+    return get_data<list_node>(n).size();
 }
 node_ptr macro_list_get(node_ptr n, uint64_t index) noexcept
 {
-    vector<node*> children = get_data<list_node>(n).second;
-    if(index >= children.size())
+    list_node& list = get_data<list_node>(n);
+    if(index >= list.size())
         longjmp(execution_data.back().jmp_env, id("index_out_of_bounds"));
-    return as_node_ptr(children[index]);
+    return as_node_ptr(resolve(&list[index]));
 }
 void macro_list_set(node_ptr n, uint64_t index, node_ptr to_set)
 {
-    vector<node*>& children = get_data<list_node>(n).second;
-    if(index >= children.size())
+    list_node& list = get_writable_data<list_node>(n);
+    if(index >= list.size())
         longjmp(execution_data.back().jmp_env, id("index_out_of_bounds"));
-    children[index] = as_node(to_set);
+    execution_data.back().graph.set_child(list, index, *resolve(to_set));
 }
 void macro_list_push(node_ptr n, node_ptr to_push)
 {
-    auto& list_data = get_data<list_node>(n);
-    list_data.second.push_back(as_node(to_push));
-    node** children_begin = &list_data.second[0];
-    node** children_end = children_begin + list_data.second.size();
-    list_data.first = list_node{children_begin, children_end};
+    execution_data.back().graph.push_back(get_writable_data<list_node>(n), *resolve(to_push));
 }
 void macro_list_pop(node_ptr n)
 {
-    auto& list_data = get_data<list_node>(n);
-    list_data.second.pop_back();
-    node** children_begin = &list_data.second[0];
-    node** children_end = children_begin + list_data.second.size();
-    list_data.first = list_node{children_begin, children_end};
+    list_node& list = get_writable_data<list_node>(n);
+    if(list.empty())
+        longjmp(execution_data.back().jmp_env, id("index_out_of_bounds"));
+    execution_data.back().graph.pop_back(list);
 }
 
 node_ptr macro_ref_create()
 {
-    return as_node_ptr(&execution_data.back().graph.create_ref(""));
+    return owned(execution_data.back().graph.create_ref(""));
 }
 node_ptr macro_ref_get_identifier(node_ptr n)
 {
-    auto& ref_data = get_data<ref_node>(n);
-    lit_node& lit = execution_data.back().graph.create_lit(save<string>(ref_data.first.identifier()));
-    return as_node_ptr(&lit);
+    const ref_node& ref = get_data<ref_node>(n);
+    return owned(execution_data.back().graph.create_lit(save<string>(ref.identifier())));
 }
 void macro_ref_set_identifier(node_ptr ref, node_ptr lit)
 {
-    auto& ref_data = get_data<ref_node>(ref);
-    auto& lit_data = get_data<lit_node>(lit);
-    ref_data.second = save<string>(lit_data.first);
-    char* str_begin = &ref_data.second[0];
-    char* str_end = str_begin + ref_data.second.size();
-    ref_data.first = ref_node{str_begin, str_end, const_cast<node*>(ref_data.first.refered())};
+    const lit_node& identifier = get_data<lit_node>(lit);
+    execution_data.back().graph.set_identifier(get_writable_data<ref_node>(ref), identifier.begin(), identifier.end());
 }
 bool macro_ref_has_refered(node_ptr ref)
 {
-    auto& ref_data = get_data<ref_node>(ref);
-    return ref_data.first.refered() != nullptr;
+    return get_data<ref_node>(ref).refered() != nullptr;
 }
 node_ptr macro_ref_get_refered(node_ptr ref)
 {
-    auto& ref_data = get_data<ref_node>(ref);
-    if(ref_data.first.refered() == nullptr)
+    const ref_node& r = get_data<ref_node>(ref);
+    if(r.refered() == nullptr)
         longjmp(execution_data.back().jmp_env, id("ref_null"));
-    return as_node_ptr(const_cast<node*>(ref_data.first.refered()));
+    return as_node_ptr(const_cast<node*>(r.refered()));
 }
 void macro_ref_set_refered(node_ptr ref, node_ptr new_refered)
 {
-    auto& ref_data = get_data<ref_node>(ref);
-    ref_data.first.refered(as_node(new_refered));
+    get_writable_data<ref_node>(ref).refered(resolve(new_refered));
 }
 
 node_ptr macro_to_node(size_t ptr_as_int)
 {
     node* ptr = reinterpret_cast<node*>(ptr_as_int);
-    return as_node_ptr(&execution_data.back().graph.add(*ptr));
+    return owned(execution_data.back().graph.add(*ptr));
 }
 
 node_ptr macro_call_macro(size_t ptr_as_int, node_ptr macro_arg)
 {
     const macro_node& macro = *reinterpret_cast<macro_node*>(ptr_as_int);
-    const list_node& arg = as_node(macro_arg)->cast_else<list_node>([&]
+    const list_node& arg = resolve(macro_arg)->cast_else<list_node>([&]
     {
         longjmp(execution_data.back().jmp_env, id("call_macro_arg_not_a_list"));
     });
@@ -276,37 +379,192 @@ node_ptr macro_call_macro(size_t ptr_as_int, node_ptr macro_arg)
 }
 
 
-pair<node&, dynamic_graph> execute_macro(macro_function* func, const node& arg)
+namespace
 {
-    auto p = dynamic_graph::clone(arg);
-    execution_data.emplace_back();
-    execution_data.back().graph = move(p.second);
-    node& macro_arg = p.first;
 
-    if(int error_id = setjmp(execution_data.back().jmp_env))
+node_ptr ptr_arg(uint64_t arg)
+{
+    return reinterpret_cast<node_ptr>(arg);
+}
+uint64_t ptr_result(node_ptr ptr)
+{
+    return reinterpret_cast<uint64_t>(ptr);
+}
+
+// the data of an execution, popped when it returns, raises an error, or an exception
+// (thrown by a native macro it calls through macro_call_macro) passes through
+class execution_scope
+{
+public:
+    execution_scope()
     {
-        execution_data.pop_back();
-        throw compile_exception(error_kind::MACRO_EXECUTION, error_id, blank());
+        execution_data.emplace_back();
+    }
+    execution_scope(const execution_scope&) = delete;
+    ~execution_scope()
+    {
+        pop_execution_data();
     }
 
-    node* result = as_node(func(as_node_ptr(&macro_arg)));
-
-    dynamic_graph graph = move(execution_data.back().graph);
-    execution_data.pop_back();
-    return {*result, move(graph)};
-}
+    execution_scope& operator=(const execution_scope&) = delete;
+};
 
-pair<node&, dynamic_graph> execute_macro(macro_function* func, node_range args)
+template<class MacroFunction>
+pair<node&, dynamic_graph> execute(MacroFunction& func, node_range args)
 {
-    auto node_pointers = save<vector<node*>>(mapped(args,
+    execution_scope scope;
+    auto arg_pointers = save<vector<node*>>(mapped(args,
     [&](node& n) -> node*
     {
         return &n;
     }));
-    node** children_begin = &node_pointers[0];
-    node** children_end = children_begin + node_pointers.size();
-    list_node top_level_list{children_begin, children_end};
+    node_ptr macro_arg = owned(execution_data.back().graph.create_list(arg_pointers));
+
+    if(int error_id = setjmp(execution_data.back().jmp_env))
+        throw compile_exception(error_kind::MACRO_EXECUTION, error_id, blank());
+
+    node* result = resolve(func(macro_arg));
+    if(!execution_data.back().copies.empty())
+    {
+        macro_copy_scope copy_scope;
+        result = &redirect_to_copies(*result);
+    }
+    if(macro_profiling_enabled())
+        profile_execution(execution_data.back().owned.size() - 1, execution_data.size());
 
-    return execute_macro(func, top_level_list);
+    // temporaries the result doesn't lead to are released together with the graph of the execution
+    auto p = execution_data.back().graph.extract(*result);
+    return {p.first, move(p.second)};
 }
 
+}
+
+runtime_function* find_runtime_function(const string& name)
+{
+    // int8 arguments are passed zero-extended, results have to be, too
+    static const unordered_map<string, runtime_function*> functions =
+    {
+        {"macro_is_id", [](const uint64_t* args) -> uint64_t { return macro_is_id(ptr_arg(args[0])); }},
+        {"macro_is_lit", [](const uint64_t* args) -> uint64_t { return macro_is_lit(ptr_arg(args[0])); }},
+        {"macro_is_ref", [](const uint64_t* args) -> uint64_t { return macro_is_ref(ptr_arg(args[0])); }},
+        {"macro_is_list", [](const uint64_t* args) -> uint64_t { return macro_is_list(ptr_arg(args[0])); }},
+        {"macro_is_macro", [](const uint64_t* args) -> uint64_t { return macro_is_macro(ptr_arg(args[0])); }},
+
+        {"macro_lit_create", [](const uint64_t*) -> uint64_t { return ptr_result(macro_lit_create()); }},
+        {"macro_lit_size", [](const uint64_t* args) -> uint64_t { return macro_lit_size(ptr_arg(args[0])); }},
+        {"macro_lit_get", [](const uint64_t* args) -> uint64_t
+        {
+            return static_cast<uint8_t>(macro_lit_get(ptr_arg(args[0]), args[1]));
+        }},
+        {"macro_lit_set", [](const uint64_t* args) -> uint64_t
+        {
+            macro_lit_set(ptr_arg(args[0]), args[1], static_cast<int8_t>(args[2]));
+            return 0;
+        }},
+        {"macro_lit_push", [](const uint64_t* args) -> uint64_t
+        {
+            macro_lit_push(ptr_arg(args[0]), static_cast<int8_t>(args[1]));
+            return 0;
+        }},
+        {"macro_lit_pop", [](const uint64_t* args) -> uint64_t
+        {
+            macro_lit_pop(ptr_arg(args[0]));
+            return 0;
+        }},
+
+        {"macro_list_create", [](const uint64_t*) -> uint64_t { return ptr_result(macro_list_create()); }},
+        {"macro_list_size", [](const uint64_t* args) -> uint64_t { return macro_list_size(ptr_arg(args[0])); }},
+        {"macro_list_get", [](const uint64_t* args) -> uint64_t
+        {
+            return ptr_result(macro_list_get(ptr_arg(args[0]), args[1]));
+        }},
+        {"macro_list_set", [](const uint64_t* args) -> uint64_t
+        {
+            macro_list_set(ptr_arg(args[0]), args[1], ptr_arg(args[2]));
+            return 0;
+        }},
+        {"macro_list_push", [](const uint64_t* args) -> uint64_t
+        {
+            macro_list_push(ptr_arg(args[0]), ptr_arg(args[1]));
+            return 0;
+        }},
+        {"macro_list_pop", [](const uint64_t* args) -> uint64_t
+        {
+            macro_list_pop(ptr_arg(args[0]));
+            return 0;
+        }},
+
+        {"macro_ref_create", [](const uint64_t*) -> uint64_t { return ptr_result(macro_ref_create()); }},
+        {"macro_ref_get_identifier", [](const uint64_t* args) -> uint64_t
+        {
+            return ptr_result(macro_ref_get_identifier(ptr_arg(args[0])));
+        }},
+        {"macro_ref_set_identifier", [](const uint64_t* args) -> uint64_t
+        {
+            macro_ref_set_identifier(ptr_arg(args[0]), ptr_arg(args[1]));
+            return 0;
+        }},
+        {"macro_ref_has_refered", [](const uint64_t* args) -> uint64_t
+        {
+            return macro_ref_has_refered(ptr_arg(args[0]));
+        }},
+        {"macro_ref_get_refered", [](const uint64_t* args) -> uint64_t
+        {
+            return ptr_result(macro_ref_get_refered(ptr_arg(args[0])));
+        }},
+        {"macro_ref_set_refered", [](const uint64_t* args) -> uint64_t
+        {
+            macro_ref_set_refered(ptr_arg(args[0]), ptr_arg(args[1]));
+            return 0;
+        }},
+
+        {"macro_to_node", [](const uint64_t* args) -> uint64_t { return ptr_result(macro_to_node(args[0])); }},
+        {"macro_call_macro", [](const uint64_t* args) -> uint64_t
+        {
+            return ptr_result(macro_call_macro(args[0], ptr_arg(args[1])));
+        }}
+    };
+    auto it = functions.find(name);
+    if(it == functions.end())
+        return nullptr;
+    return it->second;
+}
+
+int call_runtime_function(runtime_function* func, const uint64_t* args, uint64_t& result)
+{
+    // the runtime functions jump to the jmp_env of the current execution on errors,
+    // it is redirected here while func runs (nested executions have their own)
+    jmp_buf saved;
+    memcpy(saved, execution_data.back().jmp_env, sizeof(jmp_buf));
+    if(int error_id = setjmp(execution_data.back().jmp_env))
+    {
+        memcpy(execution_data.back().jmp_env, saved, sizeof(jmp_buf));
+        return error_id;
+    }
+    try
+    {
+        result = func(args);
+    }
+    catch(...)
+    {
+        // from a native macro called through macro_call_macro, the enclosing execution is still running
+        memcpy(execution_data.back().jmp_env, saved, sizeof(jmp_buf));
+        throw;
+    }
+    memcpy(execution_data.back().jmp_env, saved, sizeof(jmp_buf));
+    return 0;
+}
+
+void raise_macro_error(int error_id)
+{
+    longjmp(execution_data.back().jmp_env, error_id);
+}
+
+pair<node&, dynamic_graph> execute_macro(macro_function* func, node_range args)
+{
+    return execute(func, args);
+}
+pair<node&, dynamic_graph> execute_macro(const function<node_ptr (node_ptr)>& func, node_range args)
+{
+    return execute(func, args);
+}
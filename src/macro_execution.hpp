@@ -4,13 +4,44 @@
 #include "node.hpp"
 
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 #include <vector>
+#include <atomic>
+#include <string>
+#include <functional>
 
-typedef uint8_t* node_ptr;
-typedef node_ptr macro_function(node_ptr);
-
+// args are not copied, the result may refer to them
+// (nodes the macro modifies are copied first, args themselves don't change)
 std::pair<node&, dynamic_graph> execute_macro(macro_function* func, node_range args);
+// same for macros that are not compiled (see macro_interpreter.hpp)
+std::pair<node&, dynamic_graph> execute_macro(const std::function<node_ptr (node_ptr)>& func, node_range args);
+
+// the runtime functions called by macros, with arguments and result passed as 64 bit integers
+typedef std::uint64_t runtime_function(const std::uint64_t* args);
+// nullptr if there is no runtime function with the (symbol) name
+runtime_function* find_runtime_function(const std::string& name);
+// returns the id of the error if func fails (0 otherwise), instead of jumping out of the caller
+// only valid during a macro execution
+int call_runtime_function(runtime_function* func, const std::uint64_t* args, std::uint64_t& result);
+// fails the current macro execution, like a failing runtime function
+// there must not be objects with destructors on the stack up to the execute_macro call
+[[noreturn]] void raise_macro_error(int error_id);
+
+// number of running executions that have copied a node (on any thread)
+// while it is 0, nodes can be read directly instead of through the runtime functions
+extern std::atomic<std::size_t> forwarding_executions;
+
+// offsets (in bytes) of the node members read by the accessors in the macro environment
+struct node_layout
+{
+    static std::size_t type();
+    static std::size_t lit_begin();
+    static std::size_t lit_end();
+    static std::size_t ref_refered();
+    static std::size_t list_begin();
+    static std::size_t list_end();
+};
 
 namespace llvm
 {
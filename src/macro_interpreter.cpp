@@ -0,0 +1,626 @@
+#include "macro_interpreter.hpp"
+#include "macro_environment.hpp"
+#include "arena.hpp"
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/GetElementPtrTypeIterator.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+
+using std::unique_ptr;
+using std::vector;
+using std::string;
+using std::size_t;
+using std::uint64_t;
+using std::int64_t;
+using std::unordered_map;
+using std::memcpy;
+using std::copy;
+using std::find;
+using std::move;
+
+using llvm::Function;
+using llvm::BasicBlock;
+using llvm::Instruction;
+using llvm::Value;
+using llvm::Constant;
+using llvm::ConstantInt;
+using llvm::ConstantExpr;
+using llvm::ConstantPointerNull;
+using llvm::UndefValue;
+using llvm::GlobalVariable;
+using llvm::Type;
+using llvm::StructType;
+using llvm::SequentialType;
+using llvm::DataLayout;
+using llvm::CmpInst;
+using llvm::ICmpInst;
+using llvm::PHINode;
+using llvm::BranchInst;
+using llvm::SwitchInst;
+using llvm::ReturnInst;
+using llvm::CallInst;
+using llvm::AllocaInst;
+using llvm::StoreInst;
+using llvm::ValueToValueMapTy;
+using llvm::CloneFunction;
+using llvm::gep_type_begin;
+using llvm::gep_type_end;
+using llvm::dyn_cast;
+using llvm::cast;
+using llvm::isa;
+
+// values are held in 64 bit registers, integers zero-extended to 64 bits
+// memory is accessed with memcpy of the low bytes, which assumes a little-endian host
+static_assert(sizeof(void*) == sizeof(uint64_t), "pointers are held in 64 bit registers");
+
+struct macro_interpreter::operation
+{
+    unsigned opcode;
+    unsigned result;            // slot of the result (instructions without one get a slot, too)
+    unsigned bits = 0;          // of the result
+    unsigned operand_bits = 0;  // of the first operand
+    uint64_t constant = 0;      // predicate (icmp), size (alloca, load, store), constant offset (getelementptr)
+    std::vector<unsigned> operands;     // slots, the incoming values of phis
+    std::vector<unsigned> blocks;       // successors of branches and switches, incoming blocks of phis
+    std::vector<uint64_t> constants;    // case values of switches, scales of the variable indices of getelementptr
+    std::vector<unsigned> widths;       // bits of the variable indices of getelementptr
+    runtime_function* runtime = nullptr;
+    const interpreted_function* callee = nullptr;
+};
+
+struct macro_interpreter::block
+{
+    std::vector<operation> phis;
+    std::vector<operation> body;
+    operation terminator;
+};
+
+struct macro_interpreter::interpreted_function
+{
+    // the first slots are the arguments, slots of constants are initialized with their values
+    std::vector<uint64_t> initial_registers;
+    unsigned arg_count = 0;
+    // the entry block is first
+    std::vector<block> blocks;
+};
+
+namespace
+{
+
+uint64_t truncate(uint64_t value, unsigned bits)
+{
+    return bits >= 64 ? value : value & ((uint64_t{1} << bits) - 1);
+}
+int64_t sign_extend(uint64_t value, unsigned bits)
+{
+    return bits >= 64 ? static_cast<int64_t>(value) : static_cast<int64_t>(value << (64 - bits)) >> (64 - bits);
+}
+
+// 0 if values of the type can't be held in a register
+unsigned bit_width(const Type* type)
+{
+    if(type->isPointerTy())
+        return 64;
+    if(type->isIntegerTy() && type->getIntegerBitWidth() <= 64)
+        return type->getIntegerBitWidth();
+    return 0;
+}
+
+bool ends_with(const string& str, const string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+macro_interpreter::macro_interpreter(macro_execution_environment& env)
+  : env_(env)
+{}
+macro_interpreter::~macro_interpreter()
+{}
+
+unique_ptr<macro_interpreter> macro_interpreter::create(const Function& func, macro_execution_environment& env)
+{
+    unique_ptr<macro_interpreter> interpreter{new macro_interpreter{env}};
+    ValueToValueMapTy vtvm;
+    interpreter->macro_.reset(CloneFunction(&func, vtvm, false));
+    interpreter->interpreted_macro_ = interpreter->prepare(*interpreter->macro_);
+    if(!interpreter->interpreted_macro_)
+        return nullptr;
+    return interpreter;
+}
+
+const macro_interpreter::interpreted_function* macro_interpreter::prepare(const Function& func)
+{
+    auto it = functions_.find(&func);
+    if(it != functions_.end())
+        return it->second.get();
+
+    // inserted before decoding, so recursive calls find it
+    interpreted_function& result = *functions_.emplace(&func, unique_ptr<interpreted_function>{new interpreted_function}).first->second;
+    if(func.isDeclaration() || func.isVarArg() || !decode(func, result))
+        return nullptr;
+    return &result;
+}
+
+bool macro_interpreter::constant_value(const Constant& constant, uint64_t& value)
+{
+    if(const ConstantInt* integer = dyn_cast<ConstantInt>(&constant))
+    {
+        if(bit_width(integer->getType()) == 0)
+            return false;
+        value = integer->getZExtValue();
+        return true;
+    }
+    if(isa<ConstantPointerNull>(&constant) || isa<UndefValue>(&constant))
+    {
+        value = 0;
+        return true;
+    }
+    if(const GlobalVariable* global = dyn_cast<GlobalVariable>(&constant))
+    {
+        // like macro_forwarding_executions, mapped to a variable of the compiler
+        value = reinterpret_cast<uint64_t>(env_.llvm_engine.getPointerToGlobal(global));
+        return value != 0;
+    }
+    const ConstantExpr* expr = dyn_cast<ConstantExpr>(&constant);
+    if(!expr)
+        return false;
+    unsigned bits = bit_width(expr->getType());
+    if(bits == 0 || !constant_value(*expr->getOperand(0), value))
+        return false;
+    switch(expr->getOpcode())
+    {
+    case Instruction::BitCast:
+    case Instruction::PtrToInt:
+    case Instruction::IntToPtr:
+    case Instruction::Trunc:
+    case Instruction::ZExt:
+        value = truncate(value, bits);
+        return true;
+    case Instruction::GetElementPtr:
+    {
+        const DataLayout& layout = *env_.llvm_module.getDataLayout();
+        for(auto it = gep_type_begin(expr), end = gep_type_end(expr); it != end; ++it)
+        {
+            const ConstantInt* index = dyn_cast<ConstantInt>(it.getOperand());
+            if(!index)
+                return false;
+            if(StructType* struct_type = dyn_cast<StructType>(*it))
+                value += layout.getStructLayout(struct_type)->getElementOffset(index->getZExtValue());
+            else
+                value += layout.getTypeAllocSize(cast<SequentialType>(*it)->getElementType()) * index->getSExtValue();
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool macro_interpreter::decode(const Function& func, interpreted_function& result)
+{
+    const DataLayout& layout = *env_.llvm_module.getDataLayout();
+    unordered_map<const Value*, unsigned> slots;
+    unordered_map<const BasicBlock*, unsigned> block_indices;
+
+    // every value gets its slot first, phis may use values defined later
+    for(auto arg = func.arg_begin(); arg != func.arg_end(); ++arg)
+    {
+        if(bit_width(arg->getType()) == 0)
+            return false;
+        slots.insert({&*arg, static_cast<unsigned>(slots.size())});
+    }
+    result.arg_count = slots.size();
+    for(const BasicBlock& b : func)
+    {
+        block_indices.insert({&b, static_cast<unsigned>(block_indices.size())});
+        for(const Instruction& instruction : b)
+            slots.insert({&instruction, static_cast<unsigned>(slots.size())});
+    }
+    result.initial_registers.resize(slots.size(), 0);
+
+    auto operand = [&](const Value* value, vector<unsigned>& operands)
+    {
+        auto it = slots.find(value);
+        if(it == slots.end())
+        {
+            const Constant* constant = dyn_cast<Constant>(value);
+            uint64_t constant_result;
+            if(!constant || !constant_value(*constant, constant_result))
+                return false;
+            it = slots.insert({value, static_cast<unsigned>(slots.size())}).first;
+            result.initial_registers.push_back(constant_result);
+        }
+        operands.push_back(it->second);
+        return true;
+    };
+    auto operands = [&](const Instruction& instruction, operation& op)
+    {
+        for(unsigned i = 0; i != instruction.getNumOperands(); ++i)
+        {
+            if(!operand(instruction.getOperand(i), op.operands))
+                return false;
+        }
+        return true;
+    };
+
+    for(const BasicBlock& b : func)
+    {
+        block decoded;
+        for(const Instruction& instruction : b)
+        {
+            operation op;
+            op.opcode = instruction.getOpcode();
+            op.result = slots.at(&instruction);
+            if(!instruction.getType()->isVoidTy())
+            {
+                op.bits = bit_width(instruction.getType());
+                if(op.bits == 0)
+                    return false;
+            }
+            if(instruction.getNumOperands() != 0)
+                op.operand_bits = bit_width(instruction.getOperand(0)->getType());
+
+            switch(op.opcode)
+            {
+            case Instruction::Add:
+            case Instruction::Sub:
+            case Instruction::Mul:
+            case Instruction::UDiv:
+            case Instruction::SDiv:
+            case Instruction::URem:
+            case Instruction::SRem:
+            case Instruction::And:
+            case Instruction::Or:
+            case Instruction::Xor:
+            case Instruction::Shl:
+            case Instruction::LShr:
+            case Instruction::AShr:
+            case Instruction::Select:
+            case Instruction::Trunc:
+            case Instruction::ZExt:
+            case Instruction::SExt:
+            case Instruction::BitCast:
+            case Instruction::PtrToInt:
+            case Instruction::IntToPtr:
+                if(op.operand_bits == 0 || !operands(instruction, op))
+                    return false;
+                break;
+            case Instruction::ICmp:
+                op.constant = cast<ICmpInst>(instruction).getPredicate();
+                if(op.operand_bits == 0 || !operands(instruction, op))
+                    return false;
+                break;
+            case Instruction::Alloca:
+            {
+                const AllocaInst& alloca = cast<AllocaInst>(instruction);
+                if(alloca.isArrayAllocation())
+                    return false;
+                op.constant = layout.getTypeAllocSize(alloca.getAllocatedType());
+                break;
+            }
+            case Instruction::Load:
+                op.constant = layout.getTypeStoreSize(instruction.getType());
+                if(!operands(instruction, op))
+                    return false;
+                break;
+            case Instruction::Store:
+            {
+                const StoreInst& store = cast<StoreInst>(instruction);
+                op.constant = layout.getTypeStoreSize(store.getValueOperand()->getType());
+                if(op.operand_bits == 0 || !operands(instruction, op))
+                    return false;
+                break;
+            }
+            case Instruction::GetElementPtr:
+            {
+                if(!operand(instruction.getOperand(0), op.operands))
+                    return false;
+                for(auto it = gep_type_begin(instruction), end = gep_type_end(instruction); it != end; ++it)
+                {
+                    const Value* index = it.getOperand();
+                    const ConstantInt* constant_index = dyn_cast<ConstantInt>(index);
+                    if(StructType* struct_type = dyn_cast<StructType>(*it))
+                        op.constant += layout.getStructLayout(struct_type)->getElementOffset(constant_index->getZExtValue());
+                    else
+                    {
+                        uint64_t scale = layout.getTypeAllocSize(cast<SequentialType>(*it)->getElementType());
+                        if(constant_index)
+                            op.constant += scale * constant_index->getSExtValue();
+                        else
+                        {
+                            unsigned width = bit_width(index->getType());
+                            if(width == 0 || !operand(index, op.operands))
+                                return false;
+                            op.constants.push_back(scale);
+                            op.widths.push_back(width);
+                        }
+                    }
+                }
+                break;
+            }
+            case Instruction::PHI:
+            {
+                const PHINode& phi = cast<PHINode>(instruction);
+                for(unsigned i = 0; i != phi.getNumIncomingValues(); ++i)
+                {
+                    if(!operand(phi.getIncomingValue(i), op.operands))
+                        return false;
+                    op.blocks.push_back(block_indices.at(phi.getIncomingBlock(i)));
+                }
+                break;
+            }
+            case Instruction::Br:
+            {
+                const BranchInst& branch = cast<BranchInst>(instruction);
+                if(branch.isConditional() && !operand(branch.getCondition(), op.operands))
+                    return false;
+                for(unsigned i = 0; i != branch.getNumSuccessors(); ++i)
+                    op.blocks.push_back(block_indices.at(branch.getSuccessor(i)));
+                break;
+            }
+            case Instruction::Switch:
+            {
+                const SwitchInst& sw = cast<SwitchInst>(instruction);
+                if(op.operand_bits == 0 || !operand(sw.getCondition(), op.operands))
+                    return false;
+                op.blocks.push_back(block_indices.at(sw.getDefaultDest()));
+                for(auto c = sw.case_begin(); c != sw.case_end(); ++c)
+                {
+                    op.constants.push_back(truncate(c.getCaseValue()->getZExtValue(), op.operand_bits));
+                    op.blocks.push_back(block_indices.at(c.getCaseSuccessor()));
+                }
+                break;
+            }
+            case Instruction::Ret:
+            {
+                const ReturnInst& ret = cast<ReturnInst>(instruction);
+                if(ret.getReturnValue() && !operand(ret.getReturnValue(), op.operands))
+                    return false;
+                break;
+            }
+            case Instruction::Call:
+            {
+                const CallInst& call = cast<CallInst>(instruction);
+                const Function* callee = call.getCalledFunction();
+                if(!callee)
+                    return false;
+                // the accessors with IR bodies (see define_inline) are shortcuts to their runtime functions
+                string name = callee->getName().str();
+                op.runtime = find_runtime_function(name);
+                if(!op.runtime && ends_with(name, "_inline"))
+                    op.runtime = find_runtime_function(name.substr(0, name.size() - 7));
+                if(!op.runtime)
+                {
+                    op.callee = prepare(*callee);
+                    if(!op.callee)
+                        return false;
+                }
+                for(unsigned i = 0; i != call.getNumArgOperands(); ++i)
+                {
+                    if(!operand(call.getArgOperand(i), op.operands))
+                        return false;
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+
+            if(op.opcode == Instruction::PHI)
+                decoded.phis.push_back(move(op));
+            else if(instruction.isTerminator())
+                decoded.terminator = move(op);
+            else
+                decoded.body.push_back(move(op));
+        }
+        result.blocks.push_back(move(decoded));
+    }
+    return true;
+}
+
+uint64_t macro_interpreter::run(const interpreted_function& func, const uint64_t* args, int& error_id) const
+{
+    vector<uint64_t> registers = func.initial_registers;
+    copy(args, args + func.arg_count, registers.begin());
+    arena stack; // memory of allocas, freed when the function returns
+    vector<uint64_t> call_args;
+    vector<uint64_t> incoming;
+
+    unsigned previous = 0;
+    unsigned current = 0;
+    while(true)
+    {
+        const block& b = func.blocks[current];
+
+        // the phis of a block are evaluated together, with the values from before entering it
+        incoming.clear();
+        for(const operation& phi : b.phis)
+        {
+            size_t i = find(phi.blocks.begin(), phi.blocks.end(), previous) - phi.blocks.begin();
+            incoming.push_back(registers[phi.operands[i]]);
+        }
+        for(size_t i = 0; i != b.phis.size(); ++i)
+            registers[b.phis[i].result] = incoming[i];
+
+        for(const operation& op : b.body)
+        {
+            auto operand = [&](size_t i)
+            {
+                return registers[op.operands[i]];
+            };
+            auto signed_operand = [&](size_t i)
+            {
+                return sign_extend(operand(i), op.operand_bits);
+            };
+            uint64_t value = 0;
+            switch(op.opcode)
+            {
+            case Instruction::Add:
+                value = operand(0) + operand(1);
+                break;
+            case Instruction::Sub:
+                value = operand(0) - operand(1);
+                break;
+            case Instruction::Mul:
+                value = operand(0) * operand(1);
+                break;
+            case Instruction::UDiv:
+                value = operand(0) / operand(1);
+                break;
+            case Instruction::SDiv:
+                value = signed_operand(0) / signed_operand(1);
+                break;
+            case Instruction::URem:
+                value = operand(0) % operand(1);
+                break;
+            case Instruction::SRem:
+                value = signed_operand(0) % signed_operand(1);
+                break;
+            case Instruction::And:
+                value = operand(0) & operand(1);
+                break;
+            case Instruction::Or:
+                value = operand(0) | operand(1);
+                break;
+            case Instruction::Xor:
+                value = operand(0) ^ operand(1);
+                break;
+            // shifting by the width or more is undefined in IR, too
+            case Instruction::Shl:
+                value = operand(1) < op.bits ? operand(0) << operand(1) : 0;
+                break;
+            case Instruction::LShr:
+                value = operand(1) < op.bits ? operand(0) >> operand(1) : 0;
+                break;
+            case Instruction::AShr:
+                value = operand(1) < op.bits ? signed_operand(0) >> operand(1) : 0;
+                break;
+            case Instruction::ICmp:
+                switch(op.constant)
+                {
+                case CmpInst::ICMP_EQ:
+                    value = operand(0) == operand(1);
+                    break;
+                case CmpInst::ICMP_NE:
+                    value = operand(0) != operand(1);
+                    break;
+                case CmpInst::ICMP_UGT:
+                    value = operand(0) > operand(1);
+                    break;
+                case CmpInst::ICMP_UGE:
+                    value = operand(0) >= operand(1);
+                    break;
+                case CmpInst::ICMP_ULT:
+                    value = operand(0) < operand(1);
+                    break;
+                case CmpInst::ICMP_ULE:
+                    value = operand(0) <= operand(1);
+                    break;
+                case CmpInst::ICMP_SGT:
+                    value = signed_operand(0) > signed_operand(1);
+                    break;
+                case CmpInst::ICMP_SGE:
+                    value = signed_operand(0) >= signed_operand(1);
+                    break;
+                case CmpInst::ICMP_SLT:
+                    value = signed_operand(0) < signed_operand(1);
+                    break;
+                case CmpInst::ICMP_SLE:
+                    value = signed_operand(0) <= signed_operand(1);
+                    break;
+                }
+                break;
+            case Instruction::Select:
+                value = operand(0) ? operand(1) : operand(2);
+                break;
+            case Instruction::SExt:
+                value = signed_operand(0);
+                break;
+            case Instruction::Trunc:
+            case Instruction::ZExt:
+            case Instruction::BitCast:
+            case Instruction::PtrToInt:
+            case Instruction::IntToPtr:
+                value = operand(0);
+                break;
+            case Instruction::Alloca:
+                value = reinterpret_cast<uint64_t>(stack.allocate(op.constant, 16));
+                break;
+            case Instruction::Load:
+                memcpy(&value, reinterpret_cast<const void*>(operand(0)), op.constant);
+                break;
+            case Instruction::Store:
+            {
+                uint64_t to_store = operand(0);
+                memcpy(reinterpret_cast<void*>(operand(1)), &to_store, op.constant);
+                break;
+            }
+            case Instruction::GetElementPtr:
+                value = operand(0) + op.constant;
+                for(size_t i = 0; i != op.constants.size(); ++i)
+                    value += sign_extend(operand(i + 1), op.widths[i]) * op.constants[i];
+                break;
+            case Instruction::Call:
+                call_args.clear();
+                for(unsigned slot : op.operands)
+                    call_args.push_back(registers[slot]);
+                if(op.runtime)
+                    error_id = call_runtime_function(op.runtime, call_args.data(), value);
+                else
+                    value = run(*op.callee, call_args.data(), error_id);
+                if(error_id != 0)
+                    return 0;
+                break;
+            }
+            registers[op.result] = truncate(value, op.bits);
+        }
+
+        const operation& terminator = b.terminator;
+        previous = current;
+        switch(terminator.opcode)
+        {
+        case Instruction::Ret:
+            return terminator.operands.empty() ? 0 : registers[terminator.operands[0]];
+        case Instruction::Br:
+            if(terminator.operands.empty() || registers[terminator.operands[0]])
+                current = terminator.blocks[0];
+            else
+                current = terminator.blocks[1];
+            break;
+        case Instruction::Switch:
+        {
+            uint64_t condition = registers[terminator.operands[0]];
+            // the default destination is first
+            auto it = find(terminator.constants.begin(), terminator.constants.end(), condition);
+            if(it == terminator.constants.end())
+                current = terminator.blocks[0];
+            else
+                current = terminator.blocks[it - terminator.constants.begin() + 1];
+            break;
+        }
+        }
+    }
+}
+
+node_ptr macro_interpreter::operator()(node_ptr macro_arg) const
+{
+    int error_id = 0;
+    uint64_t arg = reinterpret_cast<uint64_t>(macro_arg);
+    uint64_t result = run(*interpreted_macro_, &arg, error_id);
+    // only now, with all frames of the interpreter left, the execution can be failed
+    if(error_id != 0)
+        raise_macro_error(error_id);
+    return reinterpret_cast<node_ptr>(result);
+}
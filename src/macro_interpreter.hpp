@@ -0,0 +1,52 @@
+#ifndef MACRO_INTERPRETER_HPP_
+#define MACRO_INTERPRETER_HPP_
+
+#include "macro_execution.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+namespace llvm
+{
+class Function;
+class Constant;
+}
+
+struct macro_execution_environment;
+
+// executes the IR of a macro (and of the compile time procs it calls) without generating machine code
+// for macros that run only a few times, this is a lot cheaper than optimizing and JIT-compiling them
+class macro_interpreter
+{
+public:
+    // nullptr if func or a function it calls contains an instruction the interpreter doesn't handle
+    // func is copied, so it can be optimized and compiled while the interpreter is in use
+    static std::unique_ptr<macro_interpreter> create(const llvm::Function& func, macro_execution_environment& env);
+    macro_interpreter(const macro_interpreter&) = delete;
+    ~macro_interpreter();
+
+    macro_interpreter& operator=(const macro_interpreter&) = delete;
+
+    // to be called by execute_macro, like a compiled macro_function
+    node_ptr operator()(node_ptr macro_arg) const;
+private:
+    struct operation;
+    struct block;
+    struct interpreted_function;
+
+    macro_interpreter(macro_execution_environment& env);
+
+    const interpreted_function* prepare(const llvm::Function& func);
+    bool decode(const llvm::Function& func, interpreted_function& result);
+    bool constant_value(const llvm::Constant& constant, std::uint64_t& value);
+    std::uint64_t run(const interpreted_function& func, const std::uint64_t* args, int& error_id) const;
+
+    macro_execution_environment& env_;
+    std::unique_ptr<llvm::Function> macro_;
+    std::unordered_map<const llvm::Function*, std::unique_ptr<interpreted_function>> functions_;
+    const interpreted_function* interpreted_macro_ = nullptr;
+};
+
+#endif
+
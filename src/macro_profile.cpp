@@ -0,0 +1,176 @@
+#include "macro_profile.hpp"
+
+#include <ostream>
+#include <iomanip>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <mutex>
+#include <cstdio>
+
+using std::size_t;
+using std::string;
+using std::vector;
+using std::pair;
+using std::unordered_map;
+using std::function;
+using std::ostream;
+using std::setw;
+using std::left;
+using std::right;
+using std::fixed;
+using std::setprecision;
+using std::sort;
+using std::max;
+using std::mutex;
+using std::lock_guard;
+using std::atomic;
+using std::snprintf;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+atomic<bool> macro_profiling{false};
+
+namespace
+{
+
+// statistics of a running call, merged into the profile when it returns
+struct profile_frame
+{
+    const void* macro;
+    double copy_seconds;
+    size_t nodes_created;
+    size_t depth;
+};
+
+thread_local vector<profile_frame> frames;
+
+mutex profile_mutex;
+unordered_map<const void*, macro_statistics> profile;
+
+double seconds_since(steady_clock::time_point begin)
+{
+    return duration<double>(steady_clock::now() - begin).count();
+}
+
+vector<pair<const void*, macro_statistics>> sorted_profile()
+{
+    vector<pair<const void*, macro_statistics>> sorted;
+    {
+        lock_guard<mutex> lock{profile_mutex};
+        sorted.assign(profile.begin(), profile.end());
+    }
+    sort(sorted.begin(), sorted.end(), [](const pair<const void*, macro_statistics>& lhs, const pair<const void*, macro_statistics>& rhs)
+    {
+        return lhs.second.total_seconds > rhs.second.total_seconds;
+    });
+    return sorted;
+}
+
+void write_json_string(ostream& os, const string& str)
+{
+    os << '"';
+    for(char c : str)
+    {
+        if(c == '"' || c == '\\')
+            os << '\\' << c;
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            os << escaped;
+        }
+        else
+            os << c;
+    }
+    os << '"';
+}
+
+}
+
+void enable_macro_profiling(bool enable)
+{
+    macro_profiling = enable;
+}
+
+void macro_profile_scope::begin()
+{
+    frames.push_back({macro_, 0, 0, 0});
+    begin_ = steady_clock::now();
+}
+void macro_profile_scope::end()
+{
+    double seconds = seconds_since(begin_);
+    profile_frame frame = frames.back();
+    frames.pop_back();
+
+    lock_guard<mutex> lock{profile_mutex};
+    macro_statistics& statistics = profile[macro_];
+    ++statistics.calls;
+    statistics.total_seconds += seconds;
+    statistics.max_seconds = max(statistics.max_seconds, seconds);
+    statistics.copy_seconds += frame.copy_seconds;
+    statistics.nodes_created += frame.nodes_created;
+    statistics.max_depth = max(statistics.max_depth, frame.depth);
+}
+
+void macro_copy_scope::end()
+{
+    if(!frames.empty())
+        frames.back().copy_seconds += seconds_since(begin_);
+}
+
+void profile_execution(size_t nodes_created, size_t depth)
+{
+    if(frames.empty())
+        return;
+    frames.back().nodes_created += nodes_created;
+    frames.back().depth = max(frames.back().depth, depth);
+}
+
+unordered_map<const void*, macro_statistics> macro_profile()
+{
+    lock_guard<mutex> lock{profile_mutex};
+    return profile;
+}
+void reset_macro_profile()
+{
+    lock_guard<mutex> lock{profile_mutex};
+    profile.clear();
+}
+
+void print_macro_profile(ostream& os, const function<string (const void*)>& name)
+{
+    os << left << setw(40) << "macro" << right << setw(10) << "calls" << setw(12) << "total ms"
+        << setw(12) << "max ms" << setw(12) << "copy ms" << setw(12) << "nodes" << setw(8) << "depth" << "\n";
+    os << fixed << setprecision(3);
+    for(const auto& p : sorted_profile())
+    {
+        const macro_statistics& statistics = p.second;
+        os << left << setw(40) << name(p.first) << right << setw(10) << statistics.calls
+            << setw(12) << statistics.total_seconds * 1e3 << setw(12) << statistics.max_seconds * 1e3
+            << setw(12) << statistics.copy_seconds * 1e3 << setw(12) << statistics.nodes_created
+            << setw(8) << statistics.max_depth << "\n";
+    }
+}
+
+void write_macro_profile_json(ostream& os, const function<string (const void*)>& name)
+{
+    os << "[";
+    bool first = true;
+    for(const auto& p : sorted_profile())
+    {
+        const macro_statistics& statistics = p.second;
+        os << (first ? "\n" : ",\n") << "  {\"name\": ";
+        write_json_string(os, name(p.first));
+        os << ", \"calls\": " << statistics.calls
+            << ", \"total_seconds\": " << statistics.total_seconds
+            << ", \"max_seconds\": " << statistics.max_seconds
+            << ", \"copy_seconds\": " << statistics.copy_seconds
+            << ", \"nodes_created\": " << statistics.nodes_created
+            << ", \"max_depth\": " << statistics.max_depth << "}";
+        first = false;
+    }
+    os << "\n]\n";
+}
@@ -0,0 +1,99 @@
+#ifndef MACRO_PROFILE_HPP_
+#define MACRO_PROFILE_HPP_
+
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+
+// statistics of a macro, collected while profiling is enabled
+// macros are identified by their function (macro_node::function().get())
+struct macro_statistics
+{
+    std::size_t calls = 0;
+    // including nested macro calls
+    double total_seconds = 0;
+    double max_seconds = 0;
+    // copying arguments, for the macro cache and when they are first modified
+    double copy_seconds = 0;
+    // by the executions of the macro itself, not by nested ones
+    std::size_t nodes_created = 0;
+    // deepest nesting of executions the macro ran in, 1 if it was called by the compiler
+    std::size_t max_depth = 0;
+};
+
+// off by default, then profiling costs a branch per macro call
+extern std::atomic<bool> macro_profiling;
+
+inline bool macro_profiling_enabled()
+{
+    return macro_profiling.load(std::memory_order_relaxed);
+}
+void enable_macro_profiling(bool enable);
+
+// times a macro call, and receives the statistics of its execution (see below)
+class macro_profile_scope
+{
+public:
+    explicit macro_profile_scope(const void* macro)
+      : macro_(macro_profiling_enabled() ? macro : nullptr)
+    {
+        if(macro_)
+            begin();
+    }
+    macro_profile_scope(const macro_profile_scope&) = delete;
+    ~macro_profile_scope()
+    {
+        if(macro_)
+            end();
+    }
+
+    macro_profile_scope& operator=(const macro_profile_scope&) = delete;
+private:
+    void begin();
+    void end();
+
+    const void* macro_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+// times copying arguments, for the innermost profiled macro call on this thread
+class macro_copy_scope
+{
+public:
+    macro_copy_scope()
+      : enabled_(macro_profiling_enabled())
+    {
+        if(enabled_)
+            begin_ = std::chrono::steady_clock::now();
+    }
+    macro_copy_scope(const macro_copy_scope&) = delete;
+    ~macro_copy_scope()
+    {
+        if(enabled_)
+            end();
+    }
+
+    macro_copy_scope& operator=(const macro_copy_scope&) = delete;
+private:
+    void end();
+
+    bool enabled_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+// for the innermost profiled macro call on this thread, ignored if there is none
+void profile_execution(std::size_t nodes_created, std::size_t depth);
+
+std::unordered_map<const void*, macro_statistics> macro_profile();
+void reset_macro_profile();
+
+// sorted by total time, name returns the name of a macro
+void print_macro_profile(std::ostream& os, const std::function<std::string (const void*)>& name);
+void write_macro_profile_json(std::ostream& os, const std::function<std::string (const void*)>& name);
+
+#endif
+
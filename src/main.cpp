@@ -1,6 +1,9 @@
 #include "compile_unit.hpp"
 #include "error/compile_exception.hpp"
 #include "printing.hpp"
+#include "line_table.hpp"
+#include "mapped_file.hpp"
+#include "macro_profile.hpp"
 
 #include <boost/filesystem.hpp>
 
@@ -11,6 +14,10 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <unordered_map>
+#include <sstream>
+#include <utility>
+#include <memory>
 
 using boost::filesystem::path;
 
@@ -19,10 +26,16 @@ using std::cerr;
 using std::endl;
 using std::vector;
 using std::string;
+using std::stoul;
+using std::stoull;
 using std::pair;
 using std::ofstream;
+using std::ostringstream;
+using std::move;
 using std::ios;
 using std::size_t;
+using std::unordered_map;
+using std::shared_ptr;
 
 using llvm::raw_os_ostream;
 using llvm::WriteBitcodeToFile;
@@ -30,25 +43,93 @@ using llvm::verifyModule;
 
 int main(int argc, char** args)
 {
-    vector<path> paths{args + 1, args + argc};
+    compilation_context context;
+    vector<path> paths;
+    const string jit_threshold_option = "--jit-threshold=";
+    const string code_cache_option = "--code-cache=";
+    const string code_cache_size_option = "--code-cache-size=";
+    const string profile_option = "--profile-macros";
+    const string entry_option = "--entry=";
+    path entry;
+    bool print_profile = false;
+    string profile_json_path;
+    for(int i = 1; i != argc; ++i)
+    {
+        string arg = args[i];
+        // optimization level of macros: -O0, -O1 or -O2 (default)
+        if(arg == "-O0")
+            context.macro_optimization_level(optimization_level::NONE);
+        else if(arg == "-O1")
+            context.macro_optimization_level(optimization_level::O1);
+        else if(arg == "-O2")
+            context.macro_optimization_level(optimization_level::O2);
+        // number of calls a macro is interpreted for before it is JIT-compiled, 0 disables the interpreter
+        else if(arg.compare(0, jit_threshold_option.size(), jit_threshold_option) == 0)
+            context.macro_jit_threshold(stoul(arg.substr(jit_threshold_option.size())));
+        // directory to keep optimized macros in between runs, and its size in MiB
+        else if(arg.compare(0, code_cache_option.size(), code_cache_option) == 0)
+            context.code_cache_directory(arg.substr(code_cache_option.size()));
+        else if(arg.compare(0, code_cache_size_option.size(), code_cache_size_option) == 0)
+            context.code_cache_size(stoull(arg.substr(code_cache_size_option.size())) << 20);
+        // statistics of macro executions, printed at the end or written to a file as JSON (--profile-macros=FILE)
+        else if(arg == profile_option)
+            print_profile = true;
+        else if(arg.compare(0, profile_option.size() + 1, profile_option + "=") == 0)
+            profile_json_path = arg.substr(profile_option.size() + 1);
+        // compiles only the given file and the modules it imports, instead of the files given as arguments
+        else if(arg.compare(0, entry_option.size(), entry_option) == 0)
+            entry = arg.substr(entry_option.size());
+        else if(arg.size() > 1 && arg[0] == '-')
+        {
+            cerr << "unknown option " << arg << endl;
+            cerr << "usage: " << args[0] << " [-O0|-O1|-O2] [--jit-threshold=N] [--code-cache=DIR] [--code-cache-size=MIB] [--profile-macros[=FILE]] (--entry=FILE | files...)" << endl;
+            return 1;
+        }
+        else
+            paths.push_back(arg);
+    }
+    if(!entry.empty() && !paths.empty())
+    {
+        cerr << "files can't be given together with " << entry_option << endl;
+        return 1;
+    }
+    unit_files unit = entry.empty() ? open_unit(paths) : discover_unit(entry);
+    paths = unit.paths;
+
+    enable_macro_profiling(print_profile || !profile_json_path.empty());
+    // for the profile: macros are named by the module that exports them
+    unordered_map<const void*, string> macro_names;
+    auto name_macros = [&](const string& module_name, const module& m)
+    {
+        for_each(m.exports, unpacking(
+        [&](identifier_id_t identifier, const node& n)
+        {
+            if(n.is<macro_node>())
+                macro_names.insert({n.cast<macro_node>().function().get(), module_name + ":" + context.to_string(identifier)});
+        }));
+    };
+    name_macros("core", context.core_module());
+
     cout << "compiling files";
     for(const path& p : paths)
         cout << " " << p.native();
     cout << endl;
     
-    compilation_context context;
+    // errors are located in the bytes that were parsed, even if a file changes in the meantime
+    vector<shared_ptr<const mapped_file>> files = unit.files;
     try
     {
-        vector<module> modules = compile_unit(paths, context);
+        vector<module> modules = compile_unit(move(unit), context);
         assert(modules.size() == paths.size());
         for_each(zipped(paths, modules), unpacking(
         [&](const path& p, const module& m)
         {
             cout << "file " << p.native() << ":" << endl;
+            name_macros(p.native(), m);
             for_each(m.exports, unpacking(
-            [&](const string& identifier, const node& n)
+            [&](identifier_id_t identifier, const node& n)
             {
-                cout << identifier << " defined as\n";
+                cout << context.to_string(identifier) << " defined as\n";
                 cout << n;
             }));
             cout << endl;
@@ -61,7 +142,26 @@ int main(int argc, char** args)
             assert(file_id < paths.size());
             return paths[file_id].native();
         };
-        print(cerr, exc, file_id_to_name);
+        // line tables are only built for the files that errors are printed for
+        // locations in files without a valid mapping are printed as byte offsets
+        unordered_map<size_t, line_table> line_tables;
+        auto file_id_to_lines = [&](size_t file_id) -> const line_table*
+        {
+            if(file_id >= files.size() || !files[file_id] || !*files[file_id])
+                return nullptr;
+            auto it = line_tables.find(file_id);
+            if(it == line_tables.end())
+                it = line_tables.emplace(file_id, line_table{files[file_id]->begin(), files[file_id]->end()}).first;
+            return &it->second;
+        };
+        print(cerr, exc, file_id_to_name, file_id_to_lines);
+    }
+    catch(const circular_dependency& exc)
+    {
+        cerr << "circular dependency:";
+        for(size_t file_id : exc.cycle)
+            cerr << " " << paths[file_id].native() << " imports";
+        cerr << " " << paths[exc.cycle.front()].native() << endl;
     }
 
     raw_os_ostream llvm_cerr{cerr};
@@ -71,5 +171,22 @@ int main(int argc, char** args)
     raw_os_ostream llvm_output{output};
 
     WriteBitcodeToFile(&context.runtime_module(), llvm_output);
+
+    auto macro_name = [&](const void* macro) -> string
+    {
+        auto it = macro_names.find(macro);
+        if(it != macro_names.end())
+            return it->second;
+        ostringstream unexported;
+        unexported << "<macro at " << macro << ">";
+        return unexported.str();
+    };
+    if(print_profile)
+        print_macro_profile(cout, macro_name);
+    if(!profile_json_path.empty())
+    {
+        ofstream profile_output{profile_json_path};
+        write_macro_profile_json(profile_output, macro_name);
+    }
 }
 
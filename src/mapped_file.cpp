@@ -0,0 +1,46 @@
+#include "mapped_file.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::size_t;
+
+mapped_file::mapped_file(const char* path)
+  : data_{nullptr},
+    size_{0},
+    is_valid{false}
+{
+    int fd = open(path, O_RDONLY);
+    if(fd == -1)
+        return;
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == 0)
+    {
+        size_t file_size = static_cast<size_t>(file_stat.st_size);
+        if(file_size == 0)
+            is_valid = true; // mmap can't map empty files, empty range is fine
+        else
+        {
+            void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping != MAP_FAILED)
+            {
+                // the parser reads the file front to back exactly once
+                madvise(mapping, file_size, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(mapping);
+                size_ = file_size;
+                is_valid = true;
+            }
+        }
+    }
+    close(fd); // the mapping stays valid after closing
+}
+
+mapped_file::~mapped_file()
+{
+    if(data_)
+        munmap(const_cast<char*>(data_), size_);
+}
+
@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#include <cstddef>
+
+// read-only memory mapping of a whole file
+// check with operator bool whether mapping succeeded (like std::ifstream)
+class mapped_file
+{
+public:
+    explicit mapped_file(const char* path);
+    mapped_file(const mapped_file&) = delete;
+    ~mapped_file();
+
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    explicit operator bool() const
+    {
+        return is_valid;
+    }
+
+    const char* begin() const
+    {
+        return data_;
+    }
+    const char* end() const
+    {
+        return data_ + size_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+private:
+    const char* data_;
+    std::size_t size_;
+    bool is_valid;
+};
+
+#endif
+
@@ -25,15 +25,13 @@ using boost::none;
 
 bool is_export_statement(const list_node& statement)
 {
-    static const string export_str = "export";
     return !statement.empty() && statement[0].is<ref_node>() &&
-            statement[0].cast<ref_node>().identifier() == rangeify(export_str);
+            statement[0].cast<ref_node>().identifier_id() == identifier_id(identifier_ids::EXPORT);
 }
 bool is_import_statement(const list_node& statement)
 {
-    static const string import_str = "import";
     return !statement.empty() && statement[0].is<ref_node>() &&
-            statement[0].cast<ref_node>().identifier() == rangeify(import_str);
+            statement[0].cast<ref_node>().identifier_id() == identifier_id(identifier_ids::IMPORT);
 }
 
 optional<import_statement> parse_import(const list_node& statement)
@@ -60,8 +58,7 @@ optional<import_statement> parse_import(const list_node& statement)
     {
         fatal<id("invalid_from_token")>(statement[2].source());
     });
-    static const string from_str = "from";
-    if(from_token.identifier() != rangeify(from_str))
+    if(from_token.identifier_id() != identifier_id(identifier_ids::FROM))
         fatal<id("invalid_from_token")>(statement[2].source());
 
     const lit_node& imported_module = statement[3].cast_else<lit_node>([&]()
@@ -115,7 +112,7 @@ symbol_table initial_symbol_table(const module_header& header, function<const mo
         for(const node& s : import.import_list)
         {
             // s.cast<ref_node>() checked by parse_import
-            auto imported_identifier = save<string>(s.cast<ref_node>().identifier());
+            identifier_id_t imported_identifier = s.cast<ref_node>().identifier_id();
             auto symbol_find_it = imported_module.exports.find(imported_identifier);
             if(symbol_find_it == imported_module.exports.end())
                 fatal<id("symbol_not_found")>(s.source());
@@ -129,15 +126,14 @@ void remove_not_exported(symbol_table& table, const module_header& header)
 {
     for(auto it = table.begin(); it != table.end(); )
     {
-        const auto& identifier = it->first;
+        identifier_id_t identifier = it->first;
         for(const export_statement& export_st : header.exports)
         {
             for(auto exports_it = export_st.statement.begin() + 1;
                     exports_it != export_st.statement.end();
                     ++exports_it)
             {
-                const auto& exported_identifier = exports_it->cast<ref_node>().identifier();
-                if(rangeify(identifier) == exported_identifier)
+                if(exports_it->cast<ref_node>().identifier_id() == identifier)
                 {
                     ++it;
                     goto is_exported;
@@ -154,7 +150,7 @@ void dispatch_references(node& s, const symbol_table& table)
     if(s.is<ref_node>())
     {
         ref_node& r = s.cast<ref_node>();
-        auto find_it = table.find(save<string>(r.identifier()));
+        auto find_it = table.find(r.identifier_id());
         if(find_it != table.end())
             r.refered(&find_it->second);
     }
@@ -199,8 +195,7 @@ module evaluate_module(list_node& syntax_tree, dynamic_graph graph_owner, const
             fatal<id("invalid_command")>(statement[0].source());
         });
         
-        static const string def_str = "def";
-        if(command.identifier() == rangeify(def_str))
+        if(command.identifier_id() == identifier_id(identifier_ids::DEF))
         {
             if(statement.size() < 3)
                 fatal<id("def_invalid_argument_number")>(statement.source());
@@ -222,7 +217,7 @@ module evaluate_module(list_node& syntax_tree, dynamic_graph graph_owner, const
             graph_owner.add(move(graph));
             
             bool was_inserted;
-            tie(ignore, was_inserted) = table.insert({save<string>(defined.identifier()), definition});
+            tie(ignore, was_inserted) = table.insert({defined.identifier_id(), definition});
             if(!was_inserted)
                 fatal<id("duplicate_definition")>(defined.source());
         }
@@ -33,7 +33,7 @@ struct module_header
 module_header read_module_header(const list_node& syntax_tree);
 std::unordered_map<std::string, std::vector<node_source>> imported_modules(const module_header& header);
 
-typedef std::unordered_map<std::string, const node&> symbol_table;
+typedef std::unordered_map<identifier_id_t, const node&> symbol_table;
 struct module
 {
     dynamic_graph node_owner;
@@ -0,0 +1,418 @@
+#include "module_cache.hpp"
+
+#include "ast_cache.hpp"
+#include "mapped_file.hpp"
+#include "integer_literal.hpp"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::string;
+using std::to_string;
+using std::vector;
+using std::pair;
+using std::unordered_map;
+using std::shared_ptr;
+using std::make_shared;
+using std::ofstream;
+using std::ios;
+using std::memcpy;
+using std::memcmp;
+using std::move;
+using std::numeric_limits;
+using std::sort;
+
+using boost::optional;
+using boost::none;
+
+namespace
+{
+
+constexpr char cache_magic[4] = {'A', 'L', 'M', '\0'};
+constexpr uint32_t cache_version = 1;
+constexpr uint32_t no_node = numeric_limits<uint32_t>::max();
+
+// layout of a cache file:
+// header, export_record[export_count], node_record[node_count], uint32_t[child_count], char[char_count]
+// nodes are in post order, so children and refered nodes come before the nodes referring to them
+struct cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t content_hash;
+    uint64_t source_size;
+    uint64_t imports_hash;
+    uint64_t interface_hash;
+    uint32_t export_count;
+    uint32_t node_count;
+    uint32_t child_count;
+    uint32_t char_count;
+};
+
+// identifier in chars, exported node
+struct export_record
+{
+    uint32_t first;
+    uint32_t size;
+    uint32_t node;
+};
+
+enum record_kind
+  : uint8_t
+{
+    LITERAL,
+    REFERENCE,
+    LIST,
+    // an export of an imported module, loaded from the module
+    IMPORTED
+};
+
+struct node_record
+{
+    uint8_t kind;
+    uint8_t has_source;
+    uint8_t unused[2];
+    file_offset source_begin;
+    file_offset source_end;
+    // literals and references: characters in chars, the identifier for references
+    // lists: child indices
+    // imported nodes: identifier of the export in chars
+    uint32_t first;
+    uint32_t size;
+    // references: index of the refered node, or no_node
+    // imported nodes: index of the import statement
+    uint32_t extra;
+};
+
+// import statement index and identifier
+typedef pair<uint32_t, const string*> imported_symbol;
+
+class cache_writer
+{
+public:
+    cache_writer(size_t file_id, unordered_map<const node*, imported_symbol> imported)
+      : file_id{file_id},
+        imported{move(imported)}
+    {}
+
+    // returns no_node if n can't be cached
+    uint32_t write(const node& n)
+    {
+        auto inserted = indices.insert({&n, no_node});
+        if(!inserted.second)
+            return inserted.first->second; // no_node for a cycle
+
+        node_record record = {};
+        auto imported_it = imported.find(&n);
+        if(imported_it != imported.end())
+        {
+            // imported nodes keep their source
+            record.kind = IMPORTED;
+            record.extra = imported_it->second.first;
+            add_chars(record, *imported_it->second.second);
+            records.push_back(record);
+            return inserted.first->second = records.size() - 1;
+        }
+
+        if(const file_source* source = boost::get<file_source>(&n.source()))
+        {
+            if(source->file_id != file_id)
+                return no_node; // the entry would have to know the ids of other files
+            record.has_source = 1;
+            record.source_begin = source->begin;
+            record.source_end = source->end;
+        }
+
+        if(n.is<list_node>())
+        {
+            vector<uint32_t> child_indices;
+            for(const node& child : n.cast<list_node>())
+            {
+                uint32_t child_index = write(child);
+                if(child_index == no_node)
+                    return no_node;
+                child_indices.push_back(child_index);
+            }
+            record.kind = LIST;
+            record.first = children.size();
+            record.size = child_indices.size();
+            children.insert(children.end(), child_indices.begin(), child_indices.end());
+        }
+        else if(n.is<lit_node>())
+        {
+            const lit_node& lit = n.cast<lit_node>();
+            record.kind = LITERAL;
+            add_chars(record, string{lit.begin(), lit.end()});
+        }
+        else if(n.is<ref_node>())
+        {
+            const ref_node& ref = n.cast<ref_node>();
+            record.kind = REFERENCE;
+            record.extra = no_node;
+            if(ref.refered())
+            {
+                record.extra = write(*ref.refered());
+                if(record.extra == no_node)
+                    return no_node;
+            }
+            add_chars(record, identifier_string(ref.identifier_id()));
+        }
+        else
+            return no_node; // ids, macros and procs only exist while the compiler runs
+
+        records.push_back(record);
+        return inserted.first->second = records.size() - 1;
+    }
+    void add_chars(node_record& record, const string& str)
+    {
+        record.first = chars.size();
+        record.size = str.size();
+        chars += str;
+    }
+
+    vector<node_record> records;
+    vector<uint32_t> children;
+    string chars;
+private:
+    size_t file_id;
+    unordered_map<const node*, imported_symbol> imported;
+    unordered_map<const node*, uint32_t> indices;
+};
+
+// the exports of the imported modules, by node
+// a node exported under several names is identified by the first module and the least name, so entries don't
+// depend on the order of hash tables
+unordered_map<const node*, imported_symbol> imported_symbols(const vector<const module*>& imported_modules)
+{
+    unordered_map<const node*, imported_symbol> symbols;
+    for(size_t import_index = 0; import_index != imported_modules.size(); ++import_index)
+    {
+        for(const auto& exported : imported_modules[import_index]->exports)
+        {
+            imported_symbol symbol{import_index, &identifier_string(exported.first)};
+            auto inserted = symbols.insert({&exported.second, symbol});
+            if(!inserted.second && inserted.first->second.first == import_index
+                    && *symbol.second < *inserted.first->second.second)
+                inserted.first->second = symbol;
+        }
+    }
+    return symbols;
+}
+
+uint64_t combine(uint64_t hash, uint64_t other)
+{
+    char words[16];
+    memcpy(words, &hash, 8);
+    memcpy(words + 8, &other, 8);
+    return content_hash(words, words + 16);
+}
+
+}
+
+uint64_t imports_hash(const vector<uint64_t>& interface_hashes)
+{
+    const char* begin = reinterpret_cast<const char*>(interface_hashes.data());
+    return content_hash(begin, begin + interface_hashes.size() * sizeof(uint64_t));
+}
+uint64_t uncached_interface_hash(const module_cache_key& key)
+{
+    return combine(combine(key.content_hash, key.source_size), key.imports_hash);
+}
+
+bool has_module_cache(const char* path, uint64_t content_hash, uint64_t source_size)
+{
+    mapped_file file{path};
+    if(!file || file.size() < sizeof(cache_header))
+        return false;
+    cache_header header;
+    memcpy(&header, file.begin(), sizeof(header));
+    return memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0 && header.version == cache_version
+            && header.content_hash == content_hash && header.source_size == source_size;
+}
+
+optional<cached_module> read_module_cache(const char* path, const module_cache_key& key, size_t file_id,
+        const vector<const module*>& imported_modules)
+{
+    auto file = make_shared<mapped_file>(path);
+    if(!*file || file->size() < sizeof(cache_header))
+        return none;
+
+    cache_header header;
+    memcpy(&header, file->begin(), sizeof(header));
+    if(memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version
+            || header.content_hash != key.content_hash || header.source_size != key.source_size
+            || header.imports_hash != key.imports_hash)
+        return none;
+    if(file->size() != sizeof(header) + header.export_count * sizeof(export_record)
+            + header.node_count * sizeof(node_record) + header.child_count * sizeof(uint32_t) + header.char_count)
+        return none;
+
+    // the mapping is page aligned and all sizes but the one of chars are multiples of 4
+    const export_record* exports = reinterpret_cast<const export_record*>(file->begin() + sizeof(header));
+    const node_record* records = reinterpret_cast<const node_record*>(exports + header.export_count);
+    const uint32_t* children = reinterpret_cast<const uint32_t*>(records + header.node_count);
+    const char* chars = reinterpret_cast<const char*>(children + header.child_count);
+
+    auto is_in_chars = [&](uint32_t first, uint32_t size)
+    {
+        return first <= header.char_count && size <= header.char_count - first;
+    };
+
+    // one pass front to back, like read_ast_cache
+    dynamic_graph loaded;
+    vector<node*> nodes;
+    nodes.reserve(header.node_count);
+    for(uint32_t index = 0; index != header.node_count; ++index)
+    {
+        const node_record& record = records[index];
+        if(record.kind != LIST && !is_in_chars(record.first, record.size))
+            return none;
+        const char* begin = chars + record.first;
+        const char* end = begin + record.size;
+
+        node* created;
+        if(record.kind == IMPORTED)
+        {
+            if(record.extra >= imported_modules.size())
+                return none;
+            const symbol_table& imported_exports = imported_modules[record.extra]->exports;
+            auto it = imported_exports.find(identifier_id(begin, end));
+            if(it == imported_exports.end())
+                return none;
+            nodes.push_back(const_cast<node*>(&it->second));
+            continue;
+        }
+        else if(record.kind == LIST)
+        {
+            if(record.first > header.child_count || record.size > header.child_count - record.first)
+                return none;
+            vector<node*> list_children(record.size);
+            for(uint32_t i = 0; i != record.size; ++i)
+            {
+                uint32_t child_index = children[record.first + i];
+                if(child_index >= index)
+                    return none;
+                list_children[i] = nodes[child_index];
+            }
+            created = &loaded.create_list(move(list_children));
+        }
+        else if(record.kind == LITERAL)
+            created = &loaded.create_lit(begin, end, decode_integer(begin, end));
+        else if(record.kind == REFERENCE)
+        {
+            if(record.extra != no_node && record.extra >= index)
+                return none;
+            ref_node& ref = loaded.create_ref(begin, end, identifier_id(begin, end));
+            if(record.extra != no_node)
+                ref.refered(nodes[record.extra]);
+            created = &ref;
+        }
+        else
+            return none;
+
+        if(record.has_source)
+        {
+            if(record.source_begin > record.source_end || record.source_end > key.source_size)
+                return none;
+            created->source(file_source{record.source_begin, record.source_end, static_cast<uint32_t>(file_id)});
+        }
+        nodes.push_back(created);
+    }
+
+    symbol_table table;
+    for(uint32_t i = 0; i != header.export_count; ++i)
+    {
+        const export_record& record = exports[i];
+        if(!is_in_chars(record.first, record.size) || record.node >= header.node_count)
+            return none;
+        table.insert({identifier_id(chars + record.first, chars + record.first + record.size), *nodes[record.node]});
+    }
+
+    // literals and references point into the mapping
+    loaded.keep_alive(move(file));
+    return cached_module{module{move(loaded), move(table)}, header.interface_hash};
+}
+
+optional<uint64_t> write_module_cache(const char* path, const module_cache_key& key, size_t file_id,
+        const module& m, const vector<const module*>& imported_modules)
+{
+    // sorted by name, so entries and interface hashes don't depend on the order of hash tables
+    vector<pair<const string*, const node*>> sorted_exports;
+    for(const auto& exported : m.exports)
+        sorted_exports.push_back({&identifier_string(exported.first), &exported.second});
+    sort(sorted_exports.begin(), sorted_exports.end(), [](const pair<const string*, const node*>& lhs, const pair<const string*, const node*>& rhs)
+    {
+        return *lhs.first < *rhs.first;
+    });
+
+    cache_writer writer{file_id, imported_symbols(imported_modules)};
+    vector<export_record> exports;
+    for(const auto& exported : sorted_exports)
+    {
+        export_record record;
+        record.node = writer.write(*exported.second);
+        if(record.node == no_node)
+            return none;
+        record.first = writer.chars.size();
+        record.size = exported.first->size();
+        writer.chars += *exported.first;
+        exports.push_back(record);
+    }
+
+    cache_header header = {};
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.content_hash = key.content_hash;
+    header.source_size = key.source_size;
+    header.imports_hash = key.imports_hash;
+    header.export_count = exports.size();
+    header.node_count = writer.records.size();
+    header.child_count = writer.children.size();
+    header.char_count = writer.chars.size();
+
+    // imported nodes are only named in the entry, so the interface depends on the imports, too
+    const char* exports_begin = reinterpret_cast<const char*>(exports.data());
+    const char* records_begin = reinterpret_cast<const char*>(writer.records.data());
+    const char* children_begin = reinterpret_cast<const char*>(writer.children.data());
+    uint64_t interface_hash = key.imports_hash;
+    interface_hash = combine(interface_hash, content_hash(exports_begin, exports_begin + exports.size() * sizeof(export_record)));
+    interface_hash = combine(interface_hash, content_hash(records_begin, records_begin + writer.records.size() * sizeof(node_record)));
+    interface_hash = combine(interface_hash, content_hash(children_begin, children_begin + writer.children.size() * sizeof(uint32_t)));
+    header.interface_hash = combine(interface_hash, content_hash(writer.chars.data(), writer.chars.data() + writer.chars.size()));
+
+    // write to a temporary file and rename it, so readers never see half written entries
+    string temporary_path = string{path} + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream file{temporary_path, ios::binary | ios::trunc};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(exports_begin, exports.size() * sizeof(export_record));
+        file.write(records_begin, writer.records.size() * sizeof(node_record));
+        file.write(children_begin, writer.children.size() * sizeof(uint32_t));
+        file.write(writer.chars.data(), writer.chars.size());
+        if(!file)
+        {
+            std::remove(temporary_path.c_str());
+            return none;
+        }
+    }
+    if(std::rename(temporary_path.c_str(), path) != 0)
+    {
+        std::remove(temporary_path.c_str());
+        return none;
+    }
+    return header.interface_hash;
+}
+
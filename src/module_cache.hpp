@@ -0,0 +1,57 @@
+#ifndef MODULE_CACHE_HPP_
+#define MODULE_CACHE_HPP_
+
+#include "module.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// cache of the exports of an evaluated module, stored next to its source file as <name>.alm
+// an entry is keyed by the hash of the source and the interface hashes of the imported modules,
+// so a module is evaluated again when it or the exports of a module it imports change
+// only modules whose exports are plain data (literals, references and lists) and whose evaluation added nothing
+// to the runtime module are cached: macros, procs and ids refer to compiled code and counters that only exist
+// while the compiler runs, modules defining them are always evaluated
+// the format uses the native byte order, caches are not meant to be copied between machines
+
+struct module_cache_key
+{
+    std::uint64_t content_hash;
+    std::uint64_t source_size;
+    // see imports_hash
+    std::uint64_t imports_hash;
+};
+
+// the interface hash of the core module
+constexpr std::uint64_t core_interface_hash = 0;
+
+// interface_hashes are the ones of the imported modules, in the order of the import statements
+std::uint64_t imports_hash(const std::vector<std::uint64_t>& interface_hashes);
+// interface hash of a module that is not cached, changes whenever its source or its imports change
+std::uint64_t uncached_interface_hash(const module_cache_key& key);
+
+// whether there is an entry for this source, it is only used if the imports match, too
+// (the source doesn't have to be parsed if they do)
+bool has_module_cache(const char* path, std::uint64_t content_hash, std::uint64_t source_size);
+
+struct cached_module
+{
+    module loaded;
+    std::uint64_t interface_hash;
+};
+
+// imported_modules are the modules of the import statements, in order
+// returns none if there is no usable entry
+boost::optional<cached_module> read_module_cache(const char* path, const module_cache_key& key, std::size_t file_id,
+        const std::vector<const module*>& imported_modules);
+
+// m has to be the result of evaluating the module with file_id, that didn't add to the runtime module
+// returns the interface hash of m, or none if it can't be cached (see above) or the entry couldn't be written
+boost::optional<std::uint64_t> write_module_cache(const char* path, const module_cache_key& key, std::size_t file_id,
+        const module& m, const std::vector<const module*>& imported_modules);
+
+#endif
+
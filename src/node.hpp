@@ -3,17 +3,23 @@
 
 #include "node_source.hpp"
 #include "dynamic_graph.hpp"
+#include "identifier.hpp"
+#include "integer_literal.hpp"
 
 #include <mblib/range.hpp>
 #include <mblib/functor.hpp>
 
 #include <cstddef>
+#include <cstdint>
 #include <cassert>
 #include <vector>
 #include <initializer_list>
 #include <memory>
 #include <iterator>
 #include <functional>
+#include <atomic>
+
+struct node_layout;
 
 enum class node_type
 {
@@ -102,6 +108,7 @@ private:
     friend class list_node;
     friend class macro_node;
     friend class proc_node;
+    friend struct node_layout;
 
     node(node_type nt)
       : nt_(nt)
@@ -141,9 +148,14 @@ public:
     static constexpr node_type type_id = node_type::LITERAL;
 
     lit_node(char* begin, char* end)
+      : lit_node(begin, end, lit_integer{lit_integer::NOT_DECODED, 0})
+    {}
+    // integer has to be NOT_DECODED or decode_integer(begin, end)
+    lit_node(char* begin, char* end, lit_integer integer)
       : node(type_id),
         begin_(begin),
-        end_(end)
+        end_(end),
+        integer_(integer)
     {}
     
     typedef char* iterator;
@@ -155,9 +167,24 @@ public:
     {
         return end_;
     }
+
+    // literals from the parser and the ast cache are decoded when they are created, others on each call
+    lit_integer integer() const
+    {
+        if(integer_.status == lit_integer::NOT_DECODED)
+            return decode_integer(begin_, end_);
+        return integer_;
+    }
+    // has to be called after modifying the characters in place
+    void reset_integer()
+    {
+        integer_ = lit_integer{lit_integer::NOT_DECODED, 0};
+    }
 private:
+    friend struct node_layout;
     char* begin_;
     char* end_;
+    lit_integer integer_;
 };
 
 class ref_node
@@ -167,9 +194,14 @@ public:
     static constexpr node_type type_id = node_type::REFERENCE;
     
     ref_node(char* begin, char* end, node* new_refered)
+      : ref_node(begin, end, ::identifier_id(begin, end), new_refered)
+    {}
+    // id has to be the identifier_id of [begin, end)
+    ref_node(char* begin, char* end, identifier_id_t id, node* new_refered)
       : node(type_id),
         begin_(begin),
         end_(end),
+        id_(id),
         refered_(new_refered)
     {}
     
@@ -177,6 +209,10 @@ public:
     {
         return rangeify(begin_, end_);
     }
+    identifier_id_t identifier_id() const
+    {
+        return id_;
+    }
     const node* refered() const
     {
         return refered_;
@@ -186,8 +222,10 @@ public:
         refered_ = new_refered;
     }
 private:
+    friend struct node_layout;
     char* begin_;
     char* end_;
+    identifier_id_t id_;
     const node* refered_;
 };
 
@@ -262,12 +300,29 @@ public:
         return const_cast<list_node&>(*this)[index];
     }
 private:
+    friend class dynamic_graph;
+    friend struct node_layout;
+
     node** begin_;
     node** end_;
 };
 
 typedef decltype(rangeify(std::declval<const list_node>())) node_range;
 
+class macro_cache;
+
+// JIT compiled macros, called through the runtime functions in macro_execution.cpp
+typedef std::uint8_t* node_ptr;
+typedef node_ptr macro_function(node_ptr);
+
+enum class macro_kind
+{
+    // implemented in C++ (like the macros of the core module), always called through function()
+    NATIVE,
+    // called directly once compiled_code() is set, through function() before (e.g. while interpreted)
+    COMPILED
+};
+
 class macro_node
   : public node
 {
@@ -276,25 +331,68 @@ public:
 
     typedef std::pair<node&, dynamic_graph> macro(node_range);
 
-    std::pair<node&, dynamic_graph> operator()(decltype(rangeify(std::declval<const list_node>())) r) const
-    {
-        return (*func_)(std::move(r));
-    }
+    // defined in macro_cache.cpp
+    std::pair<node&, dynamic_graph> operator()(node_range r) const;
+
     macro_node(std::shared_ptr<std::function<macro>> function)
       : node(type_id),
         func_(std::move(function))
     {}
+    // code has to live as long as function, which sets it when the macro is compiled
+    macro_node(std::shared_ptr<std::function<macro>> function, const std::atomic<macro_function*>* code)
+      : node(type_id),
+        func_(std::move(function)),
+        kind_(macro_kind::COMPILED),
+        code_(code)
+    {}
+
+    macro_kind kind() const
+    {
+        return kind_;
+    }
+    // nullptr until the macro is compiled, and for native macros
+    macro_function* compiled_code() const
+    {
+        if(kind_ != macro_kind::COMPILED)
+            return nullptr;
+        return code_->load(std::memory_order_acquire);
+    }
 
-    const std::shared_ptr<std::function<macro>>& function()
+    const std::shared_ptr<std::function<macro>>& function() const
     {
         return func_;
     }
+    // makes the macro native
     void function(std::shared_ptr<std::function<macro>> new_func)
     {
         func_ = std::move(new_func);
+        kind_ = macro_kind::NATIVE;
+        code_ = nullptr;
+    }
+    // results are looked up in (and added to) the cache if there is one, copies of the node share it
+    const std::shared_ptr<macro_cache>& cache() const
+    {
+        return cache_;
+    }
+    void cache(std::shared_ptr<macro_cache> new_cache)
+    {
+        cache_ = std::move(new_cache);
+    }
+    // calling a macro with side effects (like unique) makes the results of enclosing cached macros uncacheable
+    bool has_side_effects() const
+    {
+        return has_side_effects_;
+    }
+    void has_side_effects(bool new_value)
+    {
+        has_side_effects_ = new_value;
     }
 private:
     std::shared_ptr<std::function<macro>> func_;
+    std::shared_ptr<macro_cache> cache_;
+    bool has_side_effects_ = false;
+    macro_kind kind_ = macro_kind::NATIVE;
+    const std::atomic<macro_function*>* code_ = nullptr;
 };
 
 namespace llvm
@@ -421,7 +519,7 @@ inline bool structurally_equal(const node& lhs, const node& rhs)
     {
         const ref_node& lhs_ref = lhs.cast<ref_node>();
         const ref_node& rhs_ref = rhs.cast<ref_node>();
-        if(lhs_ref.identifier() != rhs_ref.identifier())
+        if(lhs_ref.identifier_id() != rhs_ref.identifier_id())
             return false;
         if(lhs_ref.refered() == nullptr || rhs_ref.refered() == nullptr)
             return lhs_ref.refered() == rhs_ref.refered();
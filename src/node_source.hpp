@@ -4,18 +4,17 @@
 #include <boost/variant.hpp>
 
 #include <cstddef>
+#include <cstdint>
 
-struct file_position
-{
-    std::size_t line;
-    std::size_t line_pos;
-};
+// byte offset into a source file
+// lines and columns are only computed for printing (see line_table.hpp)
+typedef std::uint32_t file_offset;
 
 struct file_source
 {
-    file_position begin;
-    file_position end;
-    size_t file_id;
+    file_offset begin;
+    file_offset end;
+    std::uint32_t file_id;
 };
 
 typedef boost::variant<boost::blank, file_source> node_source;
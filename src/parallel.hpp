@@ -0,0 +1,218 @@
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include <limits>
+
+inline std::size_t worker_count()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// calls functor(index) for every index in [0, count), distributed over up to worker_count() threads
+// if calls throw, the exception of the lowest index is rethrown after all threads are done,
+// indices above a failed one may be skipped
+template<class Functor>
+void parallel_for(std::size_t count, Functor&& functor)
+{
+    std::atomic<std::size_t> next_index{0};
+    std::atomic<std::size_t> failed_index{std::numeric_limits<std::size_t>::max()};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    auto work = [&]
+    {
+        for(std::size_t index = next_index++; index < count; index = next_index++)
+        {
+            if(index > failed_index)
+                continue;
+            try
+            {
+                functor(index);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock{failure_mutex};
+                if(index < failed_index)
+                {
+                    failed_index = index;
+                    failure = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::size_t thread_count = std::min(worker_count(), count);
+    std::vector<std::thread> threads;
+    for(std::size_t i = 1; i < thread_count; ++i)
+        threads.emplace_back(work);
+    work(); // the calling thread is a worker, too
+    for(std::thread& t : threads)
+        t.join();
+
+    if(failure)
+        std::rethrow_exception(failure);
+}
+
+// calls functor(index) for every node of an acyclic graph, after the calls for all of dependencies[index] have returned
+// ready nodes are run by up to worker_count() threads: every thread has a queue of the nodes it made ready
+// and runs the most recent one, threads without work steal the oldest node of another queue
+// if calls throw, the nodes depending on a failed one are skipped, the others still run,
+// the exception of the lowest failed index is rethrown after all threads are done
+template<class Functor>
+void parallel_for_dag(const std::vector<std::vector<std::size_t>>& dependencies, Functor&& functor)
+{
+    std::size_t count = dependencies.size();
+    if(count == 0)
+        return;
+
+    std::vector<std::vector<std::size_t>> dependents(count);
+    std::unique_ptr<std::atomic<std::size_t>[]> remaining{new std::atomic<std::size_t>[count]};
+    std::unique_ptr<std::atomic<bool>[]> skipped{new std::atomic<bool>[count]};
+    for(std::size_t index = 0; index != count; ++index)
+    {
+        remaining[index] = dependencies[index].size();
+        skipped[index] = false;
+        for(std::size_t dependency : dependencies[index])
+            dependents[dependency].push_back(index);
+    }
+
+    struct work_queue
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> indices;
+    };
+    std::size_t thread_count = std::min(worker_count(), count);
+    std::vector<work_queue> queues(thread_count);
+    // counted before a node is queued, so it doesn't drop below the number of queued nodes
+    std::atomic<std::size_t> queued{0};
+    std::atomic<std::size_t> finished{0};
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+
+    std::size_t failed_index = std::numeric_limits<std::size_t>::max();
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    for(std::size_t index = 0, worker = 0; index != count; ++index)
+    {
+        if(remaining[index] != 0)
+            continue;
+        ++queued;
+        queues[worker].indices.push_back(index);
+        worker = (worker + 1) % thread_count;
+    }
+
+    auto push = [&](std::size_t worker, std::size_t index)
+    {
+        ++queued;
+        {
+            std::lock_guard<std::mutex> lock{queues[worker].mutex};
+            queues[worker].indices.push_back(index);
+        }
+        {
+            std::lock_guard<std::mutex> lock{idle_mutex};
+        }
+        idle.notify_one();
+    };
+    auto pop = [&](std::size_t worker, std::size_t& index)
+    {
+        for(std::size_t i = 0; i != thread_count; ++i)
+        {
+            work_queue& queue = queues[(worker + i) % thread_count];
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            if(queue.indices.empty())
+                continue;
+            if(i == 0)
+            {
+                index = queue.indices.back();
+                queue.indices.pop_back();
+            }
+            else
+            {
+                index = queue.indices.front();
+                queue.indices.pop_front();
+            }
+            --queued;
+            return true;
+        }
+        return false;
+    };
+    auto complete = [&](std::size_t worker, std::size_t index, bool failed)
+    {
+        for(std::size_t dependent : dependents[index])
+        {
+            if(failed)
+                skipped[dependent] = true;
+            if(--remaining[dependent] == 0)
+                push(worker, dependent);
+        }
+        if(++finished == count)
+        {
+            {
+                std::lock_guard<std::mutex> lock{idle_mutex};
+            }
+            idle.notify_all();
+        }
+    };
+
+    auto work = [&](std::size_t worker)
+    {
+        while(true)
+        {
+            std::size_t index;
+            if(!pop(worker, index))
+            {
+                std::unique_lock<std::mutex> lock{idle_mutex};
+                idle.wait(lock, [&]
+                {
+                    return queued != 0 || finished == count;
+                });
+                if(finished == count)
+                    return;
+                continue;
+            }
+
+            bool failed = skipped[index];
+            if(!failed)
+            {
+                try
+                {
+                    functor(index);
+                }
+                catch(...)
+                {
+                    failed = true;
+                    std::lock_guard<std::mutex> lock{failure_mutex};
+                    if(index < failed_index)
+                    {
+                        failed_index = index;
+                        failure = std::current_exception();
+                    }
+                }
+            }
+            complete(worker, index, failed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(std::size_t worker = 1; worker < thread_count; ++worker)
+        threads.emplace_back(work, worker);
+    work(0); // the calling thread is a worker, too
+    for(std::thread& t : threads)
+        t.join();
+
+    if(failure)
+        std::rethrow_exception(failure);
+}
+
+#endif
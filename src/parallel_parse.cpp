@@ -0,0 +1,126 @@
+#include "parallel_parse.hpp"
+
+#include "parse_state.hpp"
+#include "parse.hpp"
+#include "parallel.hpp"
+#include "scan.hpp"
+#include "error/parse_error.hpp"
+
+#include <utility>
+#include <algorithm>
+
+using std::vector;
+using std::size_t;
+using std::move;
+using std::find_if;
+using std::min;
+
+using namespace parse_error;
+
+vector<const char*> top_level_ends(const char* begin, const char* end)
+{
+    vector<const char*> result;
+    size_t depth = 0;
+    for(const char* pos = begin; pos != end; ++pos)
+    {
+        switch(*pos)
+        {
+        case '#':
+            pos = scan::find_newline(pos, end);
+            if(pos == end)
+                return result;
+            break;
+        case '"':
+            pos = find_if(pos + 1, end, [](char c)
+            {
+                return c == '"' || c == '\n' || c == '#';
+            });
+            if(pos == end || *pos != '"')
+                return {};
+            break;
+        case '{':
+        case '(':
+            ++depth;
+            break;
+        case '}':
+        case ')':
+            if(depth == 0)
+                return {};
+            --depth;
+            break;
+        case ';':
+            if(depth == 0)
+                result.push_back(pos + 1);
+            break;
+        }
+    }
+    if(depth != 0)
+        return {};
+    return result;
+}
+
+namespace
+{
+
+struct parsed_chunk
+{
+    dynamic_graph graph;
+    vector<node*> lists;
+    file_offset begin_position;
+    file_offset end_position;
+};
+
+}
+
+list_node& parse_file_parallel(const char* begin, const char* end, size_t file_id, dynamic_graph& graph,
+        size_t chunk_count)
+{
+    vector<const char*> ends = top_level_ends(begin, end);
+    if(ends.size() < 2 || chunk_count < 2)
+    {
+        parse_state<const char*> state{begin, end, file_id, graph};
+        return parse_file(state);
+    }
+
+    // group the statements into chunks of about the same size
+    vector<const char*> chunk_begins{begin};
+    size_t chunk_size = (end - begin) / chunk_count + 1;
+    for(const char* statement_end : ends)
+    {
+        if(statement_end != end && statement_end - chunk_begins.back() >= static_cast<std::ptrdiff_t>(chunk_size))
+            chunk_begins.push_back(statement_end);
+    }
+    // every chunk starts right behind a top level ';', where parse_file is in the same state
+    // as at the beginning of a file, so parsing them separately gives the same nodes
+    vector<parsed_chunk> chunks(chunk_begins.size());
+    parallel_for(chunks.size(), [&](size_t index)
+    {
+        const char* chunk_end = index + 1 == chunk_begins.size() ? end : chunk_begins[index + 1];
+        parsed_chunk& chunk = chunks[index];
+        parse_state<const char*> state{chunk_begins[index], chunk_end,
+            static_cast<file_offset>(chunk_begins[index] - begin), file_id, chunk.graph};
+
+        chunk.begin_position = state.position();
+        whitespace(state);
+        while(node* next_list = parse_semicolon_list(state))
+        {
+            chunk.lists.push_back(next_list);
+            whitespace(state);
+        }
+        if(!state.empty())
+            fatal<id("invalid_character")>(code_location{state.position(), state.file()});
+        chunk.end_position = state.position();
+    });
+
+    vector<node*> top_level_lists;
+    for(parsed_chunk& chunk : chunks)
+    {
+        top_level_lists.insert(top_level_lists.end(), chunk.lists.begin(), chunk.lists.end());
+        graph.add(move(chunk.graph));
+    }
+    list_node& result = graph.create_list(move(top_level_lists));
+    result.source(file_source{chunks.front().begin_position, chunks.back().end_position,
+            static_cast<std::uint32_t>(file_id)});
+    return result;
+}
+
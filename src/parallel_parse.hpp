@@ -0,0 +1,26 @@
+#ifndef PARALLEL_PARSE_HPP_
+#define PARALLEL_PARSE_HPP_
+
+#include "node.hpp"
+#include "node_source.hpp"
+#include "dynamic_graph.hpp"
+
+#include <vector>
+#include <cstddef>
+
+// files at least this large are split for parsing
+constexpr std::size_t parallel_parse_min_size = 1 << 20;
+
+// positions right behind every top level ';' in [begin, end), in order
+// a ';' is top level if it is not inside of braces, a string or a comment
+// returns nothing if braces are not balanced or a string is unterminated,
+// such files are left to the serial parser, which reports the error
+std::vector<const char*> top_level_ends(const char* begin, const char* end);
+
+// same result as parse_file on the whole of [begin, end) (including errors and source positions),
+// but parts between top level semicolons are parsed in parallel
+list_node& parse_file_parallel(const char* begin, const char* end, std::size_t file_id, dynamic_graph& graph,
+        std::size_t chunk_count);
+
+#endif
+
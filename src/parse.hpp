@@ -38,7 +38,7 @@ list_node* parse_semicolon_list(State& state)
     if(state.empty())
         return nullptr;
 
-    file_position begin = state.position();
+    file_offset begin = state.position();
     std::vector<node*> vec = parse_nodes(state);
 
     if(vec.empty())
@@ -73,7 +73,7 @@ list_node* parse_curly_list(State& state)
     if(state.empty() || state.front() != '{')
         return nullptr;
         
-    file_position begin = state.position();
+    file_offset begin = state.position();
     state.pop_front();
     std::vector<node*> top_level_nodes;
 
@@ -101,7 +101,7 @@ list_node* parse_round_list(State& state)
     if(state.empty() || state.front() != '(')
         return nullptr;
     
-    file_position begin = state.position();
+    file_offset begin = state.position();
     state.pop_front();
     whitespace(state);
     std::vector<node*> vec = parse_nodes(state);
@@ -139,7 +139,7 @@ list_node& parse_file(State& state)
 
     std::vector<node*> top_level_lists;
 
-    file_position begin = state.position();
+    file_offset begin = state.position();
     whitespace(state);
     while(node* next_list = parse_semicolon_list(state))
     {
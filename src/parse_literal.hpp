@@ -4,6 +4,8 @@
 #include "node.hpp"
 #include "error/parse_error.hpp"
 
+#include <algorithm>
+
 namespace parse_literal_detail
 {
 
@@ -14,6 +16,7 @@ inline bool is_digit(char c)
 
 }
 
+// string and digit literals are both decoded as integers here, once, instead of at every use as a constant
 template <class State>
 lit_node* parse_literal(State& state)
 {
@@ -24,45 +27,35 @@ lit_node* parse_literal(State& state)
         return nullptr;
     else if(state.front() == '"')
     {
-        file_position begin = state.position();
-        std::string str;
+        file_offset begin = state.position();
         
         state.pop_front();
-        while(true)
+        auto str_begin = state.begin();
+        // a '#' starts a comment which runs until the end of the line, so the quote is unmatched
+        auto str_end = std::find_if(str_begin, state.end(), [](char c)
         {
-            if(state.empty() || state.front() == '\n')
-                fatal<id("unmatched_quote")>(code_location{begin, state.file()});
-            if(state.front() == '"')
-                break;
-            else
-            {
-                str.push_back(state.front());
-                state.pop_front();
-            }
-        }
+            return c == '"' || c == '\n' || c == '#';
+        });
+        state.advance(str_end);
+        if(state.empty() || state.front() != '"')
+            fatal<id("unmatched_quote")>(code_location{begin, state.file()});
         
         state.pop_front();
         
-        file_position end = state.position();
-        lit_node& lit = state.graph().create_lit(std::move(str));
+        file_offset end = state.position();
+        lit_node& lit = state.graph().create_lit(str_begin, str_end, decode_integer(str_begin, str_end));
         lit.source(file_source{begin, end, state.file()});
         return &lit;
     }
     else if(is_digit(state.front()))
     {
-        file_position begin = state.position();
-        std::string str;
-        str.push_back(state.front());
-        
-        state.pop_front();
-        while(!state.empty() && is_digit(state.front()))
-        {
-            str.push_back(state.front());
-            state.pop_front();
-        }
-        file_position end = state.position();
+        file_offset begin = state.position();
+        auto str_begin = state.begin();
+        auto str_end = std::find_if_not(str_begin, state.end(), is_digit);
+        state.advance(str_end);
+        file_offset end = state.position();
 
-        lit_node& lit = state.graph().create_lit(std::move(str));
+        lit_node& lit = state.graph().create_lit(str_begin, str_end, decode_integer(str_begin, str_end));
         lit.source(file_source{begin, end, state.file()});
         return &lit;
     }
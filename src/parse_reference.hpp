@@ -2,6 +2,7 @@
 #define PARSE_REFERENCE_HPP_
 
 #include "node.hpp"
+#include "scan.hpp"
 
 #include <algorithm>
 
@@ -12,10 +13,6 @@ inline bool is_head_word_char(char c)
 {
     return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
 }
-inline bool is_tail_word_char(char c)
-{
-    return is_head_word_char(c) || ('0' <= c && c <= '9');
-}
 inline bool is_operator(char c)
 {
     static const char operators[] = "+-*^/%~<>=!|&.$";
@@ -33,34 +30,26 @@ ref_node* parse_reference(State& state)
         return nullptr;
     else if(is_head_word_char(state.front()))
     {
-        std::string identifier;
-        file_position begin = state.position();
-
-        while(!state.empty() && is_tail_word_char(state.front()))
-        {
-            identifier.push_back(state.front());
-            state.pop_front();
-        }
+        file_offset begin = state.position();
+        auto identifier_begin = state.begin();
+        auto identifier_end = scan::skip_word_chars(identifier_begin, state.end());
+        state.advance(identifier_end);
         
-        file_position end = state.position();
-        ref_node& ref = state.graph().create_ref(std::move(identifier));
+        file_offset end = state.position();
+        ref_node& ref = state.graph().create_ref(identifier_begin, identifier_end);
         ref.source(file_source{begin, end, state.file()});
         return &ref;
     }
     else if(is_operator(state.front()))
     {
-        std::string identifier;
-        file_position begin = state.position();
-
-        while(!state.empty() && is_operator(state.front()))
-        {
-            identifier.push_back(state.front());
-            state.pop_front();
-        }
+        file_offset begin = state.position();
+        auto identifier_begin = state.begin();
+        auto identifier_end = std::find_if_not(identifier_begin, state.end(), is_operator);
+        state.advance(identifier_end);
 
-        file_position end = state.position();
+        file_offset end = state.position();
 
-        ref_node& ref = state.graph().create_ref(std::move(identifier));
+        ref_node& ref = state.graph().create_ref(identifier_begin, identifier_end);
         ref.source(file_source{begin, end, state.file()});
         return &ref;
     }
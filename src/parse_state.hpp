@@ -3,29 +3,37 @@
 
 #include "dynamic_graph.hpp"
 #include "node_source.hpp"
+#include "scan.hpp"
 
 #include <string>
 #include <cassert>
 #include <iostream>
 #include <exception>
+#include <cstdint>
 
 template<class Iterator>
 class parse_state
 {
 private:
-    Iterator pos;
-    Iterator end;
+    Iterator begin_;
+    Iterator pos_;
+    Iterator end_;
     
-    file_position file_pos;
-    size_t file_id;
+    file_offset begin_offset;
+    std::uint32_t file_id;
 
     dynamic_graph& graph_;
 public:
     parse_state(Iterator begin, Iterator end, size_t file_id, dynamic_graph& graph)
-      : pos{begin},
-        end{end},
-        file_pos{0, 0},
-        file_id{file_id},
+      : parse_state{begin, end, 0, file_id, graph}
+    {}
+    // for parsing a part of a file that starts at begin_offset
+    parse_state(Iterator begin, Iterator end, file_offset begin_offset, size_t file_id, dynamic_graph& graph)
+      : begin_{begin},
+        pos_{begin},
+        end_{end},
+        begin_offset{begin_offset},
+        file_id(file_id),
         graph_(graph)
     {
         skip_comment();
@@ -33,26 +41,45 @@ public:
     
     bool empty() const
     {
-        return pos == end;
+        return pos_ == end_;
     }
 
     char front() const
     {
         assert(!empty());
-        return *pos;
+        return *pos_;
     }
     void pop_front()
     {
         assert(!empty());
-        pop_front_no_comment_skip();
+        ++pos_;
+        skip_comment();
+    }
+    // same as calling pop_front until begin() == new_begin
+    // [begin(), new_begin) must not contain a comment
+    void advance(Iterator new_begin)
+    {
+        assert(begin() <= new_begin && new_begin <= end());
+        pos_ = new_begin;
         skip_comment();
     }
     
-    const file_position& position() const
+    // the remaining input
+    // nodes refer to the input directly, so it has to be contiguous
+    Iterator begin() const
+    {
+        return pos_;
+    }
+    Iterator end() const
     {
-        return file_pos;
+        return end_;
     }
-    size_t file() const
+
+    file_offset position() const
+    {
+        return begin_offset + static_cast<file_offset>(pos_ - begin_);
+    }
+    std::uint32_t file() const
     {
         return file_id;
     }
@@ -63,28 +90,10 @@ public:
     }
 
 private:
-    // pop_front but don't check whether to skip because of a comment
-    void pop_front_no_comment_skip()
-    {
-        if(front() == '\n')
-        {
-            file_pos.line_pos = 0;
-            ++file_pos.line;
-        }
-        else
-        {
-            ++file_pos.line_pos;
-        }
-        
-        ++pos;
-    }
     void skip_comment()
     {
         if(!empty() && front() == '#')
-        {
-            while(!empty() && front() != '\n')
-                pop_front_no_comment_skip();
-        }
+            pos_ = scan::find_newline(pos_, end_);
     }
 };
 
@@ -38,10 +38,13 @@ struct print_location_visitor
 {
     ostream& os;
     const function<string (size_t)>& file_id_to_name;
+    const function<const line_table* (size_t)>& file_id_to_lines;
     
-    print_location_visitor(ostream& os, const function<string (size_t)>& file_id_to_name)
+    print_location_visitor(ostream& os, const function<string (size_t)>& file_id_to_name,
+            const function<const line_table* (size_t)>& file_id_to_lines)
       : os(os),
-        file_id_to_name(file_id_to_name)
+        file_id_to_name(file_id_to_name),
+        file_id_to_lines(file_id_to_lines)
     {}
 
     void operator()(const blank&)
@@ -50,14 +53,23 @@ struct print_location_visitor
     }
     void operator()(const code_location& loc)
     {
-        os << file_id_to_name(loc.file_id) << ":" << (loc.pos.line + 1) << ":" << (loc.pos.line_pos + 1);
+        os << file_id_to_name(loc.file_id);
+        const line_table* lines = file_id_to_lines ? file_id_to_lines(loc.file_id) : nullptr;
+        if(lines)
+        {
+            file_position pos = lines->position(loc.pos);
+            os << ":" << (pos.line + 1) << ":" << (pos.line_pos + 1);
+        }
+        else
+            os << ":+" << loc.pos;
     }
 };
 
 
-ostream& print_error_location(ostream& os, const error_location& loc, const function<string (size_t)>& file_id_to_name)
+ostream& print_error_location(ostream& os, const error_location& loc, const function<string (size_t)>& file_id_to_name,
+        const function<const line_table* (size_t)>& file_id_to_lines)
 {
-    print_location_visitor visitor(os, file_id_to_name);
+    print_location_visitor visitor(os, file_id_to_name, file_id_to_lines);
     apply_visitor(visitor, loc);
     return os;
 }
@@ -128,7 +140,8 @@ string format(const string& format_string, const vector<error_parameter>& parame
     return stream.str();
 }
 
-void print(ostream& os, const compile_exception& exc, function<string (size_t)> file_id_to_name)
+void print(ostream& os, const compile_exception& exc, function<string (size_t)> file_id_to_name,
+        function<const line_table* (size_t)> file_id_to_lines)
 {
     const char* error_name;
     const char* error_message_template;
@@ -199,7 +212,7 @@ void print(ostream& os, const compile_exception& exc, function<string (size_t)>
         break;
     }
     }
-    print_error_location(os, exc.location, file_id_to_name);
+    print_error_location(os, exc.location, file_id_to_name, file_id_to_lines);
     if(error_message_template != string{""})
         os << ": " << format(error_message_template, exc.params) << "\n";
     else
@@ -209,7 +222,7 @@ void print(ostream& os, const compile_exception& exc, function<string (size_t)>
 ostream& operator<<(ostream& os, const compile_exception& exc)
 {
     auto file_id_to_name = [](size_t){return "";};
-    print(os, exc, file_id_to_name);
+    print(os, exc, file_id_to_name, nullptr);
 
     return os;
 }
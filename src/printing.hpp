@@ -8,8 +8,13 @@
 #include "error/compile_exception.hpp"
 #include "compilation_context.hpp"
 #include "node.hpp"
+#include "line_table.hpp"
 
-void print(std::ostream& os, const compile_exception& exc, std::function<std::string (std::size_t)> file_id_to_name);
+// file_id_to_lines is only called if the location of exc has to be printed
+// it returns nullptr if the lines of a file are not known, the location is printed as byte offset then
+void print(std::ostream& os, const compile_exception& exc, std::function<std::string (std::size_t)> file_id_to_name,
+        std::function<const line_table* (std::size_t)> file_id_to_lines);
+// without line tables, locations are printed as byte offsets
 std::ostream& operator<<(std::ostream& os, const compile_exception& exc);
 
 std::ostream& operator<<(std::ostream& os, const node& s);
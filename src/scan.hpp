@@ -0,0 +1,242 @@
+#ifndef SCAN_HPP_
+#define SCAN_HPP_
+
+// scanners skipping whole runs of characters for the parser
+// SSE2/AVX2 versions are chosen at compile time, the scalar versions are the fallback
+// (and the reference for testing)
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace scan_detail
+{
+
+inline bool is_whitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+inline bool is_word_char(char c)
+{
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_';
+}
+
+namespace scalar
+{
+
+inline const char* skip_whitespace(const char* begin, const char* end)
+{
+    while(begin != end && is_whitespace(*begin))
+        ++begin;
+    return begin;
+}
+inline const char* skip_word_chars(const char* begin, const char* end)
+{
+    while(begin != end && is_word_char(*begin))
+        ++begin;
+    return begin;
+}
+inline const char* find_newline(const char* begin, const char* end)
+{
+    while(begin != end && *begin != '\n')
+        ++begin;
+    return begin;
+}
+inline std::size_t count_newlines(const char* begin, const char* end)
+{
+    std::size_t count = 0;
+    for( ; begin != end; ++begin)
+        count += *begin == '\n';
+    return count;
+}
+
+}
+
+#if defined(__AVX2__)
+
+typedef __m256i vector_t;
+constexpr std::size_t vector_size = 32;
+
+inline vector_t load(const char* pos)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const vector_t*>(pos));
+}
+inline vector_t broadcast(char c)
+{
+    return _mm256_set1_epi8(c);
+}
+inline vector_t equal(vector_t lhs, vector_t rhs)
+{
+    return _mm256_cmpeq_epi8(lhs, rhs);
+}
+inline vector_t greater(vector_t lhs, vector_t rhs)
+{
+    return _mm256_cmpgt_epi8(lhs, rhs);
+}
+inline vector_t either(vector_t lhs, vector_t rhs)
+{
+    return _mm256_or_si256(lhs, rhs);
+}
+inline vector_t both(vector_t lhs, vector_t rhs)
+{
+    return _mm256_and_si256(lhs, rhs);
+}
+inline std::uint32_t mask(vector_t v)
+{
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+}
+constexpr std::uint32_t full_mask = 0xffffffffu;
+
+#define SCAN_HAS_VECTOR_IMPLEMENTATION
+
+#elif defined(__SSE2__)
+
+typedef __m128i vector_t;
+constexpr std::size_t vector_size = 16;
+
+inline vector_t load(const char* pos)
+{
+    return _mm_loadu_si128(reinterpret_cast<const vector_t*>(pos));
+}
+inline vector_t broadcast(char c)
+{
+    return _mm_set1_epi8(c);
+}
+inline vector_t equal(vector_t lhs, vector_t rhs)
+{
+    return _mm_cmpeq_epi8(lhs, rhs);
+}
+inline vector_t greater(vector_t lhs, vector_t rhs)
+{
+    return _mm_cmpgt_epi8(lhs, rhs);
+}
+inline vector_t either(vector_t lhs, vector_t rhs)
+{
+    return _mm_or_si128(lhs, rhs);
+}
+inline vector_t both(vector_t lhs, vector_t rhs)
+{
+    return _mm_and_si128(lhs, rhs);
+}
+inline std::uint32_t mask(vector_t v)
+{
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+}
+constexpr std::uint32_t full_mask = 0xffffu;
+
+#define SCAN_HAS_VECTOR_IMPLEMENTATION
+
+#endif
+
+#ifdef SCAN_HAS_VECTOR_IMPLEMENTATION
+
+// bytes are compared as signed chars: non-ASCII bytes are negative and fall out of every range
+inline vector_t in_range(vector_t chars, char lowest, char highest)
+{
+    return both(greater(chars, broadcast(lowest - 1)), greater(broadcast(highest + 1), chars));
+}
+
+inline vector_t whitespace_mask(vector_t chars)
+{
+    return either(either(equal(chars, broadcast(' ')), equal(chars, broadcast('\t'))), equal(chars, broadcast('\n')));
+}
+inline vector_t word_char_mask(vector_t chars)
+{
+    // setting bit 5 maps upper case letters onto lower case ones (and nothing else onto them)
+    vector_t folded = either(chars, broadcast(0x20));
+    vector_t letters = in_range(folded, 'a', 'z');
+    vector_t digits = in_range(chars, '0', '9');
+    vector_t underscores = equal(chars, broadcast('_'));
+    return either(either(letters, digits), underscores);
+}
+inline vector_t newline_mask(vector_t chars)
+{
+    return equal(chars, broadcast('\n'));
+}
+
+// first position at which stop_mask has a bit set
+template<class StopMaskFunctor, class ScalarFunctor>
+const char* find_first(const char* begin, const char* end, StopMaskFunctor&& stop_mask, ScalarFunctor&& scalar_fallback)
+{
+    while(static_cast<std::size_t>(end - begin) >= vector_size)
+    {
+        std::uint32_t stops = stop_mask(load(begin));
+        if(stops != 0)
+            return begin + __builtin_ctz(stops);
+        begin += vector_size;
+    }
+    return scalar_fallback(begin, end);
+}
+
+#endif
+
+}
+
+namespace scan
+{
+
+inline const char* skip_whitespace(const char* begin, const char* end)
+{
+    using namespace scan_detail;
+#ifdef SCAN_HAS_VECTOR_IMPLEMENTATION
+    return find_first(begin, end, [](vector_t chars)
+    {
+        return ~mask(whitespace_mask(chars)) & full_mask;
+    }, scalar::skip_whitespace);
+#else
+    return scalar::skip_whitespace(begin, end);
+#endif
+}
+
+inline const char* skip_word_chars(const char* begin, const char* end)
+{
+    using namespace scan_detail;
+#ifdef SCAN_HAS_VECTOR_IMPLEMENTATION
+    return find_first(begin, end, [](vector_t chars)
+    {
+        return ~mask(word_char_mask(chars)) & full_mask;
+    }, scalar::skip_word_chars);
+#else
+    return scalar::skip_word_chars(begin, end);
+#endif
+}
+
+// used to skip comment bodies
+inline const char* find_newline(const char* begin, const char* end)
+{
+    using namespace scan_detail;
+#ifdef SCAN_HAS_VECTOR_IMPLEMENTATION
+    return find_first(begin, end, [](vector_t chars)
+    {
+        return mask(newline_mask(chars));
+    }, scalar::find_newline);
+#else
+    return scalar::find_newline(begin, end);
+#endif
+}
+
+inline std::size_t count_newlines(const char* begin, const char* end)
+{
+    using namespace scan_detail;
+#ifdef SCAN_HAS_VECTOR_IMPLEMENTATION
+    std::size_t count = 0;
+    while(static_cast<std::size_t>(end - begin) >= vector_size)
+    {
+        count += __builtin_popcount(mask(newline_mask(load(begin))));
+        begin += vector_size;
+    }
+    return count + scalar::count_newlines(begin, end);
+#else
+    return scalar::count_newlines(begin, end);
+#endif
+}
+
+}
+
+#endif
+
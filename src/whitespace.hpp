@@ -1,6 +1,8 @@
 #ifndef WHITESPACE_HPP_
 #define WHITESPACE_HPP_
 
+#include "scan.hpp"
+
 namespace whitespace_detail
 {
 
@@ -20,9 +22,10 @@ bool whitespace(State& state)
         return false;
     else
     {
-        state.pop_front();
-        while(!state.empty() && is_whitespace(state.front()))
-            state.pop_front();
+        // a skipped comment ends on a newline, so keep going after it
+        do
+            state.advance(scan::skip_whitespace(state.begin(), state.end()));
+        while(!state.empty() && is_whitespace(state.front()));
         return true;
     }
 }
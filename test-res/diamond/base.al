@@ -0,0 +1,11 @@
+import (proc int return unique) from "core";
+export base_id base_proc;
+
+def base_id unique;
+def base_proc proc ((a (int 64))) (int 64)
+{
+	block1
+	{
+		(return (int 64)) a;
+	};
+};
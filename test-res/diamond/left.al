@@ -0,0 +1,12 @@
+import (proc int return unique) from "core";
+import (base_id) from "base";
+export left_id left_proc base_id;
+
+def left_id unique;
+def left_proc proc ((a (int 64)) (b (int 64))) (int 64)
+{
+	block1
+	{
+		(return (int 64)) a;
+	};
+};
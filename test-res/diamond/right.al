@@ -0,0 +1,12 @@
+import (proc int return unique) from "core";
+import (base_id) from "base";
+export right_id right_proc;
+
+def right_id unique;
+def right_proc proc ((a (int 64)) (b (int 64)) (c (int 64))) (int 64)
+{
+	block1
+	{
+		(return (int 64)) a;
+	};
+};
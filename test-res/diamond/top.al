@@ -0,0 +1,13 @@
+import (proc int return unique) from "core";
+import (left_id) from "left";
+import (right_id) from "right";
+export top_id top_proc;
+
+def top_id unique;
+def top_proc proc ((a (int 64)) (b (int 64)) (c (int 64)) (d (int 64))) (int 64)
+{
+	block1
+	{
+		(return (int 64)) a;
+	};
+};
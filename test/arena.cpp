@@ -0,0 +1,112 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE arena
+#include <boost/test/unit_test.hpp>
+
+#include "../src/arena.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using std::vector;
+using std::uintptr_t;
+using std::size_t;
+
+BOOST_AUTO_TEST_CASE(allocate_test)
+{
+    arena memory;
+    BOOST_CHECK_EQUAL(memory.chunk_count(), 0);
+
+    vector<char*> allocations;
+    for(size_t i = 0; i != 1000; ++i)
+    {
+        size_t alignment = size_t{1} << (i % 5);
+        char* p = static_cast<char*>(memory.allocate(i % 13 + 1, alignment));
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % alignment, 0);
+        for(size_t j = 0; j != i % 13 + 1; ++j)
+            p[j] = static_cast<char>(i);
+        allocations.push_back(p);
+    }
+    for(size_t i = 0; i != 1000; ++i)
+        BOOST_CHECK_EQUAL(allocations[i][i % 13], static_cast<char>(i));
+
+    // a big allocation gets a chunk of its own, the current chunk is still used afterwards
+    size_t chunks = memory.chunk_count();
+    char* big = static_cast<char*>(memory.allocate(size_t{1} << 22, 8));
+    big[(size_t{1} << 22) - 1] = 'x';
+    BOOST_CHECK_EQUAL(memory.chunk_count(), chunks + 1);
+    memory.allocate(1, 1);
+    BOOST_CHECK_EQUAL(memory.chunk_count(), chunks + 1);
+}
+
+BOOST_AUTO_TEST_CASE(finalizer_test)
+{
+    size_t destroyed = 0;
+    auto destroy = [](void* counter)
+    {
+        ++*static_cast<size_t*>(counter);
+    };
+    {
+        arena memory;
+        memory.add_finalizer(destroy, &destroyed);
+        {
+            arena other;
+            other.add_finalizer(destroy, &destroyed);
+            other.add_finalizer(destroy, &destroyed);
+            memory.splice(other);
+            BOOST_CHECK_EQUAL(other.chunk_count(), 0);
+        }
+        BOOST_CHECK_EQUAL(destroyed, 0);
+
+        arena moved = std::move(memory);
+        BOOST_CHECK_EQUAL(destroyed, 0);
+    }
+    BOOST_CHECK_EQUAL(destroyed, 3);
+}
+
+BOOST_AUTO_TEST_CASE(splice_test)
+{
+    arena memory;
+    int& first = memory.create<int>(1);
+
+    arena other;
+    int& second = other.create<int>(2);
+    size_t other_chunks = other.chunk_count();
+    size_t chunks = memory.chunk_count();
+    memory.splice(other);
+    BOOST_CHECK_EQUAL(memory.chunk_count(), chunks + other_chunks);
+
+    // allocation continues in the first chunk
+    memory.create<int>(3);
+    BOOST_CHECK_EQUAL(memory.chunk_count(), chunks + other_chunks);
+    BOOST_CHECK_EQUAL(first, 1);
+    BOOST_CHECK_EQUAL(second, 2);
+
+    arena empty;
+    empty.splice(memory);
+    BOOST_CHECK_EQUAL(memory.chunk_count(), 0);
+    BOOST_CHECK_EQUAL(empty.chunk_count(), chunks + other_chunks);
+}
+
+
+BOOST_AUTO_TEST_CASE(chunk_ranges_test)
+{
+    arena memory;
+    BOOST_CHECK(memory.chunk_ranges().empty());
+
+    vector<char*> allocations;
+    for(size_t i = 0; i != 1000; ++i)
+        allocations.push_back(static_cast<char*>(memory.allocate(64, 8)));
+    auto ranges = memory.chunk_ranges();
+    BOOST_CHECK_EQUAL(ranges.size(), memory.chunk_count());
+    for(char* p : allocations)
+    {
+        size_t containing = 0;
+        for(const auto& range : ranges)
+        {
+            if(range.first <= p && p + 64 <= range.second)
+                ++containing;
+        }
+        BOOST_CHECK_EQUAL(containing, 1);
+    }
+}
@@ -0,0 +1,138 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ast_cache
+#include <boost/test/unit_test.hpp>
+
+#include "../src/ast_cache.hpp"
+#include "../src/parse.hpp"
+#include "../src/compile_unit.hpp"
+
+#include "state_utils.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <string>
+#include <fstream>
+
+using std::string;
+using std::size_t;
+using std::ofstream;
+using std::ios;
+
+using boost::filesystem::path;
+using boost::filesystem::temp_directory_path;
+using boost::filesystem::unique_path;
+using boost::filesystem::remove;
+using boost::filesystem::resize_file;
+using boost::filesystem::file_size;
+using boost::filesystem::exists;
+using boost::get;
+
+namespace
+{
+
+const string source = R"source(import (a b) from "mod";
+export c;
+# comment
+def c macro ((x (int 64))) (int 64)
+{
+    entry { (return_int64 1234); };
+};
+()"";
+)source";
+
+bool same_sources(const node& lhs, const node& rhs)
+{
+    const file_source& lhs_source = get<file_source>(lhs.source());
+    const file_source& rhs_source = get<file_source>(rhs.source());
+    if(lhs_source.begin != rhs_source.begin || lhs_source.end != rhs_source.end || lhs_source.file_id != rhs_source.file_id)
+        return false;
+    if(lhs.is<list_node>())
+    {
+        for(size_t i = 0; i != lhs.cast<list_node>().size(); ++i)
+        {
+            if(!same_sources(lhs.cast<list_node>()[i], rhs.cast<list_node>()[i]))
+                return false;
+        }
+    }
+    return true;
+}
+
+struct cache_file
+{
+    path p = temp_directory_path() / unique_path("%%%%-%%%%-%%%%.alc");
+    ~cache_file()
+    {
+        remove(p);
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(round_trip_test)
+{
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    state s{begin, end, default_file_id, create_graph()};
+    list_node& parsed = parse_file(s);
+
+    cache_file cache;
+    uint64_t hash = content_hash(begin, end);
+    BOOST_REQUIRE(write_ast_cache(cache.p.native().c_str(), hash, begin, end, parsed));
+
+    list_node* loaded = read_ast_cache(cache.p.native().c_str(), hash, begin, end, default_file_id, create_graph());
+    BOOST_REQUIRE(loaded);
+    BOOST_CHECK(structurally_equal(*loaded, parsed));
+    BOOST_CHECK(same_sources(*loaded, parsed));
+
+    // characters are the source's, literals are decoded
+    const list_node& def = (*loaded)[2].cast<list_node>();
+    BOOST_CHECK(&def[1].cast<ref_node>().identifier().front() == &parsed[2].cast<list_node>()[1].cast<ref_node>().identifier().front());
+    BOOST_CHECK_EQUAL(def[1].cast<ref_node>().identifier_id(), identifier_id("c"));
+}
+
+BOOST_AUTO_TEST_CASE(mismatch_test)
+{
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    state s{begin, end, default_file_id, create_graph()};
+    list_node& parsed = parse_file(s);
+
+    cache_file cache;
+    uint64_t hash = content_hash(begin, end);
+    BOOST_REQUIRE(write_ast_cache(cache.p.native().c_str(), hash, begin, end, parsed));
+
+    string changed = source;
+    changed[0] = 'x';
+    BOOST_CHECK(content_hash(changed.data(), changed.data() + changed.size()) != hash);
+    BOOST_CHECK(!read_ast_cache(cache.p.native().c_str(), hash + 1, begin, end, default_file_id, create_graph()));
+    BOOST_CHECK(!read_ast_cache(cache.p.native().c_str(), hash, begin, end - 1, default_file_id, create_graph()));
+
+    // truncated
+    resize_file(cache.p, file_size(cache.p) - 4);
+    BOOST_CHECK(!read_ast_cache(cache.p.native().c_str(), hash, begin, end, default_file_id, create_graph()));
+
+    // garbage
+    {
+        ofstream file{cache.p.native(), ios::binary | ios::trunc};
+        file << string(200, '\xff');
+    }
+    BOOST_CHECK(!read_ast_cache(cache.p.native().c_str(), hash, begin, end, default_file_id, create_graph()));
+
+    path missing = temp_directory_path() / unique_path("%%%%-%%%%-%%%%.alc");
+    BOOST_CHECK(!read_ast_cache(missing.native().c_str(), hash, begin, end, default_file_id, create_graph()));
+}
+
+BOOST_AUTO_TEST_CASE(read_file_uses_cache_test)
+{
+    path cache_path = "test-res/b/b.alc";
+    remove(cache_path);
+
+    parsed_file parsed = read_file(1, "test-res/b/b.al");
+    BOOST_CHECK(exists(cache_path));
+    parsed_file loaded = read_file(1, "test-res/b/b.al");
+    BOOST_CHECK(structurally_equal(loaded.syntax_tree, parsed.syntax_tree));
+    BOOST_CHECK(same_sources(loaded.syntax_tree, parsed.syntax_tree));
+    BOOST_CHECK_EQUAL(loaded.header.imports.size(), parsed.header.imports.size());
+    BOOST_CHECK_EQUAL(loaded.header.exports.size(), parsed.header.exports.size());
+}
+
@@ -0,0 +1,119 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE compact_graph
+#include <boost/test/unit_test.hpp>
+
+#include "graph_building.hpp"
+#include "../src/compact_graph.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+
+using std::string;
+using std::unordered_map;
+using std::make_shared;
+using std::function;
+
+BOOST_AUTO_TEST_CASE(compact_test)
+{
+    lit_node& shared = lit{"shared"};
+    list_node& target = list{lit{"target"}};
+    ref_node& r = ref{"r", &target};
+    list_node& root = list{id{7}, shared, list{r, shared}};
+    shared.source(file_source{3, 9, 1});
+
+    compact_graph graph{root};
+    BOOST_CHECK_EQUAL(graph.size(), 7);
+
+    // pre-order over lists, then the nodes only reachable through references
+    BOOST_CHECK(graph.is<list_node>(0));
+    BOOST_CHECK_EQUAL(graph.child_count(0), 3);
+    BOOST_CHECK(graph.is<id_node>(graph.child(0, 0)));
+    BOOST_CHECK_EQUAL(graph.id(graph.child(0, 0)), 7);
+    node_handle shared_handle = graph.child(0, 1);
+    BOOST_CHECK_EQUAL(string(graph.literal_begin(shared_handle), graph.literal_end(shared_handle)), "shared");
+    BOOST_CHECK_EQUAL(boost::get<file_source>(graph.source(shared_handle)).begin, 3);
+    BOOST_CHECK(graph.source(0).which() == 0);
+
+    node_handle inner = graph.child(0, 2);
+    BOOST_CHECK_EQUAL(inner, 3);
+    BOOST_CHECK_EQUAL(graph.child(inner, 1), shared_handle);
+    node_handle ref_handle = graph.child(inner, 0);
+    BOOST_CHECK_EQUAL(graph.identifier(ref_handle), "r");
+    BOOST_CHECK_EQUAL(graph.identifier_id(ref_handle), identifier_id("r"));
+    BOOST_CHECK_EQUAL(graph.refered(ref_handle), 5);
+    BOOST_CHECK(graph.is<list_node>(5));
+
+    auto p = graph.expand();
+    BOOST_CHECK(structurally_equal(p.first, root));
+    const list_node& expanded = p.first.cast<list_node>();
+    BOOST_CHECK_EQUAL(&expanded[1], &expanded[2].cast<list_node>()[1]);
+}
+
+BOOST_AUTO_TEST_CASE(clone_test)
+{
+    list_node& target = list{lit{"target"}, ref{"unresolved"}};
+    list_node& root = list{lit{"a"}, list{ref{"r", &target}}, id{3}};
+    compact_graph graph{root};
+
+    compact_graph copy = graph.clone(graph.child(0, 1));
+    BOOST_CHECK_EQUAL(copy.size(), 5);
+    BOOST_CHECK(copy.is<list_node>(copy.root()));
+    BOOST_CHECK(structurally_equal(copy, copy.root(), graph, graph.child(0, 1)));
+    BOOST_CHECK(!structurally_equal(copy, copy.root(), graph, graph.root()));
+
+    BOOST_CHECK(structurally_equal(graph.clone(graph.root()), 0, graph, 0));
+    BOOST_CHECK(structurally_equal(graph.clone(graph.root()).expand().first, root));
+}
+
+BOOST_AUTO_TEST_CASE(structurally_equal_test)
+{
+    // cycles through references terminate
+    ref_node& r1 = ref{"r"};
+    list_node& l1 = list{lit{"x"}, r1};
+    r1.refered(&l1);
+    ref_node& r2 = ref{"r"};
+    list_node& l2 = list{lit{"x"}, r2};
+    r2.refered(&l2);
+    ref_node& r3 = ref{"r"};
+    list_node& l3 = list{lit{"y"}, r3};
+    r3.refered(&l3);
+
+    compact_graph g1{l1};
+    compact_graph g2{l2};
+    compact_graph g3{l3};
+    BOOST_CHECK(structurally_equal(g1, 0, g2, 0));
+    BOOST_CHECK(!structurally_equal(g1, 0, g3, 0));
+
+    compact_graph g4{list{lit{"x"}, ref{"r"}}};
+    BOOST_CHECK(!structurally_equal(g1, 0, g4, 0));
+    compact_graph g5{list{lit{"x"}}};
+    BOOST_CHECK(!structurally_equal(g1, 0, g5, 0));
+
+    // macros are compared by the function they call
+    dynamic_graph graph;
+    macro_node& macro1 = graph.create_macro();
+    macro1.function(make_shared<function<macro_node::macro>>());
+    macro_node& macro2 = graph.create_macro();
+    macro2.function(make_shared<function<macro_node::macro>>());
+    compact_graph g6{list{macro1, macro1}};
+    compact_graph g7{list{macro1, macro2}};
+    BOOST_CHECK(structurally_equal(g6, 0, g6.clone(0), 0));
+    BOOST_CHECK(!structurally_equal(g6, 0, g7, 0));
+}
+
+BOOST_AUTO_TEST_CASE(dispatch_references_test)
+{
+    compact_graph graph{list{list{ref{"a"}, lit{"a"}}, ref{"b"}, ref{"c"}, id{0}}};
+    unordered_map<identifier_id_t, node_handle> table{{identifier_id("a"), 5}, {identifier_id("b"), 0}};
+
+    dispatch_references(graph, graph.child(0, 0), table);
+    BOOST_CHECK_EQUAL(graph.refered(graph.child(graph.child(0, 0), 0)), 5);
+    BOOST_CHECK_EQUAL(graph.refered(graph.child(0, 1)), null_handle);
+
+    dispatch_references(graph, graph.root(), table);
+    BOOST_CHECK_EQUAL(graph.refered(graph.child(0, 1)), 0);
+    BOOST_CHECK_EQUAL(graph.refered(graph.child(0, 2)), null_handle);
+}
+
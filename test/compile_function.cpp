@@ -45,15 +45,15 @@ BOOST_AUTO_TEST_CASE(compile_signature_test)
     node& return_type1 = int64_type;
     
     unique_ptr<Function> function1;
-    unordered_map<string, named_value_info> parameter_table1;
+    unordered_map<identifier_id_t, named_value_info> parameter_table1;
     tie(function1, parameter_table1) = compile_signature(params1, return_type1, context());
     
     BOOST_CHECK(function1 != nullptr);
     BOOST_CHECK_EQUAL(parameter_table1.size(), 3);
-    BOOST_CHECK(parameter_table1.count(save<string>(a.identifier())));
-    BOOST_CHECK(parameter_table1.count(save<string>(b.identifier())));
-    BOOST_CHECK(parameter_table1.count(save<string>(c.identifier())));
-    BOOST_CHECK(&parameter_table1.at(save<string>(b.identifier())).llvm_value == (++function1->arg_begin()));
+    BOOST_CHECK(parameter_table1.count(a.identifier_id()));
+    BOOST_CHECK(parameter_table1.count(b.identifier_id()));
+    BOOST_CHECK(parameter_table1.count(c.identifier_id()));
+    BOOST_CHECK(&parameter_table1.at(b.identifier_id()).llvm_value == (++function1->arg_begin()));
     
     node& params2 = list
     {
@@ -4,17 +4,64 @@
 
 #include "state_utils.hpp"
 #include "../src/compile_unit.hpp"
+#include "../src/core_unique_ids.hpp"
 
 #include "context.hpp"
 
 #include <boost/filesystem.hpp>
 
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+
 using std::vector;
 using std::pair;
+using std::string;
+using std::size_t;
+
+using llvm::Function;
 
 using boost::filesystem::path;
 using boost::filesystem::current_path;
+using boost::optional;
+
+namespace
+{
+
+// top imports left and right, which both import base, so left and right are evaluated in parallel
+const vector<path> diamond_paths = {"test-res/diamond/top.al", "test-res/diamond/left.al",
+    "test-res/diamond/right.al", "test-res/diamond/base.al"};
+
+struct diamond_result
+{
+    // of top_id, left_id, right_id and base_id, by file id
+    vector<size_t> ids;
+    // parameter counts of the functions in the runtime module, in order
+    vector<size_t> arg_counts;
+};
+
+diamond_result compile_diamond()
+{
+    compilation_context unit_context;
+    vector<module> modules = compile_unit(diamond_paths, unit_context);
+    BOOST_REQUIRE_EQUAL(modules.size(), 4);
+
+    diamond_result result;
+    const char* id_names[] = {"top_id", "left_id", "right_id", "base_id"};
+    for(size_t file_id = 0; file_id != modules.size(); ++file_id)
+    {
+        const node& id = modules[file_id].exports.at(identifier_id(id_names[file_id]));
+        BOOST_REQUIRE(id.is<id_node>());
+        result.ids.push_back(id.cast<id_node>().id());
+    }
+    // left exports the node of base
+    BOOST_CHECK(&modules[1].exports.at(identifier_id("base_id")) == &modules[3].exports.at(identifier_id("base_id")));
 
+    for(const Function& func : unit_context.runtime_module())
+        result.arg_counts.push_back(func.arg_size());
+    return result;
+}
+
+}
 
 BOOST_AUTO_TEST_CASE(read_files_test)
 {
@@ -67,3 +114,83 @@ BOOST_AUTO_TEST_CASE(toposort_test)
     vector<size_t> expected2 = {0, 1};
     BOOST_CHECK(sorted2 == expected2);
 }
+
+BOOST_AUTO_TEST_CASE(toposort_cycle_test)
+{
+    // 0 imports 1, 1 and 2 import each other
+    vector<vector<size_t>> graph
+    {
+        {1},
+        {2},
+        {1},
+        {}
+    };
+    try
+    {
+        toposort(graph);
+        BOOST_FAIL("no exception thrown");
+    }
+    catch(const circular_dependency& exc)
+    {
+        vector<size_t> expected = {1, 2};
+        BOOST_CHECK(exc.cycle == expected);
+    }
+
+    vector<vector<size_t>> self_import{{}, {1}};
+    try
+    {
+        toposort(self_import);
+        BOOST_FAIL("no exception thrown");
+    }
+    catch(const circular_dependency& exc)
+    {
+        vector<size_t> expected = {1};
+        BOOST_CHECK(exc.cycle == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(path_index_test)
+{
+    path_index index{{"test-res/a/a.al", "test-res/b/b.al", "./test-res/a/a.al"}};
+    BOOST_CHECK(index.find("test-res/a/a.al") == optional<size_t>{0});
+    BOOST_CHECK(index.find("test-res/b/../a/a.al") == optional<size_t>{0});
+    BOOST_CHECK(index.find("test-res/b/./b.al") == optional<size_t>{1});
+    BOOST_CHECK(!index.find("test-res/c/c.al"));
+    BOOST_CHECK(!index.find("a.al"));
+}
+
+BOOST_AUTO_TEST_CASE(discover_unit_test)
+{
+    unit_files unit = discover_unit("test-res/b/b.al");
+    BOOST_REQUIRE_EQUAL(unit.paths.size(), 2);
+    BOOST_CHECK(unit.paths[0] == path{"test-res/b/b.al"});
+    BOOST_CHECK(path_index{{"test-res/a/a.al"}}.find(unit.paths[1]) == optional<size_t>{0});
+    BOOST_REQUIRE_EQUAL(unit.files.size(), 2);
+    BOOST_REQUIRE(unit.imports[0] && unit.imports[1]);
+    BOOST_CHECK(*unit.imports[0] == vector<string>{"../a/a"});
+    BOOST_CHECK(unit.imports[1]->empty());
+
+    // a has no imports
+    BOOST_CHECK_EQUAL(discover_unit("test-res/a/a.al").paths.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_evaluation_test)
+{
+    diamond_result first = compile_diamond();
+
+    // the procs of top, left, right and base have 4, 2, 3 and 1 parameters,
+    // the runtime module is ordered by file id, though base is evaluated first
+    vector<size_t> expected_arg_counts = {4, 2, 3, 1};
+    BOOST_CHECK(first.arg_counts == expected_arg_counts);
+    // every file numbers its ids in its own range
+    for(size_t file_id = 0; file_id != first.ids.size(); ++file_id)
+        BOOST_CHECK_EQUAL((first.ids[file_id] - unique_ids::FIRST_UNUSED) >> 32, file_id + 1);
+
+    // another schedule gives the same output
+    for(size_t i = 0; i != 4; ++i)
+    {
+        diamond_result other = compile_diamond();
+        BOOST_CHECK(other.ids == first.ids);
+        BOOST_CHECK(other.arg_counts == first.arg_counts);
+    }
+}
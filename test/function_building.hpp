@@ -112,6 +112,7 @@ T* get_compiled_function(const list_node& function_source)
     Function* function = function_owner.get();
     context().macro_environment().llvm_module.getFunctionList().push_back(function_owner.get());
     function_owner.release();
+    inline_node_accessors(*function);
     
     string str;
     raw_string_ostream os(str);
@@ -0,0 +1,76 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE header_scan
+#include <boost/test/unit_test.hpp>
+
+#include "../src/header_scan.hpp"
+#include "../src/parse_state.hpp"
+#include "../src/parse.hpp"
+#include "../src/module.hpp"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+using boost::optional;
+using boost::none;
+
+namespace
+{
+
+optional<vector<string>> scanned(const string& source)
+{
+    return scan_imports(source.data(), source.data() + source.size());
+}
+
+// the imports read_module_header finds after a full parse
+vector<string> parsed_imports(const string& source)
+{
+    dynamic_graph graph;
+    parse_state<const char*> state{source.data(), source.data() + source.size(), 0, graph};
+    module_header header = read_module_header(parse_file(state));
+    return save<vector<string>>(mapped(header.imports, [](const import_statement& import)
+    {
+        return save<string>(rangeify(import.imported_module));
+    }));
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(imports_test)
+{
+    vector<string> sources =
+    {
+        "",
+        "def a ();",
+        "import (a b c) from \"../a/a\";\nexport d;\n\n\ndef d c;\n",
+        "export a b c;\n\ndef a ();\ndef b ();\ndef c a;\n",
+        "# comment\nimport(a)from\"x\";import (+ b) # comment\n from 123 ;export (a {b; c;} \"d\") e;\nimport () from \"y\";;import (z) from \"z\";",
+        "import (a) from \"x\"; def b (); import (c) from \"y\";",
+        "import {} from \"x\";\nimport { } from \"y\";"
+    };
+    for(const string& source : sources)
+    {
+        optional<vector<string>> imports = scanned(source);
+        BOOST_REQUIRE(imports);
+        BOOST_CHECK(*imports == parsed_imports(source));
+    }
+
+    vector<string> expected = {"x", "123", "y"};
+    BOOST_CHECK(*scanned(sources[4]) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_test)
+{
+    // all of them are parse errors, or errors in read_module_header
+    BOOST_CHECK(scanned("import (a) from \"x\"") == none);
+    BOOST_CHECK(scanned("import (a) from \"x") == none);
+    BOOST_CHECK(scanned("import (a (b)) from \"x\";") == none);
+    BOOST_CHECK(scanned("import a from \"x\";") == none);
+    BOOST_CHECK(scanned("import (a) of \"x\";") == none);
+    BOOST_CHECK(scanned("import (a) from x;") == none);
+    BOOST_CHECK(scanned("import (a) from \"x\" \"y\";") == none);
+    BOOST_CHECK(scanned("export (a;") == none);
+    BOOST_CHECK(scanned("export \"a;") == none);
+}
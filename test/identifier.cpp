@@ -0,0 +1,51 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE identifier
+#include <boost/test/unit_test.hpp>
+
+#include "../src/identifier.hpp"
+#include "../src/parallel.hpp"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::size_t;
+
+BOOST_AUTO_TEST_CASE(initial_identifiers_test)
+{
+    BOOST_CHECK_EQUAL(identifier_id(""), 0);
+    BOOST_CHECK_EQUAL(identifier_id("export"), identifier_id(identifier_ids::EXPORT));
+    BOOST_CHECK_EQUAL(identifier_id("import"), identifier_id(identifier_ids::IMPORT));
+    BOOST_CHECK_EQUAL(identifier_id("from"), identifier_id(identifier_ids::FROM));
+    BOOST_CHECK_EQUAL(identifier_id("def"), identifier_id(identifier_ids::DEF));
+    BOOST_CHECK_EQUAL(identifier_id("core"), identifier_id(identifier_ids::CORE));
+}
+
+BOOST_AUTO_TEST_CASE(interning_test)
+{
+    identifier_id_t abc = identifier_id("abc");
+    BOOST_CHECK(abc >= identifier_id(identifier_ids::FIRST_UNUSED));
+    BOOST_CHECK_EQUAL(identifier_id("abc"), abc);
+    BOOST_CHECK(identifier_id("abd") != abc);
+    BOOST_CHECK_EQUAL(identifier_string(abc), "abc");
+
+    const char str[] = "xabcx";
+    BOOST_CHECK_EQUAL(identifier_id(str + 1, str + 4), abc);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_interning_test)
+{
+    vector<identifier_id_t> ids(4000);
+    parallel_for(ids.size(), [&](size_t index)
+    {
+        ids[index] = identifier_id("concurrent_" + to_string(index % 1000));
+    });
+    for(size_t i = 0; i != ids.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(ids[i], ids[i % 1000]);
+        BOOST_CHECK_EQUAL(identifier_string(ids[i]), "concurrent_" + to_string(i % 1000));
+    }
+}
+
@@ -0,0 +1,50 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE line_table
+#include <boost/test/unit_test.hpp>
+
+#include "../src/line_table.hpp"
+
+#include <string>
+
+using std::string;
+
+BOOST_AUTO_TEST_CASE(position_test)
+{
+    string content = "ab\n\ncde\nf";
+    line_table lines{content.data(), content.data() + content.size()};
+
+    auto check = [&](file_offset offset, size_t line, size_t line_pos)
+    {
+        file_position pos = lines.position(offset);
+        BOOST_CHECK_EQUAL(pos.line, line);
+        BOOST_CHECK_EQUAL(pos.line_pos, line_pos);
+    };
+    check(0, 0, 0);
+    check(1, 0, 1);
+    check(2, 0, 2);
+    check(3, 1, 0);
+    check(4, 2, 0);
+    check(7, 2, 3);
+    check(8, 3, 0);
+    check(9, 3, 1); // end of file
+}
+
+BOOST_AUTO_TEST_CASE(long_lines_test)
+{
+    string content(1000, 'x');
+    content[500] = '\n';
+    line_table lines{content.data(), content.data() + content.size()};
+
+    BOOST_CHECK_EQUAL(lines.position(499).line, 0);
+    BOOST_CHECK_EQUAL(lines.position(499).line_pos, 499);
+    BOOST_CHECK_EQUAL(lines.position(999).line, 1);
+    BOOST_CHECK_EQUAL(lines.position(999).line_pos, 498);
+}
+
+BOOST_AUTO_TEST_CASE(empty_test)
+{
+    line_table lines{nullptr, nullptr};
+    BOOST_CHECK_EQUAL(lines.position(0).line, 0);
+    BOOST_CHECK_EQUAL(lines.position(0).line_pos, 0);
+}
+
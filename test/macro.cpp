@@ -8,10 +8,58 @@
 #include "function_building.hpp"
 
 #include <utility>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <thread>
 
 using std::pair;
 using std::make_shared;
 using std::move;
+using std::atomic;
+using std::size_t;
+using std::thread;
+
+extern "C"
+{
+node_ptr macro_list_create();
+node_ptr macro_list_get(node_ptr n, std::uint64_t index) noexcept;
+void macro_lit_push(node_ptr n, std::int8_t c);
+node_ptr macro_call_macro(std::size_t ptr_as_int, node_ptr macro_arg);
+}
+
+namespace
+{
+
+struct native_macro_error
+{};
+
+// compile_macro of a macro returning its argument, with the given settings of the context
+macro_node compile_identity_macro(bool lazy, size_t jit_threshold)
+{
+    bool previous_lazy = context().lazy_macro_compilation();
+    size_t previous_threshold = context().macro_jit_threshold();
+    context().lazy_macro_compilation(lazy);
+    context().macro_jit_threshold(jit_threshold);
+
+    list_node& source = list
+    {
+        list{list{s, node_type}},
+        node_type,
+        list{list{block1, list
+        {
+            list{return_symbol, s}
+        }}}
+    };
+    macro_node macro = compile_macro(rangeify(source), context());
+
+    context().lazy_macro_compilation(previous_lazy);
+    context().macro_jit_threshold(previous_threshold);
+    return macro;
+}
+
+}
 
 BOOST_AUTO_TEST_CASE(parameter_return_test)
 {
@@ -268,6 +316,43 @@ BOOST_AUTO_TEST_CASE(lit_push_pop_test)
     BOOST_CHECK(structurally_equal(p.first, expected));
 }
 
+BOOST_AUTO_TEST_CASE(lit_push_argument_test)
+{
+    list_node& params = list
+    {
+        list{s, node_type}
+    };
+    node& return_type = node_type;
+
+    list_node& body = list
+    {
+        list{block1, list
+        {
+            list{let, a, list_get, s, lit{"0"}},
+            list{lit_push, a, lit{"33"}},
+            list{return_symbol, a}
+        }}
+    };
+
+    list_node& function_source = list
+    {
+        params,
+        return_type,
+        body
+    };
+
+    macro_function* func = get_compiled_function<macro_function>(function_source);
+    // like a literal of the parser, the characters are in read-only memory
+    static const char source[] = "Hello";
+    dynamic_graph graph;
+    const list_node& l = list{graph.create_lit(source, source + 5)};
+    auto p = execute_macro(func, rangeify(l));
+    lit expected = {"Hello!"};
+    BOOST_CHECK(structurally_equal(p.first, expected));
+    lit original = {"Hello"};
+    BOOST_CHECK(structurally_equal(l[0], original));
+}
+
 BOOST_AUTO_TEST_CASE(to_node_test)
 {
     list_node& params = list
@@ -345,3 +430,213 @@ BOOST_AUTO_TEST_CASE(call_macro_test)
 
     BOOST_CHECK(structurally_equal(p.first, expected));
 }
+
+BOOST_AUTO_TEST_CASE(copy_on_write_test)
+{
+    list_node& params = list
+    {
+        list{s, node_type}
+    };
+    node& return_type = node_type;
+    
+    list_node& body = list
+    {
+        list{block1, list
+        {
+            list{let, a, list_get, s, lit{"0"}},
+            list{let, b, list_get, s, lit{"2"}},
+            list{list_set, a, lit{"0"}, b},
+            list{return_node, s}
+        }}
+    };
+
+    list_node& function_source = list
+    {
+        params,
+        return_type,
+        body
+    };
+
+    macro_function* func = get_compiled_function<macro_function>(function_source);
+    list_node& shared = list{lit{"a"}};
+    const list_node& l = list{shared, shared, lit{"b"}};
+    auto p = execute_macro(func, rangeify(l));
+
+    // the arguments are unchanged, the modification is seen through both references to the shared list
+    node& expected = list{list{lit{"b"}}, list{lit{"b"}}, lit{"b"}};
+    BOOST_CHECK(structurally_equal(p.first, expected));
+    node& original = list{list{lit{"a"}}, list{lit{"a"}}, lit{"b"}};
+    BOOST_CHECK(structurally_equal(l, original));
+    const list_node& result = p.first.cast<list_node>();
+    BOOST_CHECK_EQUAL(&result[0], &result[1]);
+}
+
+BOOST_AUTO_TEST_CASE(inlined_accessor_test)
+{
+    list_node& params = list
+    {
+        list{s, node_type}
+    };
+    node& return_type = node_type;
+    
+    // list_get and list_size read the argument directly first, then through the copy made by list_set
+    list_node& body = list
+    {
+        list{block1, list
+        {
+            list{let, a, list_get, s, lit{"0"}},
+            list{let, b, list_get, a, lit{"1"}},
+            list{list_set, a, lit{"0"}, b},
+            list{let, c, list_get, s, lit{"0"}},
+            list{let, d, list_size, c},
+            list{let, e, cmp_eq_int64, d, lit{"2"}},
+            list{cond_branch, e, block2, block3}
+        }},
+        list{block2, list
+        {
+            list{let, x, list_get, c, lit{"0"}},
+            list{return_symbol, x}
+        }},
+        list{block3, list
+        {
+            list{let, y, list_get, c, lit{"2"}},
+            list{return_symbol, y}
+        }}
+    };
+
+    list_node& function_source = list
+    {
+        params,
+        return_type,
+        body
+    };
+
+    macro_function* func = get_compiled_function<macro_function>(function_source);
+    const list_node& l = list{list{lit{"a"}, lit{"b"}}};
+    auto p = execute_macro(func, rangeify(l));
+    BOOST_CHECK(structurally_equal(p.first, lit{"b"}));
+    BOOST_CHECK_EQUAL(forwarding_executions, 0);
+
+    // out of bounds on the fast path still reports the error
+    const list_node& short_list = list{list{lit{"a"}}};
+    BOOST_CHECK_THROW(execute_macro(func, rangeify(short_list)), compile_exception);
+    BOOST_CHECK_EQUAL(forwarding_executions, 0);
+}
+
+BOOST_AUTO_TEST_CASE(compiled_dispatch_test)
+{
+    size_t function_calls = 0;
+    atomic<macro_function*> code{nullptr};
+    macro_node macro{make_shared<std::function<macro_node::macro>>(
+    [&](node_range) -> pair<node&, dynamic_graph>
+    {
+        ++function_calls;
+        dynamic_graph graph;
+        lit_node& lit = graph.create_lit("not compiled");
+        return {lit, move(graph)};
+    }), &code};
+    BOOST_CHECK(macro.kind() == macro_kind::COMPILED);
+    BOOST_CHECK(macro.compiled_code() == nullptr);
+
+    const list_node& args = list{};
+    auto p = macro(rangeify(args));
+    BOOST_CHECK(structurally_equal(p.first, lit{"not compiled"}));
+    BOOST_CHECK_EQUAL(function_calls, 1);
+
+    // once there is code, it is called without the function
+    code = [](node_ptr) -> node_ptr
+    {
+        return macro_list_create();
+    };
+    macro_node copy = macro;
+    auto q = copy(rangeify(args));
+    BOOST_CHECK(structurally_equal(q.first, list{}));
+    BOOST_CHECK_EQUAL(function_calls, 1);
+
+    copy.function(macro.function());
+    BOOST_CHECK(copy.kind() == macro_kind::NATIVE);
+    copy(rangeify(args));
+    BOOST_CHECK_EQUAL(function_calls, 2);
+}
+
+BOOST_AUTO_TEST_CASE(lazy_compilation_test)
+{
+    const list_node& args = list{lit{"a"}};
+
+    // compiled on the first call
+    macro_node macro = compile_identity_macro(true, 0);
+    BOOST_CHECK(macro.kind() == macro_kind::COMPILED);
+    BOOST_CHECK(macro.compiled_code() == nullptr);
+    auto p = macro(rangeify(args));
+    BOOST_CHECK(structurally_equal(p.first, args));
+    macro_function* code = macro.compiled_code();
+    BOOST_CHECK(code != nullptr);
+    // the function doesn't compile it again
+    auto q = (*macro.function())(rangeify(args));
+    BOOST_CHECK(structurally_equal(q.first, args));
+    BOOST_CHECK(macro.compiled_code() == code);
+
+    // interpreted for the first two calls
+    macro_node interpreted = compile_identity_macro(true, 2);
+    for(size_t i = 0; i != 2; ++i)
+    {
+        auto r = interpreted(rangeify(args));
+        BOOST_CHECK(structurally_equal(r.first, args));
+        BOOST_CHECK(interpreted.compiled_code() == nullptr);
+    }
+    interpreted(rangeify(args));
+    BOOST_CHECK(interpreted.compiled_code() != nullptr);
+
+    // compiled when it is defined
+    macro_node eager = compile_identity_macro(false, 0);
+    BOOST_CHECK(eager.compiled_code() != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_first_call_test)
+{
+    const list_node& args = list{lit{"a"}};
+    macro_node macro = compile_identity_macro(true, 0);
+
+    // both calls go through the function, the code is generated once
+    bool results_equal[2] = {false, false};
+    macro_function* codes[2] = {nullptr, nullptr};
+    auto first_call = [&](size_t index)
+    {
+        auto p = (*macro.function())(rangeify(args));
+        results_equal[index] = structurally_equal(p.first, args);
+        codes[index] = macro.compiled_code();
+    };
+    thread other{first_call, 1};
+    first_call(0);
+    other.join();
+
+    BOOST_CHECK(results_equal[0] && results_equal[1]);
+    BOOST_CHECK(codes[0] != nullptr);
+    BOOST_CHECK(codes[0] == codes[1]);
+    BOOST_CHECK(macro.compiled_code() == codes[0]);
+}
+
+BOOST_AUTO_TEST_CASE(nested_exception_test)
+{
+    macro_node failing{make_shared<std::function<macro_node::macro>>([](node_range) -> pair<node&, dynamic_graph>
+    {
+        throw native_macro_error{};
+    })};
+    // copies its argument before it calls the failing macro
+    std::function<node_ptr (node_ptr)> call_failing = [&](node_ptr macro_arg)
+    {
+        macro_lit_push(macro_list_get(macro_arg, 0), 'b');
+        return macro_call_macro(reinterpret_cast<std::size_t>(&failing), macro_arg);
+    };
+
+    const list_node& args = list{lit{"a"}};
+    BOOST_CHECK_THROW(execute_macro(call_failing, rangeify(args)), native_macro_error);
+    // the execution is not left behind, so nothing is forwarded anymore
+    BOOST_CHECK_EQUAL(forwarding_executions.load(), 0);
+    std::function<node_ptr (node_ptr)> identity = [](node_ptr macro_arg)
+    {
+        return macro_arg;
+    };
+    auto p = execute_macro(identity, rangeify(args));
+    BOOST_CHECK(structurally_equal(p.first, args));
+}
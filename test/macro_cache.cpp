@@ -0,0 +1,155 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE macro_cache
+#include <boost/test/unit_test.hpp>
+
+#include "graph_building.hpp"
+#include "../src/macro_cache.hpp"
+
+#include <memory>
+#include <functional>
+#include <utility>
+
+using std::make_shared;
+using std::function;
+using std::pair;
+using std::move;
+
+namespace
+{
+
+macro_node& create_macro(dynamic_graph& graph, function<macro_node::macro> func)
+{
+    macro_node& macro = graph.create_macro();
+    macro.function(make_shared<function<macro_node::macro>>(move(func)));
+    return macro;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(structural_hash_test)
+{
+    list_node& args1 = list{lit{"a"}, list{id{1}, ref{"x"}}};
+    list_node& args2 = list{lit{"a"}, list{id{1}, ref{"x"}}};
+    list_node& args3 = list{lit{"a"}, list{id{2}, ref{"x"}}};
+    BOOST_CHECK_EQUAL(structural_hash(rangeify(args1)), structural_hash(rangeify(args2)));
+    BOOST_CHECK(structurally_identical(rangeify(args1), rangeify(args2)));
+    BOOST_CHECK(!structurally_identical(rangeify(args1), rangeify(args3)));
+
+    // sharing is part of the structure
+    lit_node& shared = lit{"s"};
+    list_node& shared_args = list{shared, shared};
+    list_node& copied_args = list{lit{"s"}, lit{"s"}};
+    BOOST_CHECK(!structurally_identical(rangeify(shared_args), rangeify(copied_args)));
+    BOOST_CHECK(structural_hash(rangeify(shared_args)) != structural_hash(rangeify(copied_args)));
+
+    // cycles through references
+    list_node& cyclic1 = list{id{3}, ref{"self"}};
+    cyclic1[1].cast<ref_node>().refered(&cyclic1);
+    list_node& cyclic2 = list{id{3}, ref{"self"}};
+    cyclic2[1].cast<ref_node>().refered(&cyclic2);
+    list_node& args4 = list{cyclic1};
+    list_node& args5 = list{cyclic2};
+    BOOST_CHECK_EQUAL(structural_hash(rangeify(args4)), structural_hash(rangeify(args5)));
+    BOOST_CHECK(structurally_identical(rangeify(args4), rangeify(args5)));
+}
+
+BOOST_AUTO_TEST_CASE(compact_structurally_identical_test)
+{
+    // the cache compares stored compact_graph arguments with the nodes of a call
+    list_node& args1 = list{lit{"a"}, list{id{1}, ref{"x"}}};
+    list_node& args2 = list{lit{"a"}, list{id{1}, ref{"x"}}};
+    list_node& args3 = list{lit{"a"}, list{id{2}, ref{"x"}}};
+    compact_graph compact_args{args1};
+    BOOST_CHECK(structurally_identical(compact_args, compact_args.root(), rangeify(args2)));
+    BOOST_CHECK(!structurally_identical(compact_args, compact_args.root(), rangeify(args3)));
+    BOOST_CHECK(!structurally_identical(compact_args, compact_args.root(), rangeify(list{lit{"a"}}.n->cast<list_node>())));
+
+    lit_node& shared = lit{"s"};
+    list_node& shared_args = list{shared, shared};
+    list_node& copied_args = list{lit{"s"}, lit{"s"}};
+    compact_graph compact_shared{shared_args};
+    compact_graph compact_copied{copied_args};
+    BOOST_CHECK(structurally_identical(compact_shared, compact_shared.root(), rangeify(list{shared, shared}.n->cast<list_node>())));
+    BOOST_CHECK(!structurally_identical(compact_shared, compact_shared.root(), rangeify(copied_args)));
+    BOOST_CHECK(!structurally_identical(compact_copied, compact_copied.root(), rangeify(shared_args)));
+
+    list_node& cyclic1 = list{id{3}, ref{"self"}};
+    cyclic1[1].cast<ref_node>().refered(&cyclic1);
+    list_node& cyclic2 = list{id{3}, ref{"self"}};
+    cyclic2[1].cast<ref_node>().refered(&cyclic2);
+    compact_graph compact_cyclic{list{cyclic1}};
+    BOOST_CHECK(structurally_identical(compact_cyclic, compact_cyclic.root(), rangeify(list{cyclic2}.n->cast<list_node>())));
+    BOOST_CHECK(!structurally_identical(compact_cyclic, compact_cyclic.root(), rangeify(list{list{id{3}, ref{"self"}}}.n->cast<list_node>())));
+
+    // macros are compared by the function they call
+    dynamic_graph graph;
+    auto func = [](node_range args) -> pair<node&, dynamic_graph>
+    {
+        return {args.front(), dynamic_graph{}};
+    };
+    macro_node& macro1 = create_macro(graph, func);
+    macro_node& macro2 = create_macro(graph, func);
+    compact_graph compact_macro{list{macro1}};
+    BOOST_CHECK(structurally_identical(compact_macro, compact_macro.root(), rangeify(list{macro1}.n->cast<list_node>())));
+    BOOST_CHECK(!structurally_identical(compact_macro, compact_macro.root(), rangeify(list{macro2}.n->cast<list_node>())));
+}
+
+BOOST_AUTO_TEST_CASE(cached_call_test)
+{
+    dynamic_graph graph;
+    int call_count = 0;
+    macro_node& macro = create_macro(graph, [&](node_range args) -> pair<node&, dynamic_graph>
+    {
+        ++call_count;
+        dynamic_graph result_graph;
+        list_node& result = result_graph.create_list({&result_graph.create_lit("result"), &args.front()});
+        return {result, move(result_graph)};
+    });
+    macro.cache(make_shared<macro_cache>());
+
+    pair<node&, dynamic_graph> first = macro(rangeify(list{lit{"arg"}}.n->cast<list_node>()));
+    pair<node&, dynamic_graph> second = macro(rangeify(list{lit{"arg"}}.n->cast<list_node>()));
+    BOOST_CHECK_EQUAL(call_count, 1);
+    BOOST_CHECK_EQUAL(&first.first, &second.first);
+    BOOST_CHECK(structurally_equal(first.first, list{lit{"result"}, lit{"arg"}}));
+
+    macro(rangeify(list{lit{"other"}}.n->cast<list_node>()));
+    BOOST_CHECK_EQUAL(call_count, 2);
+    BOOST_CHECK_EQUAL(macro.cache()->hits(), 1);
+    BOOST_CHECK_EQUAL(macro.cache()->misses(), 2);
+    BOOST_CHECK_EQUAL(macro.cache()->size(), 2);
+
+    // the result refers to the cache's copy of the arguments, it outlives the macro node
+    dynamic_graph result_owner;
+    result_owner.add(move(first.second));
+    macro.cache(nullptr);
+    BOOST_CHECK(structurally_equal(first.first, list{lit{"result"}, lit{"arg"}}));
+}
+
+BOOST_AUTO_TEST_CASE(side_effect_test)
+{
+    dynamic_graph graph;
+    int next_id = 0;
+    macro_node& counter = create_macro(graph, [&](node_range) -> pair<node&, dynamic_graph>
+    {
+        dynamic_graph result_graph;
+        id_node& result = result_graph.create_id(next_id++);
+        return {result, move(result_graph)};
+    });
+    counter.has_side_effects(true);
+
+    macro_node& macro = create_macro(graph, [&](node_range args) -> pair<node&, dynamic_graph>
+    {
+        return counter(args);
+    });
+    macro.cache(make_shared<macro_cache>());
+
+    list_node& args = list{};
+    pair<node&, dynamic_graph> first = macro(rangeify(args));
+    pair<node&, dynamic_graph> second = macro(rangeify(args));
+    BOOST_CHECK_EQUAL(first.first.cast<id_node>().id(), 0);
+    BOOST_CHECK_EQUAL(second.first.cast<id_node>().id(), 1);
+    BOOST_CHECK_EQUAL(macro.cache()->hits(), 0);
+    BOOST_CHECK_EQUAL(macro.cache()->size(), 0);
+}
+
@@ -0,0 +1,179 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE macro_code_cache
+#include <boost/test/unit_test.hpp>
+
+#include "../src/macro_code_cache.hpp"
+#include "../src/macro_execution.hpp"
+
+#include "graph_building.hpp"
+#include "function_building.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+using boost::filesystem::path;
+using boost::filesystem::temp_directory_path;
+using boost::filesystem::unique_path;
+using boost::filesystem::directory_iterator;
+using boost::filesystem::remove_all;
+using boost::filesystem::resize_file;
+using boost::filesystem::file_size;
+
+namespace
+{
+
+// returns the first element of the list passed as first argument
+list_node& first_element_source()
+{
+    list_node& params = list
+    {
+        list{s, node_type}
+    };
+    node& return_type = node_type;
+    list_node& body = list
+    {
+        list{block1, list
+        {
+            list{let, x, list_get, s, lit{"0"}},
+            list{let, y, list_get, x, lit{"0"}},
+            list{return_node, y}
+        }}
+    };
+    return list
+    {
+        params,
+        return_type,
+        body
+    };
+}
+
+Function& add_function(const list_node& function_source)
+{
+    unique_ptr<Function> function_owner;
+    tie(function_owner, ignore) = compile_function(rangeify(function_source), context());
+    Function& function = *function_owner;
+    context().macro_environment().llvm_module.getFunctionList().push_back(function_owner.release());
+    return function;
+}
+
+size_t entry_count(const path& directory)
+{
+    size_t count = 0;
+    for(directory_iterator it{directory}, end; it != end; ++it)
+        ++count;
+    return count;
+}
+
+struct counting_passes
+{
+    int runs = 0;
+
+    void operator()(Function& func)
+    {
+        ++runs;
+        inline_node_accessors(func);
+        context().macro_environment().optimizer.run(func);
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(hit_test)
+{
+    path directory = temp_directory_path() / unique_path("%%%%-%%%%-%%%%");
+    counting_passes passes;
+    const list_node& source = first_element_source();
+    {
+        macro_code_cache cache{directory, 1 << 20, optimization_level::O2};
+        BOOST_CHECK(!cache.optimize(add_function(source), std::ref(passes)));
+        BOOST_CHECK(cache.optimize(add_function(source), std::ref(passes)));
+        BOOST_CHECK_EQUAL(passes.runs, 1);
+        BOOST_CHECK_EQUAL(cache.hits(), 1);
+        BOOST_CHECK_EQUAL(cache.misses(), 1);
+        BOOST_CHECK_EQUAL(entry_count(directory), 1);
+    }
+
+    // like a later run of the compiler
+    macro_code_cache cache{directory, 1 << 20, optimization_level::O2};
+    Function& cached = add_function(source);
+    BOOST_CHECK(cache.optimize(cached, std::ref(passes)));
+    BOOST_CHECK_EQUAL(passes.runs, 1);
+    auto func = (macro_function*) context().macro_environment().llvm_engine.getPointerToFunction(&cached);
+    const list_node& args = list{list{lit{"a"}, lit{"b"}}};
+    auto p = execute_macro(func, rangeify(args));
+    BOOST_CHECK(structurally_equal(p.first, lit{"a"}));
+
+    // entries of other optimization levels are not used
+    macro_code_cache other_level{directory, 1 << 20, optimization_level::O1};
+    BOOST_CHECK(!other_level.optimize(add_function(source), std::ref(passes)));
+    BOOST_CHECK_EQUAL(passes.runs, 2);
+
+    remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(stale_entry_test)
+{
+    path directory = temp_directory_path() / unique_path("%%%%-%%%%-%%%%");
+    counting_passes passes;
+    const list_node& source = first_element_source();
+    macro_code_cache cache{directory, 1 << 20, optimization_level::O2};
+    cache.optimize(add_function(source), std::ref(passes));
+
+    // a truncated entry is a miss, and replaced
+    path entry = directory_iterator{directory}->path();
+    resize_file(entry, file_size(entry) - 1);
+    BOOST_CHECK(!cache.optimize(add_function(source), std::ref(passes)));
+    BOOST_CHECK(cache.optimize(add_function(source), std::ref(passes)));
+
+    // so is an entry with changed code
+    {
+        std::fstream file{entry.native(), std::ios::in | std::ios::out | std::ios::binary};
+        file.seekp(-1, std::ios::end);
+        file.put('\x7f');
+    }
+    BOOST_CHECK(!cache.optimize(add_function(source), std::ref(passes)));
+    BOOST_CHECK_EQUAL(passes.runs, 3);
+
+    remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(eviction_test)
+{
+    path directory = temp_directory_path() / unique_path("%%%%-%%%%-%%%%");
+    counting_passes passes;
+    // every entry is larger than the cache, it is removed right away
+    macro_code_cache cache{directory, 1, optimization_level::O2};
+    cache.optimize(add_function(first_element_source()), std::ref(passes));
+    BOOST_CHECK_EQUAL(entry_count(directory), 0);
+    BOOST_CHECK(!cache.optimize(add_function(first_element_source()), std::ref(passes)));
+
+    remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(node_address_test)
+{
+    // to_node puts the address of the node into the code, it changes with every run
+    list_node& source = list
+    {
+        list{list{s, node_type}},
+        node_type,
+        list
+        {
+            list{block1, list
+            {
+                list{let, a, to_node, list{lit{"123"}}},
+                list{return_node, a}
+            }}
+        }
+    };
+    path directory = temp_directory_path() / unique_path("%%%%-%%%%-%%%%");
+    counting_passes passes;
+    macro_code_cache cache{directory, 1 << 20, optimization_level::O2};
+    BOOST_CHECK(!cache.optimize(add_function(source), std::ref(passes)));
+    BOOST_CHECK(!cache.optimize(add_function(source), std::ref(passes)));
+    BOOST_CHECK_EQUAL(passes.runs, 2);
+    BOOST_CHECK_EQUAL(cache.misses(), 0);
+
+    remove_all(directory);
+}
@@ -0,0 +1,147 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE macro_interpreter
+#include <boost/test/unit_test.hpp>
+
+#include "../src/macro_interpreter.hpp"
+#include "../src/macro_execution.hpp"
+
+#include "graph_building.hpp"
+#include "function_building.hpp"
+
+#include <memory>
+
+using std::unique_ptr;
+
+namespace
+{
+
+unique_ptr<macro_interpreter> get_interpreter(const list_node& function_source)
+{
+    unique_ptr<Function> function_owner;
+    try
+    {
+        tie(function_owner, ignore) = compile_function(rangeify(function_source), context());
+    }
+    catch(const compile_exception& exc)
+    {
+        ostringstream oss;
+        oss << exc;
+        BOOST_FAIL("compilation failure:" << oss.str());
+    }
+    Function* function = function_owner.get();
+    context().macro_environment().llvm_module.getFunctionList().push_back(function_owner.get());
+    function_owner.release();
+
+    unique_ptr<macro_interpreter> interpreter = macro_interpreter::create(*function, context().macro_environment());
+    BOOST_REQUIRE(interpreter);
+    return interpreter;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(loop_test)
+{
+    list_node& params = list
+    {
+        list{s, node_type}
+    };
+    node& return_type = node_type;
+
+    // copies the elements of the list passed as first argument into a new list, counting with a stack variable
+    list_node& body = list
+    {
+        list{block1, list
+        {
+            list{let, x, list_get, s, lit{"0"}},
+            list{let, y, list_create},
+            list{let, z, list_size, x},
+            list{let, a, alloc_int64},
+            list{store_int64, lit{"0"}, a},
+            list{let, b, cmp_eq_int64, z, lit{"0"}},
+            list{cond_branch, b, block3, block2}
+        }},
+        list{block2, list
+        {
+            list{let, c, load_int64, a},
+            list{let, d, list_get, x, c},
+            list{list_push, y, d},
+            list{let, e, add_int64, c, lit{"1"}},
+            list{store_int64, e, a},
+            list{let, f, cmp_ne_int64, e, z},
+            list{cond_branch, f, block2, block3}
+        }},
+        list{block3, list
+        {
+            list{return_node, y}
+        }}
+    };
+
+    list_node& function_source = list
+    {
+        params,
+        return_type,
+        body
+    };
+
+    unique_ptr<macro_interpreter> interpreter = get_interpreter(function_source);
+    auto interpret = [&](node_ptr macro_arg)
+    {
+        return (*interpreter)(macro_arg);
+    };
+
+    const list_node& l1 = list{list{lit{"a"}, id{1}, list{}}};
+    auto p1 = execute_macro(interpret, rangeify(l1));
+    BOOST_CHECK(structurally_equal(p1.first, list{lit{"a"}, id{1}, list{}}));
+
+    const list_node& l2 = list{list{}};
+    auto p2 = execute_macro(interpret, rangeify(l2));
+    BOOST_CHECK(structurally_equal(p2.first, list{}));
+
+    // same result as the compiled macro
+    macro_function* func = get_compiled_function<macro_function>(function_source);
+    auto p3 = execute_macro(func, rangeify(l1));
+    BOOST_CHECK(structurally_equal(p3.first, p1.first));
+}
+
+BOOST_AUTO_TEST_CASE(error_test)
+{
+    list_node& params = list
+    {
+        list{s, node_type}
+    };
+    node& return_type = node_type;
+
+    list_node& body = list
+    {
+        list{block1, list
+        {
+            list{let, a, list_get, s, lit{"1"}},
+            list{list_pop, a},
+            list{return_node, a}
+        }}
+    };
+
+    list_node& function_source = list
+    {
+        params,
+        return_type,
+        body
+    };
+
+    unique_ptr<macro_interpreter> interpreter = get_interpreter(function_source);
+    auto interpret = [&](node_ptr macro_arg)
+    {
+        return (*interpreter)(macro_arg);
+    };
+
+    const list_node& too_short = list{lit{"a"}};
+    BOOST_CHECK_THROW(execute_macro(interpret, rangeify(too_short)), compile_exception);
+    const list_node& empty_list = list{lit{"a"}, list{}};
+    BOOST_CHECK_THROW(execute_macro(interpret, rangeify(empty_list)), compile_exception);
+
+    // the failed executions are cleaned up
+    const list_node& l = list{lit{"a"}, list{id{1}, id{2}}};
+    auto p = execute_macro(interpret, rangeify(l));
+    BOOST_CHECK(structurally_equal(p.first, list{id{1}}));
+    BOOST_CHECK(structurally_equal(l, list{lit{"a"}, list{id{1}, id{2}}}));
+}
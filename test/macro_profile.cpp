@@ -0,0 +1,100 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE macro_profile
+#include <boost/test/unit_test.hpp>
+
+#include "graph_building.hpp"
+#include "../src/macro_profile.hpp"
+#include "../src/macro_execution.hpp"
+
+#include <memory>
+#include <functional>
+#include <sstream>
+#include <string>
+
+using std::make_shared;
+using std::function;
+using std::pair;
+using std::ostringstream;
+using std::string;
+using std::size_t;
+
+extern "C"
+{
+node_ptr macro_list_create();
+node_ptr macro_call_macro(size_t ptr_as_int, node_ptr macro_arg);
+}
+
+namespace
+{
+
+macro_node* inner_macro = nullptr;
+
+node_ptr create_list(node_ptr)
+{
+    return macro_list_create();
+}
+node_ptr call_inner(node_ptr macro_arg)
+{
+    return macro_call_macro(reinterpret_cast<size_t>(inner_macro), macro_arg);
+}
+
+macro_node compiled_macro(macro_function* func)
+{
+    return {make_shared<function<macro_node::macro>>([func](node_range args)
+    {
+        return execute_macro(func, args);
+    })};
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(statistics_test)
+{
+    macro_node inner = compiled_macro(create_list);
+    macro_node outer = compiled_macro(call_inner);
+    inner_macro = &inner;
+
+    reset_macro_profile();
+    enable_macro_profiling(true);
+    list_node& args = list{lit{"a"}};
+    outer(rangeify(args));
+    outer(rangeify(args));
+    enable_macro_profiling(false);
+    outer(rangeify(args));
+
+    auto profile = macro_profile();
+    BOOST_REQUIRE_EQUAL(profile.size(), 2);
+    const macro_statistics& inner_statistics = profile.at(inner.function().get());
+    const macro_statistics& outer_statistics = profile.at(outer.function().get());
+    BOOST_CHECK_EQUAL(inner_statistics.calls, 2);
+    BOOST_CHECK_EQUAL(outer_statistics.calls, 2);
+    BOOST_CHECK_EQUAL(inner_statistics.nodes_created, 2);
+    BOOST_CHECK_EQUAL(outer_statistics.nodes_created, 0);
+    BOOST_CHECK_EQUAL(inner_statistics.max_depth, 2);
+    BOOST_CHECK_EQUAL(outer_statistics.max_depth, 1);
+    BOOST_CHECK(outer_statistics.total_seconds >= inner_statistics.total_seconds);
+    BOOST_CHECK(outer_statistics.max_seconds <= outer_statistics.total_seconds);
+}
+
+BOOST_AUTO_TEST_CASE(report_test)
+{
+    macro_node inner = compiled_macro(create_list);
+    reset_macro_profile();
+    enable_macro_profiling(true);
+    inner(rangeify(list{}.n->cast<list_node>()));
+    enable_macro_profiling(false);
+
+    auto name = [](const void*) -> string
+    {
+        return "a \"quoted\" name";
+    };
+    ostringstream text;
+    print_macro_profile(text, name);
+    BOOST_CHECK(text.str().find("a \"quoted\" name") != string::npos);
+
+    ostringstream json;
+    write_macro_profile_json(json, name);
+    BOOST_CHECK(json.str().find("\"name\": \"a \\\"quoted\\\" name\"") != string::npos);
+    BOOST_CHECK(json.str().find("\"calls\": 1,") != string::npos);
+    BOOST_CHECK(json.str().find("\"nodes_created\": 1,") != string::npos);
+}
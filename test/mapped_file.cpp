@@ -0,0 +1,44 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE mapped_file
+#include <boost/test/unit_test.hpp>
+
+#include "../src/mapped_file.hpp"
+#include "../src/compile_unit.hpp"
+
+#include <string>
+#include <fstream>
+#include <iterator>
+
+using std::string;
+using std::ifstream;
+using std::istreambuf_iterator;
+
+BOOST_AUTO_TEST_CASE(content_test)
+{
+    mapped_file file{"test-res/b/b.al"};
+    BOOST_CHECK(file);
+
+    ifstream stream{"test-res/b/b.al"};
+    string expected{istreambuf_iterator<char>{stream}, istreambuf_iterator<char>{}};
+
+    BOOST_CHECK_EQUAL(file.size(), expected.size());
+    BOOST_CHECK(string(file.begin(), file.end()) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(missing_file_test)
+{
+    mapped_file file{"test-res/does_not_exist.al"};
+    BOOST_CHECK(!file);
+}
+
+BOOST_AUTO_TEST_CASE(parsed_nodes_refer_to_mapping_test)
+{
+    parsed_file parsed = read_file(0, "test-res/b/b.al");
+    BOOST_CHECK_EQUAL(parsed.graph_owner.buffers.size(), 1);
+
+    const auto& file = *static_cast<const mapped_file*>(parsed.graph_owner.buffers.front().get());
+    const lit_node& imported_module = parsed.header.imports.front().imported_module;
+    BOOST_CHECK(file.begin() <= imported_module.begin() && imported_module.end() <= file.end());
+    BOOST_CHECK_EQUAL(save<string>(imported_module), "../a/a");
+}
+
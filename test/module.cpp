@@ -142,7 +142,7 @@ BOOST_AUTO_TEST_CASE(simple_definition_test)
     dynamic_graph module_graph;
     macro_node& macro = module_graph.create_macro();
     macro.function(std::make_shared<std::function<macro_node::macro>>(passthrough_function));
-    module injected_module{move(module_graph), {{"pf", macro}}};
+    module injected_module{move(module_graph), {{identifier_id("pf"), macro}}};
 
     unordered_map<string, module&> module_map;
     module_map.insert({"injected", injected_module});
@@ -163,16 +163,16 @@ BOOST_AUTO_TEST_CASE(simple_definition_test)
 
     auto& exports1 = mod1.exports;
     BOOST_CHECK(exports1.size() == 3);
-    BOOST_CHECK(exports1.count("a") && exports1.count("b") && exports1.count("c"));
-    BOOST_CHECK(structurally_equal(exports1.at("a"), list{}));
-    BOOST_CHECK(structurally_equal(exports1.at("b"), list{list{lit{"bb"}}}));
-    BOOST_CHECK(structurally_equal(exports1.at("c"), list{list{}}));
+    BOOST_CHECK(exports1.count(identifier_id("a")) && exports1.count(identifier_id("b")) && exports1.count(identifier_id("c")));
+    BOOST_CHECK(structurally_equal(exports1.at(identifier_id("a")), list{}));
+    BOOST_CHECK(structurally_equal(exports1.at(identifier_id("b")), list{list{lit{"bb"}}}));
+    BOOST_CHECK(structurally_equal(exports1.at(identifier_id("c")), list{list{}}));
 
     module mod2 = evaluate_module(mod2_tree, dynamic_graph{}, mod2_header, lookup_module);
     module_map.insert({"mod2", mod2});
     
     auto& exports2 = mod2.exports;
     BOOST_CHECK(exports2.size() == 3);
-    BOOST_CHECK(exports2.count("x") && exports2.count("y") && exports2.count("z"));
+    BOOST_CHECK(exports2.count(identifier_id("x")) && exports2.count(identifier_id("y")) && exports2.count(identifier_id("z")));
 }
 
@@ -0,0 +1,118 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE module_cache
+#include <boost/test/unit_test.hpp>
+
+#include "../src/module_cache.hpp"
+
+#include "graph_building.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <vector>
+
+using std::vector;
+using std::uint64_t;
+
+using boost::filesystem::path;
+using boost::filesystem::temp_directory_path;
+using boost::filesystem::unique_path;
+using boost::filesystem::remove;
+using boost::optional;
+using boost::get;
+
+namespace
+{
+
+struct cache_file
+{
+    path p = temp_directory_path() / unique_path("%%%%-%%%%-%%%%.alm");
+    ~cache_file()
+    {
+        remove(p);
+    }
+};
+
+const module_cache_key key{1234, 100, 5678};
+const size_t file_id = 3;
+
+}
+
+BOOST_AUTO_TEST_CASE(round_trip_test)
+{
+    node& x = lit{"1"};
+    module imported{dynamic_graph{}, {{identifier_id("x"), x}}};
+    vector<const module*> imported_modules = {&imported};
+
+    list_node& data = list{lit{"a"}, ref{"x", &x}, x};
+    data[0].source(file_source{10, 13, file_id});
+    module m{dynamic_graph{}, {{identifier_id("data"), data}, {identifier_id("x"), x}}};
+
+    cache_file cache;
+    optional<uint64_t> interface_hash = write_module_cache(cache.p.native().c_str(), key, file_id, m, imported_modules);
+    BOOST_REQUIRE(interface_hash);
+    BOOST_CHECK(has_module_cache(cache.p.native().c_str(), key.content_hash, key.source_size));
+    BOOST_CHECK(!has_module_cache(cache.p.native().c_str(), key.content_hash + 1, key.source_size));
+
+    // a file id of the next run
+    optional<cached_module> cached = read_module_cache(cache.p.native().c_str(), key, 7, imported_modules);
+    BOOST_REQUIRE(cached);
+    BOOST_CHECK_EQUAL(cached->interface_hash, *interface_hash);
+    BOOST_REQUIRE_EQUAL(cached->loaded.exports.size(), 2);
+    const node& loaded_data = cached->loaded.exports.at(identifier_id("data"));
+    BOOST_CHECK(structurally_equal(loaded_data, data));
+    // imported nodes are the imported module's
+    BOOST_CHECK(&cached->loaded.exports.at(identifier_id("x")) == &x);
+    BOOST_CHECK(loaded_data.cast<list_node>()[1].cast<ref_node>().refered() == &x);
+    BOOST_CHECK(&loaded_data.cast<list_node>()[2] == &x);
+    const file_source& source = get<file_source>(loaded_data.cast<list_node>()[0].source());
+    BOOST_CHECK_EQUAL(source.begin, 10);
+    BOOST_CHECK_EQUAL(source.end, 13);
+    BOOST_CHECK_EQUAL(source.file_id, 7);
+
+    // the interface hash only depends on the exports and the imports
+    module_cache_key other_source = key;
+    other_source.content_hash += 1;
+    BOOST_CHECK(write_module_cache(cache.p.native().c_str(), other_source, file_id, m, imported_modules) == interface_hash);
+    module_cache_key other_imports = key;
+    other_imports.imports_hash += 1;
+    BOOST_CHECK(write_module_cache(cache.p.native().c_str(), other_imports, file_id, m, imported_modules) != interface_hash);
+}
+
+BOOST_AUTO_TEST_CASE(mismatch_test)
+{
+    node& x = lit{"1"};
+    module imported{dynamic_graph{}, {{identifier_id("x"), x}}};
+    vector<const module*> imported_modules = {&imported};
+    module m{dynamic_graph{}, {{identifier_id("y"), list{x}}}};
+
+    cache_file cache;
+    BOOST_REQUIRE(write_module_cache(cache.p.native().c_str(), key, file_id, m, imported_modules));
+
+    module_cache_key other_imports = key;
+    other_imports.imports_hash += 1;
+    BOOST_CHECK(!read_module_cache(cache.p.native().c_str(), other_imports, file_id, imported_modules));
+    module_cache_key other_source = key;
+    other_source.source_size += 1;
+    BOOST_CHECK(!read_module_cache(cache.p.native().c_str(), other_source, file_id, imported_modules));
+
+    // the imported module doesn't export x anymore
+    module changed{dynamic_graph{}, {{identifier_id("z"), x}}};
+    BOOST_CHECK(!read_module_cache(cache.p.native().c_str(), key, file_id, {&changed}));
+}
+
+BOOST_AUTO_TEST_CASE(not_cached_test)
+{
+    cache_file cache;
+    // ids only exist while the compiler runs
+    module with_id{dynamic_graph{}, {{identifier_id("y"), list{id{1}}}}};
+    BOOST_CHECK(!write_module_cache(cache.p.native().c_str(), key, file_id, with_id, {}));
+
+    // as do the ids of other files
+    node& other_file = lit{"a"};
+    other_file.source(file_source{0, 1, file_id + 1});
+    module with_other_file{dynamic_graph{}, {{identifier_id("y"), other_file}}};
+    BOOST_CHECK(!write_module_cache(cache.p.native().c_str(), key, file_id, with_other_file, {}));
+    BOOST_CHECK(!has_module_cache(cache.p.native().c_str(), key.content_hash, key.source_size));
+
+    BOOST_CHECK(uncached_interface_hash(key) != uncached_interface_hash(module_cache_key{key.content_hash, key.source_size, key.imports_hash + 1}));
+}
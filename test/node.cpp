@@ -7,6 +7,7 @@
 
 using std::string;
 using std::exception;
+using std::move;
 
 using boost::get;
 
@@ -121,8 +122,6 @@ BOOST_AUTO_TEST_CASE(dynamic_graph_cloning_test)
     list_node& cloned_list1 = p.first.cast<list_node>();
     dynamic_graph& clone = p.second;
 
-    BOOST_CHECK(clone.data.size() == 3);
-
     BOOST_CHECK(length(rangeify(cloned_list1)) == 2);
     BOOST_CHECK(cloned_list1[0].is<ref_node>());
     BOOST_CHECK(cloned_list1[1].is<lit_node>());
@@ -131,7 +130,146 @@ BOOST_AUTO_TEST_CASE(dynamic_graph_cloning_test)
     BOOST_CHECK_EQUAL(save<string>(ref1_clone.identifier()), "ref1");
     BOOST_CHECK_EQUAL(save<string>(lit1_clone), "lit1");
     BOOST_CHECK_EQUAL(ref1_clone.refered(), &lit1_clone);
+    BOOST_CHECK(&lit1_clone != &lit1);
+    BOOST_CHECK(lit1_clone.begin() != lit1.begin());
 
     BOOST_CHECK(structurally_equal(cloned_list1, list1));
+
+    // the copies belong to clone: extracting them from it copies all three, from graph none
+    auto extracted = clone.extract(cloned_list1);
+    list_node& extracted_list1 = extracted.first.cast<list_node>();
+    BOOST_CHECK(&extracted_list1 != &cloned_list1);
+    BOOST_CHECK(&extracted_list1[0] != &ref1_clone);
+    BOOST_CHECK(&extracted_list1[1] != &lit1_clone);
+    BOOST_CHECK(&graph.extract(cloned_list1).first == &cloned_list1);
+}
+
+BOOST_AUTO_TEST_CASE(dynamic_graph_modification_test)
+{
+    dynamic_graph graph;
+    string source = "123";
+    lit_node& lit = graph.create_lit(source.data(), source.data() + source.size());
+    
+    graph.set_char(lit, 0, '4');
+    BOOST_CHECK_EQUAL(save<string>(lit), "423");
+    BOOST_CHECK_EQUAL(source, "123");
+    BOOST_CHECK_EQUAL(lit.integer().value, 423);
+
+    for(char c = 'a'; c <= 'z'; ++c)
+        graph.push_back(lit, c);
+    graph.pop_back(lit);
+    BOOST_CHECK_EQUAL(save<string>(lit), "423abcdefghijklmnopqrstuvwxy");
+
+    ref_node& ref = graph.create_ref("ref");
+    ref.refered(&lit);
+    string identifier = "new_identifier";
+    graph.set_identifier(ref, identifier.data(), identifier.data() + identifier.size());
+    BOOST_CHECK_EQUAL(save<string>(ref.identifier()), "new_identifier");
+    BOOST_CHECK_EQUAL(ref.identifier_id(), identifier_id("new_identifier"));
+    BOOST_CHECK_EQUAL(ref.refered(), &lit);
+
+    list_node& list = graph.create_list({});
+    for(size_t i = 0; i != 10; ++i)
+        graph.push_back(list, i % 2 == 0 ? static_cast<node&>(lit) : ref);
+    graph.pop_back(list);
+    graph.set_child(list, 1, lit);
+    BOOST_CHECK_EQUAL(list.size(), 9);
+    BOOST_CHECK_EQUAL(&list[1], &lit);
+    BOOST_CHECK_EQUAL(&list[3], &ref);
+}
+
+BOOST_AUTO_TEST_CASE(dynamic_graph_copy_test)
+{
+    // like the characters of a parsed literal, in read-only memory
+    static const char source[] = "abc";
+    dynamic_graph graph;
+    lit_node& original = graph.create_lit(source, source + 3);
+
+    lit_node& copy = graph.copy(original).cast<lit_node>();
+    graph.push_back(copy, 'd');
+    BOOST_CHECK_EQUAL(save<string>(copy), "abcd");
+    BOOST_CHECK_EQUAL(save<string>(original), "abc");
+
+    lit_node& other_copy = graph.copy(original).cast<lit_node>();
+    graph.pop_back(other_copy);
+    graph.push_back(other_copy, 'x');
+    BOOST_CHECK_EQUAL(save<string>(other_copy), "abx");
+    BOOST_CHECK_EQUAL(save<string>(original), "abc");
+
+    // characters the graph owns are not shared by copies either
+    lit_node& owned = graph.create_lit("xyz");
+    lit_node& owned_copy = graph.copy(owned).cast<lit_node>();
+    graph.set_char(owned, 0, 'a');
+    graph.pop_back(owned);
+    graph.push_back(owned, 'b');
+    BOOST_CHECK_EQUAL(save<string>(owned), "ayb");
+    BOOST_CHECK_EQUAL(save<string>(owned_copy), "xyz");
+
+    // pushing onto characters that are not owned copies them first, too
+    lit_node& parsed = graph.create_lit(source, source + 3);
+    graph.pop_back(parsed);
+    graph.push_back(parsed, 'x');
+    BOOST_CHECK_EQUAL(save<string>(parsed), "abx");
+    BOOST_CHECK_EQUAL(string{source}, "abc");
+}
+
+BOOST_AUTO_TEST_CASE(dynamic_graph_extract_test)
+{
+    dynamic_graph outside;
+    lit_node& outside_lit = outside.create_lit("outside");
+
+    dynamic_graph graph;
+    lit_node& lit = graph.create_lit("lit");
+    string chars = "chars";
+    lit_node& external_lit = graph.create_lit(chars.data(), chars.data() + chars.size());
+    ref_node& ref = graph.create_ref("ref");
+    list_node& list = graph.create_list({&lit, &ref, &outside_lit, &external_lit});
+    ref.refered(&list);
+    for(size_t i = 0; i != 1000; ++i)
+        graph.create_list({&graph.create_lit("temporary")});
+    graph.keep_alive(std::make_shared<int>(0));
+
+    auto p = graph.extract(list);
+    {
+        dynamic_graph destroyed = move(graph);
+    }
+    list_node& extracted = p.first.cast<list_node>();
+    BOOST_CHECK(&extracted != &list);
+    BOOST_CHECK_EQUAL(p.second.buffers.size(), 1);
+    BOOST_REQUIRE_EQUAL(extracted.size(), 4);
+    BOOST_CHECK_EQUAL(save<string>(extracted[0].cast<lit_node>()), "lit");
+    BOOST_CHECK_EQUAL(save<string>(extracted[1].cast<ref_node>().identifier()), "ref");
+    BOOST_CHECK_EQUAL(extracted[1].cast<ref_node>().refered(), &extracted);
+    // nodes and characters of other graphs are shared
+    BOOST_CHECK_EQUAL(&extracted[2], &outside_lit);
+    BOOST_CHECK(extracted[3].cast<lit_node>().begin() == chars.data());
+
+    // nodes of other graphs are not copied, and don't make the graph keep anything
+    dynamic_graph empty;
+    auto not_extracted = empty.extract(outside_lit);
+    BOOST_CHECK_EQUAL(&not_extracted.first, &outside_lit);
 }
 
+BOOST_AUTO_TEST_CASE(dynamic_graph_add_test)
+{
+    dynamic_graph graph;
+    list_node* list = &graph.create_list({});
+    for(size_t i = 0; i != 1000; ++i)
+    {
+        dynamic_graph part;
+        macro_node& macro = part.create_macro();
+        macro.function(std::make_shared<std::function<macro_node::macro>>());
+        list_node& new_list = part.create_list({&part.create_lit("lit"), list, &macro});
+        graph.add(move(part));
+        list = &new_list;
+    }
+
+    size_t depth = 0;
+    while(!list->empty())
+    {
+        BOOST_CHECK_EQUAL(save<string>((*list)[0].cast<lit_node>()), "lit");
+        list = &(*list)[1].cast<list_node>();
+        ++depth;
+    }
+    BOOST_CHECK_EQUAL(depth, 1000);
+}
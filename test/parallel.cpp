@@ -0,0 +1,139 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE parallel
+#include <boost/test/unit_test.hpp>
+
+#include "../src/parallel.hpp"
+
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+
+using std::vector;
+using std::atomic;
+using std::size_t;
+using std::runtime_error;
+
+BOOST_AUTO_TEST_CASE(every_index_once_test)
+{
+    vector<atomic<int>> calls(1000);
+    for(atomic<int>& c : calls)
+        c = 0;
+
+    parallel_for(calls.size(), [&](size_t index)
+    {
+        ++calls[index];
+    });
+
+    for(atomic<int>& c : calls)
+        BOOST_CHECK_EQUAL(c.load(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(lowest_failure_test)
+{
+    for(int repetition = 0; repetition != 20; ++repetition)
+    {
+        try
+        {
+            parallel_for(100, [&](size_t index)
+            {
+                if(index % 10 == 7)
+                    throw index;
+            });
+            BOOST_FAIL("no exception thrown");
+        }
+        catch(size_t index)
+        {
+            BOOST_CHECK_EQUAL(index, 7);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(empty_test)
+{
+    parallel_for(0, [&](size_t)
+    {
+        throw runtime_error{"should not be called"};
+    });
+}
+
+
+BOOST_AUTO_TEST_CASE(dag_order_test)
+{
+    // node i depends on i / 2 and i - 1 (if they exist)
+    size_t count = 1000;
+    vector<vector<size_t>> dependencies(count);
+    for(size_t index = 1; index != count; ++index)
+    {
+        dependencies[index].push_back(index / 2);
+        if(index / 2 != index - 1)
+            dependencies[index].push_back(index - 1);
+    }
+    vector<atomic<int>> calls(count);
+    for(atomic<int>& c : calls)
+        c = 0;
+    atomic<int> early_calls{0};
+
+    parallel_for_dag(dependencies, [&](size_t index)
+    {
+        for(size_t dependency : dependencies[index])
+        {
+            if(calls[dependency] != 1)
+                ++early_calls;
+        }
+        ++calls[index];
+    });
+
+    BOOST_CHECK_EQUAL(early_calls.load(), 0);
+    for(atomic<int>& c : calls)
+        BOOST_CHECK_EQUAL(c.load(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(dag_independent_test)
+{
+    // without dependencies, every node is called once
+    vector<vector<size_t>> dependencies(1000);
+    vector<atomic<int>> calls(dependencies.size());
+    for(atomic<int>& c : calls)
+        c = 0;
+    parallel_for_dag(dependencies, [&](size_t index)
+    {
+        ++calls[index];
+    });
+    for(atomic<int>& c : calls)
+        BOOST_CHECK_EQUAL(c.load(), 1);
+
+    parallel_for_dag({}, [&](size_t)
+    {
+        throw runtime_error{"should not be called"};
+    });
+}
+
+BOOST_AUTO_TEST_CASE(dag_failure_test)
+{
+    // 1 and 3 fail, 2 depends on 1 and is skipped, 0 and 4 still run
+    vector<vector<size_t>> dependencies{{}, {}, {1}, {0}, {}};
+    for(int repetition = 0; repetition != 20; ++repetition)
+    {
+        vector<atomic<int>> calls(dependencies.size());
+        for(atomic<int>& c : calls)
+            c = 0;
+        try
+        {
+            parallel_for_dag(dependencies, [&](size_t index)
+            {
+                ++calls[index];
+                if(index == 1 || index == 3)
+                    throw index;
+            });
+            BOOST_FAIL("no exception thrown");
+        }
+        catch(size_t index)
+        {
+            BOOST_CHECK_EQUAL(index, 1);
+        }
+        BOOST_CHECK_EQUAL(calls[0].load(), 1);
+        BOOST_CHECK_EQUAL(calls[2].load(), 0);
+        BOOST_CHECK_EQUAL(calls[3].load(), 1);
+        BOOST_CHECK_EQUAL(calls[4].load(), 1);
+    }
+}
@@ -0,0 +1,132 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE parallel_parse
+#include <boost/test/unit_test.hpp>
+
+#include "../src/parallel_parse.hpp"
+#include "../src/parse.hpp"
+#include "../src/error/compile_exception.hpp"
+
+#include "state_utils.hpp"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::size_t;
+
+using boost::get;
+
+namespace
+{
+
+string source_of(size_t statements)
+{
+    string result = "# leading comment; with a semicolon\n";
+    for(size_t i = 0; i != statements; ++i)
+    {
+        result += "def f" + to_string(i) + " proc ((a (int 64))) (int 64)\n";
+        result += "{\n    block { (let x add a " + to_string(i) + "); (return x); }; # not top level;\n";
+        result += "    \"string with ; and { inside\";\n};\n";
+    }
+    result += "  # trailing comment\n";
+    return result;
+}
+
+bool same_sources(const node& lhs, const node& rhs)
+{
+    const file_source* lhs_source = get<file_source>(&lhs.source());
+    const file_source* rhs_source = get<file_source>(&rhs.source());
+    if(!lhs_source || !rhs_source)
+        return !lhs_source && !rhs_source;
+    if(lhs_source->begin != rhs_source->begin || lhs_source->end != rhs_source->end)
+        return false;
+    if(lhs_source->file_id != rhs_source->file_id)
+        return false;
+    if(lhs.is<list_node>())
+    {
+        const list_node& lhs_list = lhs.cast<list_node>();
+        const list_node& rhs_list = rhs.cast<list_node>();
+        for(size_t i = 0; i != lhs_list.size(); ++i)
+        {
+            if(!same_sources(lhs_list[i], rhs_list[i]))
+                return false;
+        }
+    }
+    return true;
+}
+
+list_node& serial_parse(const string& source)
+{
+    state s{source.data(), source.data() + source.size(), default_file_id, create_graph()};
+    return parse_file(s);
+}
+list_node& parallel_parse(const string& source, size_t chunk_count)
+{
+    return parse_file_parallel(source.data(), source.data() + source.size(), default_file_id, create_graph(),
+            chunk_count);
+}
+
+code_location error_location_of(const string& source, size_t chunk_count)
+{
+    try
+    {
+        if(chunk_count == 0)
+            serial_parse(source);
+        else
+            parallel_parse(source, chunk_count);
+    }
+    catch(const compile_exception& exc)
+    {
+        return get<code_location>(exc.location);
+    }
+    BOOST_FAIL("no error");
+    return {};
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(top_level_ends_test)
+{
+    string source = "a;{b;c};\"d;\" (e;f); # g;\n h";
+    vector<const char*> ends = top_level_ends(source.data(), source.data() + source.size());
+    BOOST_REQUIRE_EQUAL(ends.size(), 3);
+    BOOST_CHECK_EQUAL(ends[0] - source.data(), 2);
+    BOOST_CHECK_EQUAL(ends[1] - source.data(), 8);
+    BOOST_CHECK_EQUAL(ends[2] - source.data(), 19);
+
+    string unbalanced = "a; b }; c;";
+    BOOST_CHECK(top_level_ends(unbalanced.data(), unbalanced.data() + unbalanced.size()).empty());
+    string unterminated = "a; \"b; c;";
+    BOOST_CHECK(top_level_ends(unterminated.data(), unterminated.data() + unterminated.size()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(same_as_serial_test)
+{
+    string source = source_of(200);
+    list_node& expected = serial_parse(source);
+    for(size_t chunk_count : {2, 3, 16, 1000})
+    {
+        list_node& got = parallel_parse(source, chunk_count);
+        BOOST_CHECK(structurally_equal(got, expected));
+        BOOST_CHECK(same_sources(got, expected));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(same_error_as_serial_test)
+{
+    string source = source_of(100);
+    // invalid characters in two places, the first one has to be reported
+    source.replace(source.find("f40 proc") + 4, 1, "?");
+    source.replace(source.find("f70 proc") + 4, 1, "?");
+
+    code_location expected = error_location_of(source, 0);
+    for(size_t chunk_count : {2, 7, 100})
+    {
+        code_location got = error_location_of(source, chunk_count);
+        BOOST_CHECK_EQUAL(got.pos, expected.pos);
+        BOOST_CHECK_EQUAL(got.file_id, expected.file_id);
+    }
+}
+
@@ -58,3 +58,49 @@ BOOST_AUTO_TEST_CASE(no_literal)
     BOOST_CHECK(remaining(s) == "abc");
 }
 
+
+BOOST_AUTO_TEST_CASE(decoded_integer)
+{
+    state s = make_state("9123 \"-5\"");
+
+    lit_node* digits = parse_literal(s);
+    BOOST_REQUIRE(digits);
+    BOOST_CHECK_EQUAL(digits->integer().status, lit_integer::VALID);
+    BOOST_CHECK_EQUAL(digits->integer().value, 9123);
+
+    s.pop_front();
+    lit_node* str = parse_literal(s);
+    BOOST_REQUIRE(str);
+    BOOST_CHECK_EQUAL(str->integer().status, lit_integer::VALID);
+    BOOST_CHECK_EQUAL(str->integer().value, -5);
+}
+
+BOOST_AUTO_TEST_CASE(decode_integer_like_stol)
+{
+    const char* inputs[] = {"0", "42", "-42", "+42", "  7", "7 ", "", "-", "x1", "1x", "007",
+        "9223372036854775807", "9223372036854775808", "-9223372036854775808", "-9223372036854775809",
+        "99999999999999999999", "99999999999999999999x"};
+    for(string input : inputs)
+    {
+        lit_integer got = decode_integer(input.data(), input.data() + input.size());
+        lit_integer::status_t expected_status;
+        long expected_value = 0;
+        try
+        {
+            size_t index_after;
+            expected_value = std::stol(input, &index_after);
+            expected_status = index_after == input.size() ? lit_integer::VALID : lit_integer::INVALID;
+        }
+        catch(const std::invalid_argument&)
+        {
+            expected_status = lit_integer::INVALID;
+        }
+        catch(const std::out_of_range&)
+        {
+            expected_status = lit_integer::OUT_OF_RANGE;
+        }
+        BOOST_CHECK_MESSAGE(got.status == expected_status, input);
+        if(expected_status == lit_integer::VALID)
+            BOOST_CHECK_EQUAL(got.value, expected_value);
+    }
+}
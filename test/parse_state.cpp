@@ -14,32 +14,27 @@ BOOST_AUTO_TEST_CASE(state_test)
     BOOST_CHECK(s.file() == default_file_id);
 
     BOOST_CHECK(!s.empty());
-    BOOST_CHECK_EQUAL(s.position().line, 0);
-    BOOST_CHECK_EQUAL(s.position().line_pos, 0);
+    BOOST_CHECK_EQUAL(s.position(), 0);
     BOOST_CHECK_EQUAL(s.front(), 'a');
     
     s.pop_front();
     BOOST_CHECK(!s.empty());
-    BOOST_CHECK_EQUAL(s.position().line, 0);
-    BOOST_CHECK_EQUAL(s.position().line_pos, 1);
+    BOOST_CHECK_EQUAL(s.position(), 1);
     BOOST_CHECK_EQUAL(s.front(), 's');
 
     s.pop_front();
     BOOST_CHECK(!s.empty());
-    BOOST_CHECK_EQUAL(s.position().line, 0);
-    BOOST_CHECK_EQUAL(s.position().line_pos, 2);
+    BOOST_CHECK_EQUAL(s.position(), 2);
     BOOST_CHECK_EQUAL(s.front(), '\n');
     
     s.pop_front();
     BOOST_CHECK(!s.empty());
-    BOOST_CHECK_EQUAL(s.position().line, 1);
-    BOOST_CHECK_EQUAL(s.position().line_pos, 0);
+    BOOST_CHECK_EQUAL(s.position(), 3);
     BOOST_CHECK_EQUAL(s.front(), 'd');
 
     s.pop_front();
     BOOST_CHECK(!s.empty());
-    BOOST_CHECK_EQUAL(s.position().line, 1);
-    BOOST_CHECK_EQUAL(s.position().line_pos, 1);
+    BOOST_CHECK_EQUAL(s.position(), 4);
     BOOST_CHECK_EQUAL(s.front(), 'f');
 
     s.pop_front();
@@ -61,3 +56,34 @@ sdfsdfsf
 )");
 }
 
+
+BOOST_AUTO_TEST_CASE(advance_test)
+{
+    const char* str = "ab\ncd\n\nef #comment\ngh";
+    state s1 = make_state(str);
+    state s2 = make_state(str);
+
+    for(size_t i = 0; i != 3; ++i)
+        s1.pop_front();
+    s2.advance(s2.begin() + 3);
+    BOOST_CHECK_EQUAL(s1.position(), s2.position());
+    BOOST_CHECK(remaining(s1) == remaining(s2));
+    
+    for(size_t i = 0; i != 7; ++i)
+        s1.pop_front();
+    s2.advance(s2.begin() + 7); // stops at the comment
+    BOOST_CHECK_EQUAL(s1.position(), 18);
+    BOOST_CHECK_EQUAL(s2.position(), 18);
+    BOOST_CHECK(remaining(s1) == remaining(s2));
+}
+
+
+BOOST_AUTO_TEST_CASE(begin_offset_test)
+{
+    const char* str = "ab #comment\ncd";
+    state s{str + 2, str + 14, 2, default_file_id, create_graph()};
+    BOOST_CHECK_EQUAL(s.position(), 2);
+    s.pop_front();
+    BOOST_CHECK_EQUAL(s.position(), 11);
+    BOOST_CHECK_EQUAL(s.front(), '\n');
+}
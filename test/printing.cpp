@@ -6,6 +6,7 @@
 #include "../src/error/parse_error.hpp"
 #include "../src/error/compile_function_error.hpp"
 #include "../src/error/compile_exception.hpp"
+#include "../src/line_table.hpp"
 
 
 #include <string>
@@ -22,25 +23,44 @@ string file_id_to_name(size_t file_id)
     return "testmodule.al";
 };
 
+const line_table* file_id_to_lines(size_t file_id)
+{
+    BOOST_CHECK(file_id == 1);
+    static const string content = "a\nb\nc\nd\ne\nabcdef\n";
+    static const line_table lines{content.data(), content.data() + content.size()};
+    return &lines;
+}
+
 BOOST_AUTO_TEST_CASE(error_lookup_printing_test)
 {
     using namespace parse_error;
-    compile_exception exc{error_kind::PARSE, id("invalid_character"), code_location{{5, 2}, 1}, 5};
+    compile_exception exc{error_kind::PARSE, id("invalid_character"), code_location{12, 1}, 5};
     
 
     ostringstream oss;
-    print(oss, exc, file_id_to_name);
+    print(oss, exc, file_id_to_name, file_id_to_lines);
     BOOST_CHECK_EQUAL(oss.str(), "testmodule.al:6:3: unexpected character: 5\n");
 }
 
 BOOST_AUTO_TEST_CASE(missing_error_message_test)
 {
     using namespace compile_function_error;
-    compile_exception exc{error_kind::COMPILE_FUNCTION, id("empty_statement"), code_location{{5, 2}, 1}};
+    compile_exception exc{error_kind::COMPILE_FUNCTION, id("empty_statement"), code_location{12, 1}};
 
     ostringstream oss;
-    print(oss, exc, file_id_to_name);
+    print(oss, exc, file_id_to_name, file_id_to_lines);
     BOOST_CHECK_EQUAL(oss.str(), "testmodule.al:6:3: <empty_statement> (missing error message)\n");
 }
 
+BOOST_AUTO_TEST_CASE(unknown_lines_printing_test)
+{
+    using namespace parse_error;
+    compile_exception exc{error_kind::PARSE, id("invalid_character"), code_location{12, 1}, 5};
 
+    ostringstream oss;
+    print(oss, exc, file_id_to_name, [](size_t) -> const line_table*
+    {
+        return nullptr;
+    });
+    BOOST_CHECK_EQUAL(oss.str(), "testmodule.al:+12: unexpected character: 5\n");
+}
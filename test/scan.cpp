@@ -0,0 +1,62 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE scan
+#include <boost/test/unit_test.hpp>
+
+#include "../src/scan.hpp"
+
+#include <string>
+#include <random>
+
+using std::string;
+using std::size_t;
+using std::mt19937;
+using std::uniform_int_distribution;
+
+namespace scalar = scan_detail::scalar;
+
+// random strings over an alphabet that makes every scanner stop at varying positions,
+// including the vector boundaries
+string random_input(mt19937& generator, size_t max_length)
+{
+    static const char alphabet[] = " \t\n\nabzAZ_09#;{}\"\x80\xff";
+    uniform_int_distribution<size_t> length_dist{0, max_length};
+    uniform_int_distribution<size_t> char_dist{0, sizeof(alphabet) - 2};
+    uniform_int_distribution<size_t> run_dist{0, 70};
+
+    string result;
+    size_t length = length_dist(generator);
+    while(result.size() < length)
+        result.append(run_dist(generator), alphabet[char_dist(generator)]);
+    result.resize(length);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(matches_scalar_test)
+{
+    mt19937 generator{42};
+    for(size_t i = 0; i != 5000; ++i)
+    {
+        string input = random_input(generator, 200);
+        const char* begin = input.data();
+        const char* end = begin + input.size();
+
+        BOOST_CHECK(scan::skip_whitespace(begin, end) == scalar::skip_whitespace(begin, end));
+        BOOST_CHECK(scan::skip_word_chars(begin, end) == scalar::skip_word_chars(begin, end));
+        BOOST_CHECK(scan::find_newline(begin, end) == scalar::find_newline(begin, end));
+        BOOST_CHECK_EQUAL(scan::count_newlines(begin, end), scalar::count_newlines(begin, end));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(long_runs_test)
+{
+    string input = string(100, ' ') + string(40, '\n') + "x" + string(77, 'a') + "Z_9" + ";";
+    const char* begin = input.data();
+    const char* end = begin + input.size();
+
+    const char* word_begin = scan::skip_whitespace(begin, end);
+    BOOST_CHECK_EQUAL(word_begin - begin, 140);
+    BOOST_CHECK_EQUAL(scan::skip_word_chars(word_begin, end) - begin, input.size() - 1);
+    BOOST_CHECK(scan::find_newline(word_begin, end) == end);
+    BOOST_CHECK_EQUAL(scan::count_newlines(begin, end), 40);
+}
+